@@ -0,0 +1,827 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "tracker-miner-media.h"
+#include "tmm-backend-freebase.h"
+
+/* Replays a corpus of file URIs through the decorator, with the
+ * Freebase backend talking to tmm-stand-in instead of the real
+ * API. libgdata always uses HTTPS on www.googleapis.com, so:
+ *
+ *  - LIBGDATA_HTTPS_PORT points it to the stand-in port, and
+ *    LIBGDATA_LAX_SSL_CERTIFICATES accepts its certificate.
+ *  - A resolver answering 127.0.0.1 for every name is set as
+ *    the default one.
+ *
+ * The cache starts empty, in a temporary XDG_CACHE_HOME, and
+ * there is no store, so every lookup goes to the stand-in.
+ *
+ * With --soak, a million items (unless --items says otherwise) go
+ * through the decorator queue instead, as when mining: the decorator
+ * is initialized against the store, and items are inserted there
+ * SOAK_CHUNK at a time, each with its own URN and URL. Most reuse a
+ * corpus title, the --new-titles share has a title never seen before,
+ * so every lookup misses the caches. Each chunk is deleted from the
+ * store once the next one is done. Anonymous RSS is sampled once past
+ * the warmup, and again at the end; more growth than SOAK_RSS_SLACK
+ * means memory held per item is not given back, and fails the run.
+ * This needs tracker-store, "make bench" runs it on a private
+ * session bus.
+ */
+
+#define SOAK_ITEMS 1000000
+#define SOAK_CHUNK 2000
+#define SOAK_RSS_SLACK (8 * 1024)
+#define BENCH_URN_PREFIX "urn:tmm-bench:"
+
+static gchar *corpus_path = NULL;
+static gchar *stand_in_path = NULL;
+static gchar *responses_dir = NULL;
+static gint n_items = 0;
+static gint max_active_items = 100;
+static gint latency = 50;
+static gint jitter = 25;
+static gdouble error_rate = 0.01;
+static gdouble miss_rate = 0.05;
+static gboolean soak = FALSE;
+static gdouble new_titles = 0.1;
+
+static GOptionEntry entries[] = {
+	{ "corpus", 'c', 0,
+	  G_OPTION_ARG_FILENAME, &corpus_path,
+	  "File URIs to look up (default: corpus.txt in the source directory)",
+	  "FILE" },
+	{ "items", 'n', 0,
+	  G_OPTION_ARG_INT, &n_items,
+	  "Number of items looked up, cycling over the corpus "
+	  "(default: the corpus size)",
+	  "N" },
+	{ "max-active-items", 'a', 0,
+	  G_OPTION_ARG_INT, &max_active_items,
+	  "Items looked up concurrently (default: 100)",
+	  "N" },
+	{ "stand-in", 0, 0,
+	  G_OPTION_ARG_FILENAME, &stand_in_path,
+	  "Path to tmm-stand-in (default: the one in the build directory)",
+	  "PATH" },
+	{ "responses", 'R', 0,
+	  G_OPTION_ARG_FILENAME, &responses_dir,
+	  "Directory with canned replies for the stand-in",
+	  "DIR" },
+	{ "latency", 'l', 0,
+	  G_OPTION_ARG_INT, &latency,
+	  "Stand-in reply latency in milliseconds (default: 50)",
+	  "MS" },
+	{ "jitter", 'j', 0,
+	  G_OPTION_ARG_INT, &jitter,
+	  "Stand-in latency variation in milliseconds (default: 25)",
+	  "MS" },
+	{ "error-rate", 'e', 0,
+	  G_OPTION_ARG_DOUBLE, &error_rate,
+	  "Fraction of stand-in requests failing (default: 0.01)",
+	  "RATE" },
+	{ "miss-rate", 'm', 0,
+	  G_OPTION_ARG_DOUBLE, &miss_rate,
+	  "Fraction of searches finding nothing (default: 0.05)",
+	  "RATE" },
+	{ "soak", 's', 0,
+	  G_OPTION_ARG_NONE, &soak,
+	  "Check that memory stays flat over many items (default: 1000000)",
+	  NULL },
+	{ "new-titles", 0, 0,
+	  G_OPTION_ARG_DOUBLE, &new_titles,
+	  "Fraction of --soak items with a title not seen before (default: 0.1)",
+	  "RATE" },
+	{ NULL }
+};
+
+typedef struct _Bench Bench;
+typedef struct _BenchItem BenchItem;
+
+struct _Bench
+{
+	TmmDecorator *decorator;
+	GMainLoop *loop;
+	GPtrArray *uris;
+
+	guint n_items;
+	guint next_item;
+	guint n_active;
+	guint n_found;
+	guint n_failed;
+
+	/* Anonymous RSS in KiB, past the warmup, for --soak */
+	guint64 baseline_rss;
+	guint64 last_rss;
+	guint next_sample;
+	guint n_chunks;
+
+	gint64 start_time;
+};
+
+struct _BenchItem
+{
+	Bench *bench;
+	gchar *urn;
+	TrackerSparqlBuilder *sparql;
+};
+
+/* Resolves every name to 127.0.0.1 */
+typedef GResolver BenchResolver;
+typedef GResolverClass BenchResolverClass;
+
+G_DEFINE_TYPE (BenchResolver, bench_resolver, G_TYPE_RESOLVER)
+
+static GList *
+bench_resolver_lookup_by_name (GResolver     *resolver,
+                               const gchar   *hostname,
+                               GCancellable  *cancellable,
+                               GError       **error)
+{
+	return g_list_prepend (NULL, g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4));
+}
+
+static void
+bench_resolver_lookup_by_name_async (GResolver           *resolver,
+                                     const gchar         *hostname,
+                                     GCancellable        *cancellable,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             user_data)
+{
+	GTask *task;
+
+	task = g_task_new (resolver, cancellable, callback, user_data);
+	g_task_return_pointer (task,
+	                       bench_resolver_lookup_by_name (resolver, hostname, cancellable, NULL),
+	                       (GDestroyNotify) g_resolver_free_addresses);
+	g_object_unref (task);
+}
+
+static GList *
+bench_resolver_lookup_by_name_finish (GResolver     *resolver,
+                                      GAsyncResult  *result,
+                                      GError       **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+#if GLIB_CHECK_VERSION (2, 60, 0)
+/* Newer GNetworkAddress looks up IPv4 and IPv6 separately */
+static GList *
+bench_resolver_lookup_by_name_with_flags (GResolver                 *resolver,
+                                          const gchar               *hostname,
+                                          GResolverNameLookupFlags   flags,
+                                          GCancellable              *cancellable,
+                                          GError                   **error)
+{
+	if (flags & G_RESOLVER_NAME_LOOKUP_FLAGS_IPV6_ONLY) {
+		g_set_error (error, G_RESOLVER_ERROR, G_RESOLVER_ERROR_NOT_FOUND,
+		             "No IPv6 address for '%s'", hostname);
+		return NULL;
+	}
+
+	return bench_resolver_lookup_by_name (resolver, hostname, cancellable, error);
+}
+
+static void
+bench_resolver_lookup_by_name_with_flags_async (GResolver                 *resolver,
+                                                const gchar               *hostname,
+                                                GResolverNameLookupFlags   flags,
+                                                GCancellable              *cancellable,
+                                                GAsyncReadyCallback        callback,
+                                                gpointer                   user_data)
+{
+	GError *error = NULL;
+	GList *addresses;
+	GTask *task;
+
+	task = g_task_new (resolver, cancellable, callback, user_data);
+	addresses = bench_resolver_lookup_by_name_with_flags (resolver, hostname, flags,
+	                                                      cancellable, &error);
+	if (addresses)
+		g_task_return_pointer (task, addresses, (GDestroyNotify) g_resolver_free_addresses);
+	else
+		g_task_return_error (task, error);
+
+	g_object_unref (task);
+}
+#endif
+
+static void
+bench_resolver_class_init (BenchResolverClass *klass)
+{
+	klass->lookup_by_name = bench_resolver_lookup_by_name;
+	klass->lookup_by_name_async = bench_resolver_lookup_by_name_async;
+	klass->lookup_by_name_finish = bench_resolver_lookup_by_name_finish;
+#if GLIB_CHECK_VERSION (2, 60, 0)
+	klass->lookup_by_name_with_flags = bench_resolver_lookup_by_name_with_flags;
+	klass->lookup_by_name_with_flags_async = bench_resolver_lookup_by_name_with_flags_async;
+	klass->lookup_by_name_with_flags_finish = bench_resolver_lookup_by_name_finish;
+#endif
+}
+
+static void
+bench_resolver_init (BenchResolver *resolver)
+{
+}
+
+/* Accepts "tracker sparql" output as well, anything with a
+ * URI scheme is taken.
+ */
+static GPtrArray *
+corpus_load (const gchar  *path,
+             GError      **error)
+{
+	gchar *contents, **lines;
+	GPtrArray *uris;
+	guint i;
+
+	if (!g_file_get_contents (path, &contents, NULL, error))
+		return NULL;
+
+	uris = g_ptr_array_new_with_free_func (g_free);
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	for (i = 0; lines[i]; i++) {
+		gchar *line = g_strstrip (lines[i]);
+
+		if (line[0] != '#' && strstr (line, "://"))
+			g_ptr_array_add (uris, g_strdup (line));
+	}
+
+	g_strfreev (lines);
+
+	if (uris->len == 0) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+		             "No URIs in '%s'", path);
+		g_ptr_array_unref (uris);
+		return NULL;
+	}
+
+	return uris;
+}
+
+static gboolean
+remove_tree (const gchar *path)
+{
+	const gchar *name;
+	gchar *child;
+	GDir *dir;
+
+	dir = g_dir_open (path, 0, NULL);
+
+	if (dir) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			child = g_build_filename (path, name, NULL);
+			remove_tree (child);
+			g_free (child);
+		}
+
+		g_dir_close (dir);
+	}
+
+	return g_remove (path) == 0;
+}
+
+/* Returns the port the stand-in listens on, or 0 */
+static guint
+stand_in_spawn (GSubprocess **subprocess,
+                GError      **error)
+{
+	GDataInputStream *stream;
+	GPtrArray *argv;
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar *line;
+	guint port = 0;
+
+	argv = g_ptr_array_new_with_free_func (g_free);
+	g_ptr_array_add (argv, g_strdup (stand_in_path));
+	g_ptr_array_add (argv, g_strdup_printf ("--latency=%d", latency));
+	g_ptr_array_add (argv, g_strdup_printf ("--jitter=%d", jitter));
+	g_ptr_array_add (argv, g_strdup_printf ("--error-rate=%s",
+	                                        g_ascii_dtostr (buf, sizeof (buf), error_rate)));
+	g_ptr_array_add (argv, g_strdup_printf ("--miss-rate=%s",
+	                                        g_ascii_dtostr (buf, sizeof (buf), miss_rate)));
+	if (responses_dir)
+		g_ptr_array_add (argv, g_strdup_printf ("--responses=%s", responses_dir));
+	g_ptr_array_add (argv, NULL);
+
+	*subprocess = g_subprocess_newv ((const gchar * const *) argv->pdata,
+	                                 G_SUBPROCESS_FLAGS_STDIN_PIPE |
+	                                 G_SUBPROCESS_FLAGS_STDOUT_PIPE,
+	                                 error);
+	g_ptr_array_unref (argv);
+
+	if (!*subprocess)
+		return 0;
+
+	stream = g_data_input_stream_new (g_subprocess_get_stdout_pipe (*subprocess));
+	line = g_data_input_stream_read_line (stream, NULL, NULL, error);
+	g_object_unref (stream);
+
+	if (line)
+		port = (guint) g_ascii_strtoull (line, NULL, 10);
+
+	if (port == 0) {
+		if (error && !*error)
+			g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+			             "tmm-stand-in didn't start");
+		g_subprocess_force_exit (*subprocess);
+		g_clear_object (subprocess);
+	}
+
+	g_free (line);
+
+	return port;
+}
+
+static void
+stand_in_stop (GSubprocess *subprocess)
+{
+	/* Exits once its stdin is closed */
+	g_output_stream_close (g_subprocess_get_stdin_pipe (subprocess), NULL, NULL);
+	g_subprocess_wait (subprocess, NULL, NULL);
+	g_object_unref (subprocess);
+}
+
+/* Anonymous resident memory in KiB, 0 if unknown. Unlike the
+ * whole RSS, it leaves out the mapped cache file.
+ */
+static guint64
+get_rss_anon (void)
+{
+	gchar *contents, *line;
+	guint64 rss = 0;
+
+	if (!g_file_get_contents ("/proc/self/status", &contents, NULL, NULL))
+		return 0;
+
+	line = strstr (contents, "\nRssAnon:");
+
+	if (line)
+		rss = g_ascii_strtoull (line + strlen ("\nRssAnon:"), NULL, 10);
+
+	g_free (contents);
+
+	return rss;
+}
+
+/* Samples once per tenth of the items done */
+static void
+bench_soak_sample (Bench *bench,
+                   guint  n_done)
+{
+	guint step;
+
+	step = MAX (bench->n_items / 10, 1);
+
+	if (n_done < bench->next_sample)
+		return;
+
+	bench->next_sample = (n_done / step + 1) * step;
+	bench->last_rss = get_rss_anon ();
+
+	/* Caches and pools are filled by the first tenth */
+	if (bench->baseline_rss == 0 && n_done >= step)
+		bench->baseline_rss = bench->last_rss;
+
+	g_print ("soak:      %u items, RssAnon %" G_GUINT64_FORMAT " KiB\n",
+	         n_done, bench->last_rss);
+}
+
+/* A title made of letters only, digits would be taken
+ * for a year or an episode number.
+ */
+static gchar *
+bench_soak_title (guint index)
+{
+	GString *title;
+
+	title = g_string_new (NULL);
+
+	do {
+		g_string_append_c (title, 'a' + index % 26);
+		index /= 26;
+	} while (index > 0);
+
+	title->str[0] = g_ascii_toupper (title->str[0]);
+
+	return g_string_free (title, FALSE);
+}
+
+/* Each item gets a URL of its own, under a directory far enough
+ * up not to change what is guessed from the corpus path.
+ */
+static gchar *
+bench_soak_url (Bench *bench,
+                guint  index)
+{
+	const gchar *uri, *path;
+	gchar *title, *url;
+
+	if (g_random_double () < new_titles) {
+		title = bench_soak_title (index);
+		url = g_strdup_printf ("file:///tmm-bench-%u/Videos/%s.mkv", index, title);
+		g_free (title);
+		return url;
+	}
+
+	uri = g_ptr_array_index (bench->uris, index % bench->uris->len);
+	path = strchr (strstr (uri, "://") + 3, '/');
+
+	return g_strdup_printf ("file:///tmm-bench-%u%s", index, path ? path : "/");
+}
+
+static gboolean
+bench_soak_update (Bench        *bench,
+                   const gchar  *sparql,
+                   GError      **error)
+{
+	TrackerSparqlConnection *conn;
+	GError *inner_error = NULL;
+
+	conn = tracker_miner_get_connection (TRACKER_MINER (bench->decorator));
+	tracker_sparql_connection_update (conn, sparql, G_PRIORITY_DEFAULT,
+	                                  NULL, &inner_error);
+
+	if (inner_error) {
+		g_propagate_error (error, inner_error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Counts the items in @chunk the decorator gave data to */
+static guint
+bench_soak_count_found (Bench *bench,
+                        guint  chunk)
+{
+	TrackerSparqlConnection *conn;
+	TrackerSparqlCursor *cursor;
+	guint n_found = 0;
+	gchar *query;
+
+	conn = tracker_miner_get_connection (TRACKER_MINER (bench->decorator));
+	query = g_strdup_printf ("SELECT COUNT (?urn) {"
+	                         "  ?urn a nfo:Video ;"
+	                         "       nie:dataSource <%s> ."
+	                         "  FILTER (STRSTARTS (STR (?urn), \"" BENCH_URN_PREFIX "%u-\"))"
+	                         "}",
+	                         TMM_DATA_SOURCE, chunk);
+	cursor = tracker_sparql_connection_query (conn, query, NULL, NULL);
+	g_free (query);
+
+	if (cursor && tracker_sparql_cursor_next (cursor, NULL, NULL))
+		n_found = (guint) tracker_sparql_cursor_get_integer (cursor, 0);
+
+	g_clear_object (&cursor);
+
+	return n_found;
+}
+
+/* Called once the last chunk inserted is done: the one before goes
+ * away, its updates were confirmed by the decorator meanwhile, and
+ * the next one is inserted. Returns FALSE on errors.
+ */
+static gboolean
+bench_soak_feed (Bench   *bench,
+                 GError **error)
+{
+	GString *sparql;
+	gchar *query, *url;
+	guint i, n_found, end;
+	gboolean success;
+
+	if (bench->n_active > 0) {
+		bench_soak_sample (bench, bench->next_item);
+
+		n_found = MIN (bench_soak_count_found (bench, bench->n_chunks - 1),
+		               bench->n_active);
+		bench->n_found += n_found;
+		bench->n_failed += bench->n_active - n_found;
+		bench->n_active = 0;
+	}
+
+	if (bench->n_chunks > 1) {
+		query = g_strdup_printf ("DELETE { ?urn a rdfs:Resource } WHERE {"
+		                         "  ?urn a nfo:Video ."
+		                         "  FILTER (STRSTARTS (STR (?urn), \"" BENCH_URN_PREFIX "%u-\"))"
+		                         "}",
+		                         bench->n_chunks - 2);
+		success = bench_soak_update (bench, query, error);
+		g_free (query);
+
+		if (!success)
+			return FALSE;
+	}
+
+	if (bench->next_item == bench->n_items) {
+		g_main_loop_quit (bench->loop);
+		return TRUE;
+	}
+
+	sparql = g_string_new ("INSERT {");
+	end = MIN (bench->next_item + SOAK_CHUNK, bench->n_items);
+
+	for (i = bench->next_item; i < end; i++) {
+		url = bench_soak_url (bench, i);
+		g_string_append_printf (sparql,
+		                        " <" BENCH_URN_PREFIX "%u-%u> a nfo:Video, nfo:FileDataObject ;"
+		                        "   nie:url \"%s\" ;"
+		                        "   tracker:available true .",
+		                        bench->n_chunks, i, url);
+		g_free (url);
+	}
+
+	g_string_append (sparql, " }");
+	bench->n_active = end - bench->next_item;
+	bench->next_item = end;
+	bench->n_chunks++;
+
+	success = bench_soak_update (bench, sparql->str, error);
+	g_string_free (sparql, TRUE);
+
+	return success;
+}
+
+static void
+bench_soak_finished_cb (TrackerDecorator *decorator,
+                        Bench            *bench)
+{
+	TmmDecoratorStats stats;
+	GError *error = NULL;
+
+	/* Also emitted before the decorator notices a new chunk */
+	tmm_decorator_get_stats (bench->decorator, &stats);
+
+	if (stats.n_items < bench->next_item)
+		return;
+
+	if (!bench_soak_feed (bench, &error)) {
+		g_printerr ("Could not update the store: %s\n", error->message);
+		g_error_free (error);
+		bench->n_failed += bench->n_active;
+		bench->n_active = 0;
+		g_main_loop_quit (bench->loop);
+	}
+}
+
+/* Runs the items through tracker_decorator_next(), as mining does */
+static gboolean
+bench_soak_start (Bench   *bench,
+                  GError **error)
+{
+	if (!g_initable_init (G_INITABLE (bench->decorator), NULL, error))
+		return FALSE;
+
+	g_signal_connect_after (bench->decorator, "finished",
+	                        G_CALLBACK (bench_soak_finished_cb), bench);
+	tracker_miner_start (TRACKER_MINER (bench->decorator));
+
+	return bench_soak_feed (bench, error);
+}
+
+static void bench_process_more (Bench *bench);
+
+static void
+bench_item_done_cb (GObject      *object,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+	BenchItem *item = user_data;
+	Bench *bench = item->bench;
+	GError *error = NULL;
+
+	if (tmm_decorator_process_file_finish (TMM_DECORATOR (object), result, &error)) {
+		/* Nothing is written, but it's as good as committed */
+		tmm_decorator_file_committed (bench->decorator, item->urn, TRUE);
+		bench->n_found++;
+	} else {
+		g_debug ("Lookup failed for '%s': %s", item->urn, error->message);
+		g_error_free (error);
+		bench->n_failed++;
+	}
+
+	g_object_unref (item->sparql);
+	g_free (item->urn);
+	g_free (item);
+
+	bench->n_active--;
+	bench_process_more (bench);
+}
+
+static void
+bench_process_more (Bench *bench)
+{
+	BenchItem *item;
+	GFile *file;
+	guint index;
+
+	while (bench->n_active < (guint) max_active_items &&
+	       bench->next_item < bench->n_items) {
+		index = bench->next_item % bench->uris->len;
+
+		item = g_new0 (BenchItem, 1);
+		item->bench = bench;
+		item->urn = g_strdup_printf (BENCH_URN_PREFIX "%u", bench->next_item);
+		item->sparql = tracker_sparql_builder_new_update ();
+
+		file = g_file_new_for_uri (g_ptr_array_index (bench->uris, index));
+		bench->next_item++;
+		bench->n_active++;
+
+		tmm_decorator_process_file_async (bench->decorator, file, item->urn,
+		                                  NULL, item->sparql, NULL,
+		                                  bench_item_done_cb, item);
+		g_object_unref (file);
+	}
+
+	if (bench->n_active == 0 && bench->next_item == bench->n_items)
+		g_main_loop_quit (bench->loop);
+}
+
+static void
+bench_print_results (Bench *bench)
+{
+	TmmDecoratorStats stats;
+	gdouble elapsed;
+
+	elapsed = (gdouble) (g_get_monotonic_time () - bench->start_time) / G_USEC_PER_SEC;
+	tmm_decorator_get_stats (bench->decorator, &stats);
+
+	g_print ("items:     %u (%u found, %u failed) in %.2fs\n",
+	         bench->n_items, bench->n_found, bench->n_failed, elapsed);
+	g_print ("items/s:   %.1f\n", bench->n_items / MAX (elapsed, 0.001));
+	g_print ("latency:   p50 %.1fms, p95 %.1fms, p99 %.1fms\n",
+	         stats.latency_p50 / 1000.0,
+	         stats.latency_p95 / 1000.0,
+	         stats.latency_p99 / 1000.0);
+	g_print ("requests:  %" G_GUINT64_FORMAT ", %.2f per item\n",
+	         stats.n_requests, stats.requests_per_item);
+	g_print ("peak RSS:  %" G_GUINT64_FORMAT " KiB\n", stats.peak_rss);
+	g_print ("in flight: %u items, %" G_GUINT64_FORMAT " bytes held\n",
+	         stats.n_live_items, stats.live_bytes);
+}
+
+/* Returns FALSE if anonymous memory grew past the slack */
+static gboolean
+bench_check_soak (Bench *bench)
+{
+	gint64 growth;
+
+	if (bench->baseline_rss == 0 || bench->last_rss == 0) {
+		g_print ("soak:      no RssAnon to compare, skipped\n");
+		return TRUE;
+	}
+
+	growth = (gint64) bench->last_rss - (gint64) bench->baseline_rss;
+	g_print ("soak:      RssAnon grew %" G_GINT64_FORMAT " KiB past the warmup "
+	         "(at most %d KiB allowed)\n", growth, SOAK_RSS_SLACK);
+
+	return growth <= SOAK_RSS_SLACK;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+	gchar *cache_dir, *port_str;
+	GOptionContext *context;
+	GSubprocess *stand_in;
+	GResolver *resolver;
+	GError *error = NULL;
+	TmmBackend *backend;
+	gchar *classes[] = { "nfo:Video", NULL };
+	gboolean success = TRUE;
+	Bench bench;
+	guint port;
+
+	setlocale (LC_ALL, "");
+
+	context = g_option_context_new ("- Benchmark lookups against a local stand-in server");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free (context);
+
+	if (!corpus_path)
+		corpus_path = g_build_filename (TMM_BENCH_SRCDIR, "corpus.txt", NULL);
+	if (!stand_in_path)
+		stand_in_path = g_build_filename (TMM_BENCH_BUILDDIR, "tmm-stand-in", NULL);
+
+	memset (&bench, 0, sizeof (Bench));
+	bench.uris = corpus_load (corpus_path, &error);
+
+	if (!bench.uris) {
+		g_printerr ("Could not load corpus: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+
+	if (n_items > 0)
+		bench.n_items = n_items;
+	else
+		bench.n_items = soak ? SOAK_ITEMS : bench.uris->len;
+
+	/* Before anything reads it, so the user's cache is left alone */
+	cache_dir = g_dir_make_tmp ("tmm-bench-XXXXXX", &error);
+
+	if (!cache_dir) {
+		g_printerr ("Could not create cache directory: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+
+	g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+
+	port = stand_in_spawn (&stand_in, &error);
+
+	if (port == 0) {
+		g_printerr ("Could not start stand-in server: %s\n", error->message);
+		g_error_free (error);
+		remove_tree (cache_dir);
+		return EXIT_FAILURE;
+	}
+
+	port_str = g_strdup_printf ("%u", port);
+	g_setenv ("LIBGDATA_HTTPS_PORT", port_str, TRUE);
+	g_setenv ("LIBGDATA_LAX_SSL_CERTIFICATES", "1", TRUE);
+	g_setenv ("GIO_USE_PROXY_RESOLVER", "dummy", TRUE);
+	g_free (port_str);
+
+	resolver = g_object_new (bench_resolver_get_type (), NULL);
+	g_resolver_set_default (resolver);
+	g_object_unref (resolver);
+
+	/* Not initialized, so there's no store connection */
+	backend = tmm_backend_freebase_new ();
+	bench.decorator = g_object_new (TMM_TYPE_DECORATOR,
+	                                "name", "Media",
+	                                "data-source", TMM_DATA_SOURCE,
+	                                "class-names", classes,
+	                                "backend", backend,
+	                                "max-active-items", max_active_items,
+	                                "request-rate", 0.0,
+	                                NULL);
+	g_object_unref (backend);
+
+	bench.loop = g_main_loop_new (NULL, FALSE);
+	bench.start_time = g_get_monotonic_time ();
+
+	if (!soak) {
+		bench_process_more (&bench);
+	} else if (!bench_soak_start (&bench, &error)) {
+		/* Initializing fails without tracker-store */
+		g_printerr ("Could not start the soak run: %s\n", error->message);
+		g_clear_error (&error);
+		success = FALSE;
+	}
+
+	if (success)
+		g_main_loop_run (bench.loop);
+
+	bench_print_results (&bench);
+
+	if (soak && success)
+		success = bench_check_soak (&bench);
+
+	g_object_unref (bench.decorator);
+	g_main_loop_unref (bench.loop);
+	g_ptr_array_unref (bench.uris);
+	stand_in_stop (stand_in);
+
+	remove_tree (cache_dir);
+	g_free (cache_dir);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
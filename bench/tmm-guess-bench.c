@@ -0,0 +1,466 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmm-guess.h"
+
+/* Checks tmm_guess_parse() against a corpus of file names, then
+ * times it. Each corpus line is either a bare path, only used for
+ * timing, or:
+ *
+ *   path <TAB> title <TAB> year <TAB> season <TAB> episode
+ *
+ * Lines starting with '#' are ignored, so are bare lines that are
+ * neither a path nor a file:// URI. A real collection can be timed
+ * with the output of:
+ *
+ *   tracker sparql -q "SELECT nie:url(?u) { ?u a nfo:Video }"
+ *
+ * Exits with an error status if any guess differs from the expected
+ * one, so it doubles as the "make check" test.
+ *
+ * No large labeled corpus of real file names ships with it. Instead,
+ * --generate renders the checked entries through common naming
+ * schemes (release tags, separators, season directories, episode
+ * numbering) into as many labeled names as asked for. Accuracy over
+ * those is only reported, some renderings are ambiguous by nature.
+ */
+
+typedef struct _CorpusEntry CorpusEntry;
+
+struct _CorpusEntry
+{
+	gchar *path;
+	gboolean checked;
+	TmmGuess expected;
+};
+
+static gchar *corpus_path = NULL;
+static gint n_parses = 100000;
+static gint n_generate = 0;
+static gboolean verbose = FALSE;
+
+static GOptionEntry entries[] = {
+	{ "corpus", 'c', 0,
+	  G_OPTION_ARG_FILENAME, &corpus_path,
+	  "File names to parse (default: guess-corpus.txt in the source directory)",
+	  "FILE" },
+	{ "parses", 'n', 0,
+	  G_OPTION_ARG_INT, &n_parses,
+	  "Number of parses timed, cycling over the corpus (default: 100000)",
+	  "N" },
+	{ "generate", 'g', 0,
+	  G_OPTION_ARG_INT, &n_generate,
+	  "Check and time N names generated from the checked entries instead",
+	  "N" },
+	{ "verbose", 'v', 0,
+	  G_OPTION_ARG_NONE, &verbose,
+	  "Print every guess, not only the wrong ones",
+	  NULL },
+	{ NULL }
+};
+
+static void
+corpus_entry_clear (CorpusEntry *entry)
+{
+	g_free (entry->path);
+}
+
+static GArray *
+corpus_load (const gchar  *path,
+             GError      **error)
+{
+	gchar *contents, **lines;
+	GArray *corpus;
+	guint i;
+
+	if (!g_file_get_contents (path, &contents, NULL, error))
+		return NULL;
+
+	corpus = g_array_new (FALSE, TRUE, sizeof (CorpusEntry));
+	g_array_set_clear_func (corpus, (GDestroyNotify) corpus_entry_clear);
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	for (i = 0; lines[i]; i++) {
+		CorpusEntry entry = { 0 };
+		gchar **fields;
+
+		if (lines[i][0] == '\0' || lines[i][0] == '#')
+			continue;
+
+		fields = g_strsplit (lines[i], "\t", -1);
+
+		if (g_strv_length (fields) == 1) {
+			gchar *line = g_strstrip (fields[0]);
+
+			/* As listed by "tracker sparql" */
+			if (g_str_has_prefix (line, "file://"))
+				entry.path = g_filename_from_uri (line, NULL, NULL);
+			else if (line[0] == G_DIR_SEPARATOR)
+				entry.path = g_strdup (line);
+
+			if (entry.path)
+				g_array_append_val (corpus, entry);
+
+			g_strfreev (fields);
+			continue;
+		}
+
+		if (g_strv_length (fields) == 5) {
+			entry.checked = TRUE;
+			g_strlcpy (entry.expected.title, fields[1],
+			           sizeof (entry.expected.title));
+			entry.expected.year = atoi (fields[2]);
+			entry.expected.season = atoi (fields[3]);
+			entry.expected.episode = atoi (fields[4]);
+		} else {
+			g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			             "%s:%d: expected 1 or 5 fields",
+			             path, i + 1);
+			g_strfreev (fields);
+			g_strfreev (lines);
+			g_array_unref (corpus);
+			return NULL;
+		}
+
+		entry.path = g_strdup (fields[0]);
+		g_array_append_val (corpus, entry);
+		g_strfreev (fields);
+	}
+
+	g_strfreev (lines);
+
+	return corpus;
+}
+
+static gboolean
+guess_equal (const TmmGuess *guess,
+             const TmmGuess *expected)
+{
+	return (strcmp (guess->title, expected->title) == 0 &&
+	        guess->year == expected->year &&
+	        guess->season == expected->season &&
+	        guess->episode == expected->episode);
+}
+
+static const gchar *film_tags[] = {
+	"1080p.BluRay.x264", "720p.WEB-DL.AAC", "DVDRip.XviD",
+	"2160p.UHD.HDR.x265", "REMASTERED.1080p", "BRRip"
+};
+
+static const gchar *episode_tags[] = {
+	"720p.HDTV.x264", "1080p.WEB.H264", "DVDRip.XviD", "1080p.AMZN.WEB-DL"
+};
+
+/* @title with spaces replaced by @separator */
+static gchar *
+title_separate (const gchar *title,
+                gchar        separator)
+{
+	gchar *separated;
+
+	separated = g_strdup (title);
+	g_strdelimit (separated, " ", separator);
+
+	return separated;
+}
+
+static gchar *
+generate_film_path (GRand          *rand,
+                    const TmmGuess *expected)
+{
+	const gchar *tag;
+	gchar *dotted, *path;
+
+	tag = film_tags[g_rand_int_range (rand, 0, G_N_ELEMENTS (film_tags))];
+
+	if (expected->year == 0)
+		return g_strdup_printf ("/home/user/Videos/%s.mkv", expected->title);
+
+	switch (g_rand_int_range (rand, 0, 5)) {
+	case 0:
+		return g_strdup_printf ("/home/user/Videos/%s (%d).mkv",
+		                        expected->title, expected->year);
+	case 1:
+		dotted = title_separate (expected->title, '.');
+		path = g_strdup_printf ("/home/user/Videos/%s.%d.%s.mkv",
+		                        dotted, expected->year, tag);
+		g_free (dotted);
+		return path;
+	case 2:
+		return g_strdup_printf ("/home/user/Videos/%s %d 1080p.mp4",
+		                        expected->title, expected->year);
+	case 3:
+		return g_strdup_printf ("/home/user/Videos/Movies/%s (%d)/%s (%d).mkv",
+		                        expected->title, expected->year,
+		                        expected->title, expected->year);
+	default:
+		dotted = title_separate (expected->title, '_');
+		path = g_strdup_printf ("/home/user/Videos/%s_%d_DVDRip.avi",
+		                        dotted, expected->year);
+		g_free (dotted);
+		return path;
+	}
+}
+
+static gchar *
+generate_episode_path (GRand          *rand,
+                       const TmmGuess *expected)
+{
+	const gchar *tag;
+	gchar *dotted, *path;
+
+	tag = episode_tags[g_rand_int_range (rand, 0, G_N_ELEMENTS (episode_tags))];
+	dotted = title_separate (expected->title, '.');
+
+	switch (g_rand_int_range (rand, 0, 4)) {
+	case 0:
+		path = g_strdup_printf ("/home/user/Videos/Series/%s/Season %d/%s.S%02dE%02d.%s.mkv",
+		                        expected->title, expected->season, dotted,
+		                        expected->season, expected->episode, tag);
+		break;
+	case 1:
+		path = g_strdup_printf ("/home/user/Videos/%s S%02dE%02d.mkv",
+		                        expected->title, expected->season,
+		                        expected->episode);
+		break;
+	case 2:
+		path = g_strdup_printf ("/home/user/Videos/%s - %dx%02d.avi",
+		                        expected->title, expected->season,
+		                        expected->episode);
+		break;
+	default:
+		path = g_strdup_printf ("/home/user/Videos/%s.S%02dE%02d.%s.mkv",
+		                        dotted, expected->season,
+		                        expected->episode, tag);
+		break;
+	}
+
+	g_free (dotted);
+
+	return path;
+}
+
+/* Labeled names rendered from the checked entries in @corpus,
+ * series get other season and episode numbers, and no year.
+ */
+static GArray *
+corpus_generate (GArray *corpus,
+                 guint   n)
+{
+	GPtrArray *templates;
+	GArray *generated;
+	GRand *rand;
+	guint i;
+
+	templates = g_ptr_array_new ();
+
+	for (i = 0; i < corpus->len; i++) {
+		CorpusEntry *entry = &g_array_index (corpus, CorpusEntry, i);
+
+		if (entry->checked)
+			g_ptr_array_add (templates, &entry->expected);
+	}
+
+	generated = g_array_sized_new (FALSE, TRUE, sizeof (CorpusEntry), n);
+	g_array_set_clear_func (generated, (GDestroyNotify) corpus_entry_clear);
+
+	/* Same names on every run */
+	rand = g_rand_new_with_seed (0);
+
+	for (i = 0; templates->len > 0 && i < n; i++) {
+		const TmmGuess *template;
+		CorpusEntry entry = { 0 };
+
+		template = g_ptr_array_index (templates,
+		                              g_rand_int_range (rand, 0, templates->len));
+		entry.checked = TRUE;
+		entry.expected = *template;
+
+		if (template->season > 0) {
+			entry.expected.year = 0;
+			entry.expected.season = g_rand_int_range (rand, 1, 13);
+			entry.expected.episode = g_rand_int_range (rand, 1, 25);
+			entry.path = generate_episode_path (rand, &entry.expected);
+		} else {
+			entry.path = generate_film_path (rand, &entry.expected);
+		}
+
+		g_array_append_val (generated, entry);
+	}
+
+	g_rand_free (rand);
+	g_ptr_array_unref (templates);
+
+	return generated;
+}
+
+/* Returns the number of wrong guesses, which are
+ * printed unless @quiet and not verbose.
+ */
+static guint
+corpus_check (GArray   *corpus,
+              gboolean  quiet,
+              guint    *n_checked)
+{
+	guint i, n_wrong = 0;
+	TmmGuess guess;
+
+	*n_checked = 0;
+
+	for (i = 0; i < corpus->len; i++) {
+		CorpusEntry *entry = &g_array_index (corpus, CorpusEntry, i);
+		gboolean equal;
+
+		if (!entry->checked)
+			continue;
+
+		tmm_guess_parse (entry->path, &guess);
+		equal = guess_equal (&guess, &entry->expected);
+		(*n_checked)++;
+
+		if (!equal) {
+			n_wrong++;
+
+			if (quiet && !verbose)
+				continue;
+
+			g_print ("FAIL %s\n"
+			         "     got      \"%s\" year %d S%02dE%02d\n"
+			         "     expected \"%s\" year %d S%02dE%02d\n",
+			         entry->path,
+			         guess.title, guess.year, guess.season, guess.episode,
+			         entry->expected.title, entry->expected.year,
+			         entry->expected.season, entry->expected.episode);
+		} else if (verbose) {
+			g_print ("ok   %s\n", entry->path);
+		}
+	}
+
+	return n_wrong;
+}
+
+static gdouble
+corpus_time (GArray *corpus,
+             gint    n)
+{
+	gint64 start;
+	TmmGuess guess;
+	guint i = 0;
+	gint year_sum = 0;
+
+	start = g_get_monotonic_time ();
+
+	while (n-- > 0) {
+		tmm_guess_parse (g_array_index (corpus, CorpusEntry, i).path, &guess);
+		/* Keeps the calls from being optimized away */
+		year_sum += guess.year;
+
+		if (++i == corpus->len)
+			i = 0;
+	}
+
+	if (year_sum == -1)
+		g_print ("\n");
+
+	return (g_get_monotonic_time () - start) / (gdouble) G_USEC_PER_SEC;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	guint n_checked, n_wrong;
+	GArray *corpus;
+	gdouble elapsed;
+
+	setlocale (LC_ALL, "");
+
+	context = g_option_context_new ("- Check and time file name guessing");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free (context);
+
+	if (!corpus_path)
+		corpus_path = g_build_filename (TMM_BENCH_SRCDIR, "guess-corpus.txt", NULL);
+
+	corpus = corpus_load (corpus_path, &error);
+
+	if (!corpus) {
+		g_printerr ("Could not load corpus: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+
+	if (corpus->len == 0) {
+		g_printerr ("Empty corpus: %s\n", corpus_path);
+		g_array_unref (corpus);
+		return EXIT_FAILURE;
+	}
+
+	if (n_generate > 0) {
+		GArray *generated;
+
+		generated = corpus_generate (corpus, n_generate);
+		g_array_unref (corpus);
+		corpus = generated;
+
+		if (corpus->len == 0) {
+			g_printerr ("No checked entries to generate names from: %s\n",
+			            corpus_path);
+			g_array_unref (corpus);
+			return EXIT_FAILURE;
+		}
+	}
+
+	n_wrong = corpus_check (corpus, n_generate > 0, &n_checked);
+
+	if (n_checked > 0) {
+		g_print ("accuracy: %u/%u (%.1f%%)\n",
+		         n_checked - n_wrong, n_checked,
+		         100.0 * (n_checked - n_wrong) / n_checked);
+	}
+
+	if (n_parses > 0) {
+		elapsed = corpus_time (corpus, n_parses);
+		g_print ("parses: %d in %.3fs, %.0f parses/s, %.0f ns/parse\n",
+		         n_parses, elapsed,
+		         elapsed > 0 ? n_parses / elapsed : 0,
+		         elapsed * 1e9 / n_parses);
+	}
+
+	g_array_unref (corpus);
+	g_free (corpus_path);
+
+	/* Generated names are for measuring, not checking */
+	return n_wrong > 0 && n_generate == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,599 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <json-glib/json-glib.h>
+#include <libsoup/soup.h>
+
+/* Local stand-in for the Freebase API, so lookups can be
+ * benchmarked without the network:
+ *
+ *  - search, topic and mqlread requests get synthetic replies,
+ *    derived from the request so they are stable across runs,
+ *    unless a canned reply is found in --responses, named after
+ *    the SHA-1 of the request path and query, plus ".json".
+ *  - Replies are delayed by --latency, give or take --jitter,
+ *    and fail with 503 at --error-rate.
+ *
+ * Listens on HTTPS on 127.0.0.1 and prints the port on stdout,
+ * then runs until stdin is closed.
+ */
+
+static gchar *certificate_path = NULL;
+static gchar *responses_dir = NULL;
+static gint latency = 0;
+static gint jitter = 0;
+static gdouble error_rate = 0;
+static gdouble miss_rate = 0.05;
+static gint seed = 0;
+
+static GOptionEntry entries[] = {
+	{ "certificate", 'c', 0,
+	  G_OPTION_ARG_FILENAME, &certificate_path,
+	  "PEM file with the TLS certificate and key (default: stand-in.pem "
+	  "in the source directory)",
+	  "FILE" },
+	{ "responses", 'R', 0,
+	  G_OPTION_ARG_FILENAME, &responses_dir,
+	  "Directory with canned replies",
+	  "DIR" },
+	{ "latency", 'l', 0,
+	  G_OPTION_ARG_INT, &latency,
+	  "Milliseconds before replying (default: 0)",
+	  "MS" },
+	{ "jitter", 'j', 0,
+	  G_OPTION_ARG_INT, &jitter,
+	  "Random variation of the latency, in milliseconds (default: 0)",
+	  "MS" },
+	{ "error-rate", 'e', 0,
+	  G_OPTION_ARG_DOUBLE, &error_rate,
+	  "Fraction of requests failing with 503 (default: 0)",
+	  "RATE" },
+	{ "miss-rate", 'm', 0,
+	  G_OPTION_ARG_DOUBLE, &miss_rate,
+	  "Fraction of searches finding nothing (default: 0.05)",
+	  "RATE" },
+	{ "seed", 's', 0,
+	  G_OPTION_ARG_INT, &seed,
+	  "Seed for latencies and errors (default: 0)",
+	  "N" },
+	{ NULL }
+};
+
+typedef struct _StandIn StandIn;
+typedef struct _DelayedReply DelayedReply;
+typedef struct _MqlFill MqlFill;
+
+struct _StandIn
+{
+	SoupServer *server;
+	GRand *rand;
+	GMainLoop *loop;
+	guint64 n_requests;
+	guint64 n_errors;
+};
+
+struct _DelayedReply
+{
+	SoupServer *server;
+	SoupMessage *msg;
+};
+
+struct _MqlFill
+{
+	JsonBuilder *builder;
+	const gchar *id;
+	gint episode;
+};
+
+static const gchar error_reply[] =
+	"{ \"error\": { \"errors\": [{ \"domain\": \"global\","
+	"                              \"reason\": \"backendError\","
+	"                              \"message\": \"Backend Error\" }],"
+	"              \"code\": 503,"
+	"              \"message\": \"Backend Error\" } }";
+
+/* Stable for a given string, so replies don't change across runs */
+static guint32
+string_hash (const gchar *str)
+{
+	guint32 hash = 2166136261U;
+
+	for (; *str; str++) {
+		hash ^= (guchar) g_ascii_tolower (*str);
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+static gchar *
+mid_for_string (const gchar *str)
+{
+	return g_strdup_printf ("/m/0%08x", string_hash (str));
+}
+
+static void
+builder_add_topic_value (JsonBuilder *builder,
+                         const gchar *valuetype,
+                         const gchar *text)
+{
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "valuetype");
+	json_builder_add_string_value (builder, valuetype);
+	json_builder_set_member_name (builder, "values");
+	json_builder_begin_array (builder);
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "text");
+	json_builder_add_string_value (builder, text);
+	json_builder_set_member_name (builder, "lang");
+	json_builder_add_string_value (builder, "en");
+	json_builder_set_member_name (builder, "value");
+	json_builder_add_string_value (builder, text);
+	json_builder_end_object (builder);
+	json_builder_end_array (builder);
+	json_builder_set_member_name (builder, "count");
+	json_builder_add_double_value (builder, 1);
+	json_builder_end_object (builder);
+}
+
+static gchar *
+builder_free_to_data (JsonBuilder *builder)
+{
+	JsonGenerator *generator;
+	JsonNode *root;
+	gchar *data;
+
+	root = json_builder_get_root (builder);
+	generator = json_generator_new ();
+	json_generator_set_root (generator, root);
+	data = json_generator_to_data (generator, NULL);
+
+	g_object_unref (generator);
+	json_node_free (root);
+	g_object_unref (builder);
+
+	return data;
+}
+
+static gchar *
+reply_search (GHashTable *query)
+{
+	const gchar *text;
+	JsonBuilder *builder;
+	gchar *mid;
+
+	text = query ? g_hash_table_lookup (query, "query") : NULL;
+
+	if (!text)
+		return NULL;
+
+	builder = json_builder_new ();
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "status");
+	json_builder_add_string_value (builder, "200 OK");
+	json_builder_set_member_name (builder, "result");
+	json_builder_begin_array (builder);
+
+	if (string_hash (text) % 1000 >= miss_rate * 1000) {
+		mid = mid_for_string (text);
+		json_builder_begin_object (builder);
+		json_builder_set_member_name (builder, "mid");
+		json_builder_add_string_value (builder, mid);
+		json_builder_set_member_name (builder, "id");
+		json_builder_add_string_value (builder, mid);
+		json_builder_set_member_name (builder, "name");
+		json_builder_add_string_value (builder, text);
+		json_builder_set_member_name (builder, "lang");
+		json_builder_add_string_value (builder, "en");
+		json_builder_set_member_name (builder, "score");
+		json_builder_add_double_value (builder, 100);
+		json_builder_end_object (builder);
+		g_free (mid);
+	}
+
+	json_builder_end_array (builder);
+	json_builder_set_member_name (builder, "cost");
+	json_builder_add_int_value (builder, 1);
+	json_builder_end_object (builder);
+
+	return builder_free_to_data (builder);
+}
+
+/* Film and episode properties at once, the client filters them */
+static gchar *
+reply_topic (const gchar *id)
+{
+	JsonBuilder *builder;
+	gchar *name;
+
+	name = g_strdup_printf ("Title %s", id);
+	builder = json_builder_new ();
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "id");
+	json_builder_add_string_value (builder, id);
+	json_builder_set_member_name (builder, "property");
+	json_builder_begin_object (builder);
+
+	json_builder_set_member_name (builder, "/type/object/name");
+	builder_add_topic_value (builder, "string", name);
+	json_builder_set_member_name (builder, "/common/topic/description");
+	builder_add_topic_value (builder, "string", "Synopsis of a title that isn't.");
+	json_builder_set_member_name (builder, "/film/film/initial_release_date");
+	builder_add_topic_value (builder, "datetime", "2001-05-04");
+	json_builder_set_member_name (builder, "/film/film/directed_by");
+	builder_add_topic_value (builder, "object", "Some Director");
+	json_builder_set_member_name (builder, "/tv/tv_series_episode/air_date");
+	builder_add_topic_value (builder, "datetime", "2001-05-04");
+	json_builder_set_member_name (builder, "/tv/tv_series_episode/director");
+	builder_add_topic_value (builder, "object", "Some Director");
+
+	json_builder_end_object (builder);
+	json_builder_end_object (builder);
+	g_free (name);
+
+	return builder_free_to_data (builder);
+}
+
+static void mql_fill_object (JsonBuilder *builder,
+                             JsonObject  *query,
+                             const gchar *id,
+                             gint         episode);
+
+/* Fills in a value the query left blank, from the property name */
+static void
+mql_fill_value (JsonBuilder *builder,
+                const gchar *property,
+                JsonNode    *value,
+                const gchar *id,
+                gint         episode)
+{
+	gchar *str;
+
+	if (!JSON_NODE_HOLDS_NULL (value) && !JSON_NODE_HOLDS_ARRAY (value)) {
+		/* A constraint, echoed back */
+		json_builder_add_value (builder, json_node_copy (value));
+	} else if (JSON_NODE_HOLDS_ARRAY (value)) {
+		JsonArray *array = json_node_get_array (value);
+		JsonNode *element;
+
+		json_builder_begin_array (builder);
+
+		if (json_array_get_length (array) == 0) {
+			str = g_strdup_printf ("%s %s", property, id);
+			json_builder_add_string_value (builder, str);
+			g_free (str);
+		} else {
+			element = json_array_get_element (array, 0);
+
+			if (JSON_NODE_HOLDS_OBJECT (element))
+				mql_fill_object (builder, json_node_get_object (element), id, episode);
+		}
+
+		json_builder_end_array (builder);
+	} else if (strcmp (property, "id") == 0 || strcmp (property, "mid") == 0) {
+		json_builder_add_string_value (builder, id);
+	} else if (strcmp (property, "episode_number") == 0) {
+		json_builder_add_int_value (builder, episode);
+	} else if (g_str_has_suffix (property, "_number")) {
+		json_builder_add_int_value (builder, 1);
+	} else if (strcmp (property, "runtime") == 0) {
+		json_builder_add_double_value (builder, 90 + string_hash (id) % 60);
+	} else if (strstr (property, "date")) {
+		json_builder_add_string_value (builder, "2001-05-04");
+	} else {
+		str = g_strdup_printf ("%s %s", property, id);
+		json_builder_add_string_value (builder, str);
+		g_free (str);
+	}
+}
+
+static void
+mql_fill_member (JsonObject  *query,
+                 const gchar *property,
+                 JsonNode    *value,
+                 gpointer     user_data)
+{
+	MqlFill *fill = user_data;
+
+	if (g_str_has_suffix (property, "|=") ||
+	    strcmp (property, "limit") == 0 ||
+	    strcmp (property, "optional") == 0)
+		return;
+
+	json_builder_set_member_name (fill->builder, property);
+	mql_fill_value (fill->builder, property, value, fill->id, fill->episode);
+}
+
+static void
+mql_fill_object (JsonBuilder *builder,
+                 JsonObject  *query,
+                 const gchar *id,
+                 gint         episode)
+{
+	MqlFill fill = { builder, id, episode };
+
+	json_builder_begin_object (builder);
+	json_object_foreach_member (query, mql_fill_member, &fill);
+	json_builder_end_object (builder);
+}
+
+/* Handles the two query shapes the backend sends: all episodes
+ * of a season, and a batch of topics by ID.
+ */
+static gchar *
+reply_mqlread (GHashTable *query)
+{
+	JsonBuilder *builder;
+	JsonParser *parser;
+	JsonObject *object;
+	JsonArray *array;
+	const gchar *text;
+	JsonNode *root;
+	gchar *id, *str;
+	guint i, n;
+
+	text = query ? g_hash_table_lookup (query, "query") : NULL;
+	parser = json_parser_new ();
+
+	if (!text || !json_parser_load_from_data (parser, text, -1, NULL)) {
+		g_object_unref (parser);
+		return NULL;
+	}
+
+	root = json_parser_get_root (parser);
+
+	if (!JSON_NODE_HOLDS_ARRAY (root) ||
+	    json_array_get_length (json_node_get_array (root)) == 0 ||
+	    !JSON_NODE_HOLDS_OBJECT (json_array_get_element (json_node_get_array (root), 0))) {
+		g_object_unref (parser);
+		return NULL;
+	}
+
+	object = json_array_get_object_element (json_node_get_array (root), 0);
+	builder = json_builder_new ();
+	json_builder_begin_object (builder);
+	json_builder_set_member_name (builder, "result");
+	json_builder_begin_array (builder);
+
+	if (json_object_has_member (object, "id|=")) {
+		array = json_object_get_array_member (object, "id|=");
+
+		for (i = 0; i < json_array_get_length (array); i++) {
+			mql_fill_object (builder, object,
+			                 json_array_get_string_element (array, i), 0);
+		}
+	} else if (json_object_has_member (object, "series")) {
+		str = g_strdup_printf ("%s %" G_GINT64_FORMAT,
+		                       json_object_get_string_member (object, "series"),
+		                       json_object_get_int_member (object, "season_number"));
+		n = 10 + string_hash (str) % 14;
+
+		for (i = 1; i <= n; i++) {
+			gchar *episode;
+
+			episode = g_strdup_printf ("%s %u", str, i);
+			id = mid_for_string (episode);
+			mql_fill_object (builder, object, id, i);
+			g_free (episode);
+			g_free (id);
+		}
+
+		g_free (str);
+	}
+
+	json_builder_end_array (builder);
+	json_builder_end_object (builder);
+	g_object_unref (parser);
+
+	return builder_free_to_data (builder);
+}
+
+static gchar *
+reply_canned (SoupMessage *msg,
+              gsize       *len)
+{
+	SoupURI *uri;
+	gchar *request, *checksum, *filename, *path, *data = NULL;
+
+	uri = soup_message_get_uri (msg);
+	request = g_strdup_printf ("%s?%s", uri->path, uri->query ? uri->query : "");
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, request, -1);
+	filename = g_strconcat (checksum, ".json", NULL);
+	path = g_build_filename (responses_dir, filename, NULL);
+
+	if (!g_file_get_contents (path, &data, len, NULL))
+		data = NULL;
+
+	g_free (path);
+	g_free (filename);
+	g_free (checksum);
+	g_free (request);
+
+	return data;
+}
+
+static gboolean
+delayed_reply_cb (gpointer user_data)
+{
+	DelayedReply *reply = user_data;
+
+	soup_server_unpause_message (reply->server, reply->msg);
+	g_object_unref (reply->msg);
+	g_free (reply);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+server_callback (SoupServer        *server,
+                 SoupMessage       *msg,
+                 const gchar       *path,
+                 GHashTable        *query,
+                 SoupClientContext *client,
+                 gpointer           user_data)
+{
+	StandIn *stand_in = user_data;
+	gchar *body = NULL;
+	DelayedReply *reply;
+	gint delay;
+	gsize len;
+
+	stand_in->n_requests++;
+
+	if (g_rand_double (stand_in->rand) < error_rate) {
+		stand_in->n_errors++;
+		soup_message_set_status (msg, SOUP_STATUS_SERVICE_UNAVAILABLE);
+		soup_message_set_response (msg, "application/json", SOUP_MEMORY_STATIC,
+		                           error_reply, strlen (error_reply));
+	} else {
+		if (responses_dir)
+			body = reply_canned (msg, &len);
+
+		if (!body) {
+			if (g_str_has_prefix (path, "/freebase/v1/search"))
+				body = reply_search (query);
+			else if (g_str_has_prefix (path, "/freebase/v1/mqlread"))
+				body = reply_mqlread (query);
+			else if (g_str_has_prefix (path, "/freebase/v1/topic/"))
+				body = reply_topic (path + strlen ("/freebase/v1/topic"));
+
+			len = body ? strlen (body) : 0;
+		}
+
+		if (body) {
+			soup_message_set_status (msg, SOUP_STATUS_OK);
+			soup_message_set_response (msg, "application/json", SOUP_MEMORY_TAKE,
+			                           body, len);
+		} else {
+			soup_message_set_status (msg, SOUP_STATUS_BAD_REQUEST);
+		}
+	}
+
+	delay = latency;
+
+	if (jitter > 0)
+		delay += g_rand_int_range (stand_in->rand, -jitter, jitter + 1);
+
+	if (delay > 0) {
+		reply = g_new0 (DelayedReply, 1);
+		reply->server = server;
+		reply->msg = g_object_ref (msg);
+		soup_server_pause_message (server, msg);
+		g_timeout_add (delay, delayed_reply_cb, reply);
+	}
+}
+
+static gboolean
+stdin_cb (GIOChannel   *channel,
+          GIOCondition  condition,
+          gpointer      user_data)
+{
+	StandIn *stand_in = user_data;
+	gchar buf[256];
+
+	if ((condition & G_IO_IN) != 0 && read (0, buf, sizeof (buf)) > 0)
+		return G_SOURCE_CONTINUE;
+
+	g_main_loop_quit (stand_in->loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+	GTlsCertificate *certificate;
+	GOptionContext *context;
+	GError *error = NULL;
+	GIOChannel *channel;
+	StandIn stand_in;
+	GSList *uris;
+
+	setlocale (LC_ALL, "");
+
+	context = g_option_context_new ("- Stand-in for the Freebase API");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free (context);
+
+	if (!certificate_path)
+		certificate_path = g_build_filename (TMM_BENCH_SRCDIR, "stand-in.pem", NULL);
+
+	certificate = g_tls_certificate_new_from_file (certificate_path, &error);
+
+	if (!certificate) {
+		g_printerr ("Could not load certificate: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+
+	memset (&stand_in, 0, sizeof (StandIn));
+	stand_in.rand = g_rand_new_with_seed (seed);
+	stand_in.loop = g_main_loop_new (NULL, FALSE);
+	stand_in.server = soup_server_new (SOUP_SERVER_SERVER_HEADER, "tmm-stand-in",
+	                                   SOUP_SERVER_TLS_CERTIFICATE, certificate,
+	                                   NULL);
+	g_object_unref (certificate);
+
+	soup_server_add_handler (stand_in.server, "/freebase/v1",
+	                         server_callback, &stand_in, NULL);
+
+	if (!soup_server_listen_local (stand_in.server, 0,
+	                               SOUP_SERVER_LISTEN_HTTPS |
+	                               SOUP_SERVER_LISTEN_IPV4_ONLY,
+	                               &error)) {
+		g_printerr ("Could not listen: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+
+	uris = soup_server_get_uris (stand_in.server);
+	g_print ("%u\n", soup_uri_get_port (uris->data));
+	fflush (stdout);
+	g_slist_free_full (uris, (GDestroyNotify) soup_uri_free);
+
+	channel = g_io_channel_unix_new (0);
+	g_io_add_watch (channel, G_IO_IN | G_IO_HUP | G_IO_ERR, stdin_cb, &stand_in);
+	g_io_channel_unref (channel);
+
+	g_main_loop_run (stand_in.loop);
+
+	g_printerr ("stand-in: %" G_GUINT64_FORMAT " requests, %" G_GUINT64_FORMAT " failed\n",
+	            stand_in.n_requests, stand_in.n_errors);
+
+	g_object_unref (stand_in.server);
+	g_main_loop_unref (stand_in.loop);
+	g_rand_free (stand_in.rand);
+
+	return EXIT_SUCCESS;
+}
@@ -1,18 +1,282 @@
 #include <locale.h>
 #include "tracker-miner-media.h"
+#include "tmm-backend-freebase.h"
+#include "tmm-backend-local.h"
+#include "tmm-import.h"
+#include "tmm-watch.h"
+
+static gchar *backend_name = NULL;
+static gchar *index_path = NULL;
+static gint max_active_items = 0;
+static gint commit_batch_size = 0;
+static gdouble request_rate = -1;
+static gint statistics_interval = 0;
+static gint refresh_budget = -1;
+static gint request_timeout = -1;
+static gint idle_timeout = 0;
+static gchar **import_sources = NULL;
+static gboolean watch = FALSE;
+static const gchar *program_path = NULL;
+
+static GOptionEntry entries[] = {
+	{ "backend", 'B', 0,
+	  G_OPTION_ARG_STRING, &backend_name,
+	  "Metadata backend, either \"freebase\" or \"local\" (default: freebase)",
+	  "NAME" },
+	{ "index", 'i', 0,
+	  G_OPTION_ARG_FILENAME, &index_path,
+	  "Index file for the local backend, as built by tmm-build-index",
+	  "FILE" },
+	{ "max-active-items", 'n', 0,
+	  G_OPTION_ARG_INT, &max_active_items,
+	  "Maximum number of items looked up concurrently",
+	  "N" },
+	{ "commit-batch-size", 'b', 0,
+	  G_OPTION_ARG_INT, &commit_batch_size,
+	  "Number of items written to the store in a single update",
+	  "N" },
+	{ "request-rate", 'r', 0,
+	  G_OPTION_ARG_DOUBLE, &request_rate,
+	  "Maximum backend requests per second, 0 for no limit "
+	  "(default: 10, no limit with the local backend)",
+	  "RATE" },
+	{ "statistics-interval", 's', 0,
+	  G_OPTION_ARG_INT, &statistics_interval,
+	  "Log lookup statistics every N seconds",
+	  "N" },
+	{ "refresh-budget", 0, 0,
+	  G_OPTION_ARG_INT, &refresh_budget,
+	  "Backend requests per day spent refreshing stale items, 0 to disable "
+	  "(default: 200)",
+	  "N" },
+	{ "request-timeout", 0, 0,
+	  G_OPTION_ARG_INT, &request_timeout,
+	  "Seconds before giving up on a backend request, 0 for no limit "
+	  "(default: 30)",
+	  "SECONDS" },
+	{ "idle-timeout", 0, 0,
+	  G_OPTION_ARG_INT, &idle_timeout,
+	  "Exit after the queue stays empty for N seconds, leaving a small "
+	  "process behind that starts the miner again once videos are added "
+	  "(default: never)",
+	  "N" },
+	{ "import", 0, 0,
+	  G_OPTION_ARG_FILENAME_ARRAY, &import_sources,
+	  "Import the videos in a directory, or listed in a file, then exit "
+	  "(may be given multiple times)",
+	  "DIR|LIST" },
+	/* Left behind by --idle-timeout */
+	{ "watch", 0, G_OPTION_FLAG_HIDDEN,
+	  G_OPTION_ARG_NONE, &watch,
+	  NULL, NULL },
+	{ NULL }
+};
+
+static TmmBackend *
+create_backend (GError **error)
+{
+	TmmBackend *backend;
+	gchar *path;
+
+	if (!backend_name || g_strcmp0 (backend_name, "freebase") == 0)
+		return tmm_backend_freebase_new ();
+
+	if (g_strcmp0 (backend_name, "local") != 0) {
+		g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+		             "Unknown backend '%s'", backend_name);
+		return NULL;
+	}
+
+	if (index_path)
+		path = g_strdup (index_path);
+	else
+		path = g_build_filename (g_get_user_data_dir (),
+		                         "tracker-miner-media",
+		                         "index", NULL);
+
+	backend = tmm_backend_local_new (path, error);
+	g_free (path);
+
+	return backend;
+}
+
+/* With --idle-timeout the process exits once idle, and is started
+ * again by D-Bus activation. GraphUpdated signals from the store
+ * don't activate anything, so a "--watch" process is left behind to
+ * do that once videos are added, see tmm-watch.c. Calling a method
+ * on the miner's bus name (e.g. tracker-control asking for its
+ * status) starts it as well.
+ */
+typedef struct _IdleExit IdleExit;
+
+struct _IdleExit
+{
+	TrackerDecorator *decorator;
+	GMainLoop *main_loop;
+	guint timeout_id;
+};
+
+static void idle_exit_arm (IdleExit *idle_exit);
+
+/* Without a watcher nothing would start the miner
+ * for new files, so it keeps running instead.
+ */
+static gboolean
+idle_exit_spawn_watch (void)
+{
+	const gchar *argv[] = { program_path, "--watch", NULL };
+	GError *error = NULL;
+
+	if (!g_spawn_async (NULL, (gchar **) argv, NULL,
+	                    G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, &error)) {
+		g_warning ("Could not start watcher, not exiting: %s", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+idle_timeout_cb (gpointer user_data)
+{
+	IdleExit *idle_exit = user_data;
+
+	idle_exit->timeout_id = 0;
+
+	/* Items queued without a notification, wait for "finished" */
+	if (tracker_decorator_get_n_items (idle_exit->decorator) > 0)
+		return G_SOURCE_REMOVE;
+
+	if (!idle_exit_spawn_watch ()) {
+		idle_exit_arm (idle_exit);
+		return G_SOURCE_REMOVE;
+	}
+
+	g_message ("Idle for %d seconds, exiting", idle_timeout);
+	tmm_decorator_save_cache (TMM_DECORATOR (idle_exit->decorator));
+	g_main_loop_quit (idle_exit->main_loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+idle_exit_arm (IdleExit *idle_exit)
+{
+	if (idle_exit->timeout_id)
+		g_source_remove (idle_exit->timeout_id);
+
+	idle_exit->timeout_id = g_timeout_add_seconds (idle_timeout,
+	                                               idle_timeout_cb,
+	                                               idle_exit);
+}
+
+static void
+idle_exit_disarm (IdleExit *idle_exit)
+{
+	if (idle_exit->timeout_id) {
+		g_source_remove (idle_exit->timeout_id);
+		idle_exit->timeout_id = 0;
+	}
+}
+
+/* Emitted once the queue drained, and the last updates went through.
+ * The first one comes once the decorator found out what is queued,
+ * which is also how an activation with nothing to do ends up here.
+ */
+static void
+decorator_finished_cb (TrackerDecorator *decorator,
+                       IdleExit         *idle_exit)
+{
+	idle_exit_arm (idle_exit);
+}
+
+static void
+decorator_items_available_cb (TrackerDecorator *decorator,
+                              IdleExit         *idle_exit)
+{
+	idle_exit_disarm (idle_exit);
+}
+
+static void
+import_cb (GObject      *object,
+           GAsyncResult *result,
+           gpointer      user_data)
+{
+	GMainLoop *main_loop = user_data;
+	GError *error = NULL;
+
+	if (!tmm_import_finish (TMM_DECORATOR (object), result, &error)) {
+		g_printerr ("Import failed: %s\n", error->message);
+		g_error_free (error);
+	}
+
+	g_main_loop_quit (main_loop);
+}
 
 int
 main (int   argc,
       char *argv[])
 {
 	TrackerMiner *decorator;
+	TmmBackend *backend;
+	GOptionContext *context;
 	GMainLoop *main_loop;
 	GError *error = NULL;
 
 	setlocale (LC_ALL, "");
 
+	context = g_option_context_new ("- Extract information about media files");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free (context);
+
+	if (watch) {
+		if (!tmm_watch_run (&error)) {
+			g_printerr ("Could not watch for new videos: %s\n", error->message);
+			g_error_free (error);
+			return EXIT_FAILURE;
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	program_path = argv[0];
+	backend = create_backend (&error);
+
+	if (!backend) {
+		g_printerr ("Could not create backend: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+
 	main_loop = g_main_loop_new (NULL, FALSE);
-	decorator = tmm_decorator_new ();
+	decorator = tmm_decorator_new (backend);
+	g_object_unref (backend);
+
+	if (max_active_items > 0)
+		g_object_set (decorator, "max-active-items", (guint) max_active_items, NULL);
+	if (commit_batch_size > 0)
+		g_object_set (decorator, "commit-batch-size", commit_batch_size, NULL);
+
+	/* Nothing to pace with a local index */
+	if (request_rate < 0 && g_strcmp0 (backend_name, "local") == 0)
+		request_rate = 0;
+	if (request_rate >= 0)
+		g_object_set (decorator, "request-rate", request_rate, NULL);
+	if (refresh_budget >= 0)
+		g_object_set (decorator, "refresh-budget", (guint) refresh_budget, NULL);
+	if (request_timeout >= 0)
+		g_object_set (decorator, "request-timeout", (guint) request_timeout, NULL);
+	if (statistics_interval > 0)
+		g_object_set (decorator, "statistics-interval", (guint) statistics_interval, NULL);
 
 	if (!g_initable_init (G_INITABLE (decorator), NULL, &error)) {
 		g_critical ("Could not start miner: %s\n", error->message);
@@ -20,10 +284,36 @@ main (int   argc,
 		return EXIT_FAILURE;
 	}
 
-	tracker_miner_start (decorator);
-	g_main_loop_run (main_loop);
+	if (import_sources) {
+		/* Keep the decorator queue out of the way */
+		tracker_miner_pause (decorator, "Importing", NULL);
+		tmm_import_async (TMM_DECORATOR (decorator),
+		                  (const gchar * const *) import_sources,
+		                  NULL, import_cb, main_loop);
+		g_main_loop_run (main_loop);
+		g_strfreev (import_sources);
+	} else {
+		IdleExit idle_exit = { TRACKER_DECORATOR (decorator), main_loop, 0 };
+
+		/* Caches are saved before exiting, so the next
+		 * activation starts off the mapped file. The queue
+		 * is only known once the miner started, so the timer
+		 * is first armed on "finished".
+		 */
+		if (idle_timeout > 0) {
+			g_signal_connect (decorator, "finished",
+			                  G_CALLBACK (decorator_finished_cb), &idle_exit);
+			g_signal_connect (decorator, "items-available",
+			                  G_CALLBACK (decorator_items_available_cb), &idle_exit);
+		}
+
+		tracker_miner_start (decorator);
+		g_main_loop_run (main_loop);
+
+		idle_exit_disarm (&idle_exit);
+		tracker_miner_stop (decorator);
+	}
 
-	tracker_miner_stop (decorator);
 	g_main_loop_unref (main_loop);
 	g_object_unref (decorator);
 
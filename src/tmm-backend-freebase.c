@@ -0,0 +1,1066 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "tmm-backend-freebase.h"
+
+#include <gdata/gdata.h>
+
+/* Search results with a lower score are considered no match */
+#define MIN_SCORE 50
+
+typedef struct _TmmBackendFreebasePrivate TmmBackendFreebasePrivate;
+typedef struct _TopicQuery TopicQuery;
+typedef struct _SeasonQuery SeasonQuery;
+typedef struct _TopicsQuery TopicsQuery;
+
+struct _TmmBackendFreebasePrivate
+{
+	GDataFreebaseService *service;
+};
+
+/* Replies are parsed in a thread, large topics take a while */
+struct _TopicQuery
+{
+	gchar *id;
+	gboolean is_episode;
+	GDataFreebaseTopicResult *result;
+};
+
+struct _SeasonQuery
+{
+	gint season;
+	GVariant *result;
+};
+
+struct _TopicsQuery
+{
+	gchar **ids;
+	gboolean is_episode;
+	GVariant *result;
+};
+
+static void tmm_backend_freebase_backend_init (TmmBackendInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TmmBackendFreebase, tmm_backend_freebase, G_TYPE_OBJECT,
+                         G_ADD_PRIVATE (TmmBackendFreebase)
+                         G_IMPLEMENT_INTERFACE (TMM_TYPE_BACKEND,
+                                                tmm_backend_freebase_backend_init))
+
+/* Unknown IDs are reported as G_IO_ERROR_NOT_FOUND by all backends,
+ * so they aren't taken for transport failures.
+ */
+static void
+task_return_service_error (GTask  *task,
+                           GError *error)
+{
+	if (g_error_matches (error, GDATA_SERVICE_ERROR, GDATA_SERVICE_ERROR_NOT_FOUND)) {
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+		                         "%s", error->message);
+		g_error_free (error);
+	} else {
+		g_task_return_error (task, error);
+	}
+}
+
+static void
+topic_extract_artists (GDataFreebaseTopicObject *object,
+                       const gchar              *freebase_property,
+                       GPtrArray                *artists)
+{
+	gint64 i;
+
+	for (i = 0; i < gdata_freebase_topic_object_get_property_count (object, freebase_property); i++) {
+		GDataFreebaseTopicValue *value;
+
+		value = gdata_freebase_topic_object_get_property_value (object, freebase_property, i);
+		g_ptr_array_add (artists, g_strdup (gdata_freebase_topic_value_get_text (value)));
+	}
+}
+
+static void
+topic_extract_actors (GDataFreebaseTopicObject *object,
+                      GPtrArray                *artists)
+{
+	gint64 i;
+
+	for (i = 0; i < gdata_freebase_topic_object_get_property_count (object, "/film/film/starring"); i++) {
+		GDataFreebaseTopicValue *value, *child_value;
+		const GDataFreebaseTopicObject *child_object;
+
+		value = gdata_freebase_topic_object_get_property_value (object, "/film/film/starring", i);
+		child_object = gdata_freebase_topic_value_get_object (value);
+		child_value = gdata_freebase_topic_object_get_property_value (child_object, "/film/performance/actor", 0);
+
+		if (child_value)
+			g_ptr_array_add (artists, g_strdup (gdata_freebase_topic_value_get_text (child_value)));
+	}
+}
+
+/* Topic replies are filtered down to what parse_topic() reads */
+static const gchar *film_properties[] = {
+	"/type/object/name",
+	"/common/topic/description",
+	"/film/film/initial_release_date",
+	"/film/film/directed_by",
+	"/film/film/produced_by",
+	"/film/film/starring",
+	"/film/film/rating",
+	"/film/film/runtime",
+	"/film/film/genre",
+	NULL
+};
+
+static const gchar *episode_properties[] = {
+	"/type/object/name",
+	"/common/topic/description",
+	"/tv/tv_series_episode/air_date",
+	"/tv/tv_series_episode/director",
+	"/tv/tv_series_episode/producers",
+	"/tv/tv_series_episode/season_number",
+	"/tv/tv_series_episode/episode_number",
+	NULL
+};
+
+static TmmMetadata *
+parse_topic (GDataFreebaseTopicResult *result,
+             gboolean                  is_episode)
+{
+	GDataFreebaseTopicValue *value, *child_value;
+	const GDataFreebaseTopicObject *object;
+	GDataFreebaseTopicObject *root;
+	TmmMetadata *metadata;
+
+	root = gdata_freebase_topic_result_dup_object (result);
+	metadata = tmm_metadata_new ();
+	metadata->is_episode = is_episode;
+
+	if (metadata->is_episode) {
+		topic_extract_artists (root, "/tv/tv_series_episode/director", metadata->directors);
+		topic_extract_artists (root, "/tv/tv_series_episode/producers", metadata->producers);
+	} else {
+		topic_extract_artists (root, "/film/film/directed_by", metadata->directors);
+		topic_extract_artists (root, "/film/film/produced_by", metadata->producers);
+		topic_extract_actors (root, metadata->actors);
+	}
+
+	/* Extract title */
+	value = gdata_freebase_topic_object_get_property_value (root, "/type/object/name", 0);
+
+	if (value)
+		metadata->title = g_strdup (gdata_freebase_topic_value_get_string (value));
+
+	/* Extract release date */
+	if (metadata->is_episode) {
+		value = gdata_freebase_topic_object_get_property_value (root, "/tv/tv_series_episode/air_date", 0);
+	} else {
+		value = gdata_freebase_topic_object_get_property_value (root, "/film/film/initial_release_date", 0);
+	}
+
+	if (value)
+		metadata->release_date = gdata_freebase_topic_value_get_int (value);
+
+	/* Text/synopsis */
+	value = gdata_freebase_topic_object_get_property_value (root, "/common/topic/description", 0);
+
+	if (value)
+		metadata->synopsis = g_strdup (gdata_freebase_topic_value_get_string (value));
+
+	if (metadata->is_episode) {
+		value = gdata_freebase_topic_object_get_property_value (root, "/tv/tv_series_episode/season_number", 0);
+
+		if (value)
+			metadata->season = (gint) gdata_freebase_topic_value_get_double (value);
+
+		value = gdata_freebase_topic_object_get_property_value (root, "/tv/tv_series_episode/episode_number", 0);
+
+		if (value)
+			metadata->episode = (gint) gdata_freebase_topic_value_get_double (value);
+	} else {
+		/* MPAA rating */
+		value = gdata_freebase_topic_object_get_property_value (root, "/film/film/rating", 0);
+
+		if (value)
+			metadata->rating = g_strdup (gdata_freebase_topic_value_get_text (value));
+
+		/* Runtime */
+		value = gdata_freebase_topic_object_get_property_value (root, "/film/film/runtime", 0);
+
+		if (value) {
+			object = gdata_freebase_topic_value_get_object (value);
+			child_value = gdata_freebase_topic_object_get_property_value (object, "/film/film_cut/runtime", 0);
+
+			if (child_value)
+				metadata->runtime = (gint64) gdata_freebase_topic_value_get_double (child_value);
+		}
+
+		/* Genre, FIXME: nmm:genre cardinality is 1 */
+		value = gdata_freebase_topic_object_get_property_value (root, "/film/film/genre", 0);
+
+		if (value)
+			metadata->genre = g_strdup (gdata_freebase_topic_value_get_text (value));
+	}
+
+	gdata_freebase_topic_object_unref (root);
+
+	return metadata;
+}
+
+static const gchar *
+tmm_backend_freebase_get_name (TmmBackend *backend)
+{
+	return "freebase";
+}
+
+static void
+search_query_cb (GObject      *object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+	const GDataFreebaseSearchResultItem *item = NULL;
+	GDataFreebaseSearchResult *search_result;
+	GTask *task = user_data;
+	GError *error = NULL;
+
+	search_result =
+		GDATA_FREEBASE_SEARCH_RESULT (gdata_service_query_single_entry_finish (GDATA_SERVICE (object),
+		                                                                       result, &error));
+
+	if (error) {
+		task_return_service_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	if (gdata_freebase_search_result_get_num_items (search_result) > 0)
+		item = gdata_freebase_search_result_get_item (search_result, 0);
+
+	if (item && gdata_freebase_search_result_item_get_score (item) > MIN_SCORE) {
+		g_task_return_pointer (task,
+		                       g_strdup (gdata_freebase_search_result_item_get_id (item)),
+		                       g_free);
+	} else {
+		g_task_return_pointer (task, NULL, NULL);
+	}
+
+	g_object_unref (search_result);
+	g_object_unref (task);
+}
+
+/* Results are scored on the title alone, the decorator
+ * weighs the year in when rating the match.
+ */
+static void
+tmm_backend_freebase_search_film (TmmBackend          *backend,
+                                  const gchar         *title,
+                                  gint                 year,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data)
+{
+	TmmBackendFreebasePrivate *priv;
+	GDataFreebaseSearchQuery *search_query;
+	GTask *task;
+
+	priv = tmm_backend_freebase_get_instance_private (TMM_BACKEND_FREEBASE (backend));
+	task = g_task_new (backend, cancellable, callback, user_data);
+
+	search_query = gdata_freebase_search_query_new (title);
+	gdata_query_set_max_results (GDATA_QUERY (search_query), 1);
+
+	gdata_freebase_search_query_open_filter (search_query, GDATA_FREEBASE_SEARCH_FILTER_ANY);
+	gdata_freebase_search_query_add_filter (search_query, "type", "/film/film");
+	gdata_freebase_search_query_close_filter (search_query);
+
+	gdata_freebase_service_search_async (priv->service, search_query,
+	                                     cancellable, search_query_cb, task);
+	g_object_unref (search_query);
+}
+
+static gchar *
+tmm_backend_freebase_search_film_finish (TmmBackend    *backend,
+                                         GAsyncResult  *result,
+                                         GError       **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+topic_query_free (TopicQuery *query)
+{
+	g_clear_object (&query->result);
+	g_free (query->id);
+	g_free (query);
+}
+
+static void
+parse_topic_thread (GTask        *task,
+                    gpointer      source_object,
+                    gpointer      task_data,
+                    GCancellable *cancellable)
+{
+	TopicQuery *query = task_data;
+	TmmMetadata *metadata;
+
+	metadata = parse_topic (query->result, query->is_episode);
+	metadata->id = g_strdup (query->id);
+
+	g_task_return_pointer (task, metadata, (GDestroyNotify) tmm_metadata_free);
+}
+
+static void
+topic_query_cb (GObject      *object,
+                GAsyncResult *result,
+                gpointer      user_data)
+{
+	GDataFreebaseTopicResult *topic_result;
+	GTask *task = user_data;
+	TopicQuery *query;
+	GError *error = NULL;
+
+	topic_result =
+		GDATA_FREEBASE_TOPIC_RESULT (gdata_service_query_single_entry_finish (GDATA_SERVICE (object),
+		                                                                      result, &error));
+	if (error) {
+		task_return_service_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	query = g_task_get_task_data (task);
+	query->result = topic_result;
+
+	g_task_run_in_thread (task, parse_topic_thread);
+	g_object_unref (task);
+}
+
+static void
+tmm_backend_freebase_get_topic (TmmBackend          *backend,
+                                const gchar         *id,
+                                gboolean             is_episode,
+                                GCancellable        *cancellable,
+                                GAsyncReadyCallback  callback,
+                                gpointer             user_data)
+{
+	TmmBackendFreebasePrivate *priv;
+	GDataFreebaseTopicQuery *topic_query;
+	TopicQuery *query;
+	GTask *task;
+
+	priv = tmm_backend_freebase_get_instance_private (TMM_BACKEND_FREEBASE (backend));
+
+	query = g_new0 (TopicQuery, 1);
+	query->id = g_strdup (id);
+	query->is_episode = is_episode;
+
+	task = g_task_new (backend, cancellable, callback, user_data);
+	g_task_set_task_data (task, query, (GDestroyNotify) topic_query_free);
+
+	topic_query = gdata_freebase_topic_query_new (id);
+	gdata_freebase_topic_query_set_filter (topic_query,
+	                                       is_episode ? episode_properties : film_properties);
+	gdata_freebase_service_get_topic_async (priv->service, topic_query,
+	                                        cancellable, topic_query_cb, task);
+	g_object_unref (topic_query);
+}
+
+static TmmMetadata *
+tmm_backend_freebase_get_topic_finish (TmmBackend    *backend,
+                                       GAsyncResult  *result,
+                                       GError       **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/* json-glib boxes MQL values in variants, and nulls in maybes,
+ * peel those off. Takes ownership of @variant.
+ */
+static GVariant *
+mql_value_unbox (GVariant *variant)
+{
+	GVariant *child;
+
+	while (variant) {
+		if (g_variant_is_of_type (variant, G_VARIANT_TYPE_VARIANT))
+			child = g_variant_get_variant (variant);
+		else if (g_variant_is_of_type (variant, G_VARIANT_TYPE_MAYBE))
+			child = g_variant_get_maybe (variant);
+		else
+			break;
+
+		g_variant_unref (variant);
+		variant = child;
+	}
+
+	return variant;
+}
+
+static GVariant *
+mql_object_lookup (GVariant    *object,
+                   const gchar *property)
+{
+	return mql_value_unbox (g_variant_lookup_value (object, property, NULL));
+}
+
+static gchar *
+mql_object_dup_string (GVariant    *object,
+                       const gchar *property)
+{
+	GVariant *value;
+	gchar *str = NULL;
+
+	value = mql_object_lookup (object, property);
+
+	if (value && g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+		str = g_variant_dup_string (value, NULL);
+
+	g_clear_pointer (&value, g_variant_unref);
+
+	return str;
+}
+
+static gint64
+mql_object_get_int (GVariant    *object,
+                    const gchar *property)
+{
+	GVariant *value;
+	gint64 retval = -1;
+
+	value = mql_object_lookup (object, property);
+
+	if (!value)
+		return -1;
+
+	if (g_variant_is_of_type (value, G_VARIANT_TYPE_INT64))
+		retval = g_variant_get_int64 (value);
+	else if (g_variant_is_of_type (value, G_VARIANT_TYPE_DOUBLE))
+		retval = (gint64) g_variant_get_double (value);
+
+	g_variant_unref (value);
+
+	return retval;
+}
+
+/* Adds all strings of a (possibly) multi-valued property */
+static void
+mql_object_collect_strings (GVariant    *object,
+                            const gchar *property,
+                            GPtrArray   *strings)
+{
+	GVariant *value, *child;
+	GVariantIter iter;
+
+	value = mql_object_lookup (object, property);
+
+	if (!value)
+		return;
+
+	if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING)) {
+		g_ptr_array_add (strings, g_variant_dup_string (value, NULL));
+	} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_ARRAY)) {
+		g_variant_iter_init (&iter, value);
+
+		while ((child = g_variant_iter_next_value (&iter)) != NULL) {
+			child = mql_value_unbox (child);
+
+			if (child && g_variant_is_of_type (child, G_VARIANT_TYPE_STRING))
+				g_ptr_array_add (strings, g_variant_dup_string (child, NULL));
+
+			g_clear_pointer (&child, g_variant_unref);
+		}
+	}
+
+	g_variant_unref (value);
+}
+
+/* MQL dates are ISO 8601, possibly truncated to the year */
+static gint64
+mql_parse_date (const gchar *str)
+{
+	gint year, month = 1, day = 1;
+	GDateTime *date_time;
+	gint64 time;
+
+	if (!str || sscanf (str, "%d-%d-%d", &year, &month, &day) < 1)
+		return -1;
+
+	date_time = g_date_time_new_utc (year, month, day, 0, 0, 0);
+
+	if (!date_time)
+		return -1;
+
+	time = g_date_time_to_unix (date_time);
+	g_date_time_unref (date_time);
+
+	return time;
+}
+
+static TmmMetadata *
+mql_parse_episode (GVariant *object)
+{
+	TmmMetadata *metadata;
+	GPtrArray *descriptions;
+	gchar *air_date, *id;
+
+	id = mql_object_dup_string (object, "id");
+
+	if (!id)
+		return NULL;
+
+	metadata = tmm_metadata_new ();
+	metadata->id = id;
+	metadata->is_episode = TRUE;
+	metadata->title = mql_object_dup_string (object, "name");
+	metadata->season = (gint) mql_object_get_int (object, "season_number");
+	metadata->episode = (gint) mql_object_get_int (object, "episode_number");
+
+	air_date = mql_object_dup_string (object, "air_date");
+	metadata->release_date = mql_parse_date (air_date);
+	g_free (air_date);
+
+	descriptions = g_ptr_array_new_with_free_func ((GDestroyNotify) g_free);
+	mql_object_collect_strings (object, "/common/topic/description", descriptions);
+
+	if (descriptions->len > 0)
+		metadata->synopsis = g_strdup (g_ptr_array_index (descriptions, 0));
+
+	g_ptr_array_unref (descriptions);
+
+	mql_object_collect_strings (object, "director", metadata->directors);
+	mql_object_collect_strings (object, "producers", metadata->producers);
+
+	return metadata;
+}
+
+/* Returns the episodes of @season in a MQL query result */
+static GPtrArray *
+mql_parse_season (GVariant *result,
+                  gint      season)
+{
+	TmmMetadata *metadata;
+	GPtrArray *episodes;
+	GVariant *object;
+	GVariantIter iter;
+
+	episodes = g_ptr_array_new_with_free_func ((GDestroyNotify) tmm_metadata_free);
+
+	if (!g_variant_is_of_type (result, G_VARIANT_TYPE_ARRAY))
+		return episodes;
+
+	g_variant_iter_init (&iter, result);
+
+	while ((object = g_variant_iter_next_value (&iter)) != NULL) {
+		object = mql_value_unbox (object);
+
+		if (!object || !g_variant_is_of_type (object, G_VARIANT_TYPE_VARDICT)) {
+			g_clear_pointer (&object, g_variant_unref);
+			continue;
+		}
+
+		metadata = mql_parse_episode (object);
+		g_variant_unref (object);
+
+		if (!metadata)
+			continue;
+
+		if (metadata->season == season && metadata->episode > 0)
+			g_ptr_array_add (episodes, metadata);
+		else
+			tmm_metadata_free (metadata);
+	}
+
+	return episodes;
+}
+
+/* Adds the @child_property of each object in a multi-valued property */
+static void
+mql_object_collect_child_strings (GVariant    *object,
+                                  const gchar *property,
+                                  const gchar *child_property,
+                                  GPtrArray   *strings)
+{
+	GVariant *value, *child;
+	GVariantIter iter;
+
+	value = mql_object_lookup (object, property);
+
+	if (!value)
+		return;
+
+	if (g_variant_is_of_type (value, G_VARIANT_TYPE_ARRAY)) {
+		g_variant_iter_init (&iter, value);
+
+		while ((child = g_variant_iter_next_value (&iter)) != NULL) {
+			child = mql_value_unbox (child);
+
+			if (child && g_variant_is_of_type (child, G_VARIANT_TYPE_VARDICT))
+				mql_object_collect_strings (child, child_property, strings);
+
+			g_clear_pointer (&child, g_variant_unref);
+		}
+	}
+
+	g_variant_unref (value);
+}
+
+/* Returns @child_property of the first object in a multi-valued
+ * property, or -1.
+ */
+static gint64
+mql_object_get_child_int (GVariant    *object,
+                          const gchar *property,
+                          const gchar *child_property)
+{
+	GVariant *value, *child = NULL;
+	gint64 retval = -1;
+
+	value = mql_object_lookup (object, property);
+
+	if (!value)
+		return -1;
+
+	if (g_variant_is_of_type (value, G_VARIANT_TYPE_ARRAY) &&
+	    g_variant_n_children (value) > 0)
+		child = mql_value_unbox (g_variant_get_child_value (value, 0));
+
+	if (child && g_variant_is_of_type (child, G_VARIANT_TYPE_VARDICT))
+		retval = mql_object_get_int (child, child_property);
+
+	g_clear_pointer (&child, g_variant_unref);
+	g_variant_unref (value);
+
+	return retval;
+}
+
+/* Returns the first string of a (possibly) multi-valued property */
+static gchar *
+mql_object_dup_first_string (GVariant    *object,
+                             const gchar *property)
+{
+	GPtrArray *strings;
+	gchar *str = NULL;
+
+	strings = g_ptr_array_new_with_free_func ((GDestroyNotify) g_free);
+	mql_object_collect_strings (object, property, strings);
+
+	if (strings->len > 0)
+		str = g_strdup (g_ptr_array_index (strings, 0));
+
+	g_ptr_array_unref (strings);
+
+	return str;
+}
+
+/* Same properties as parse_topic() reads from film topics */
+static TmmMetadata *
+mql_parse_film (GVariant *object)
+{
+	TmmMetadata *metadata;
+	gchar *release_date;
+
+	metadata = tmm_metadata_new ();
+	metadata->title = mql_object_dup_string (object, "name");
+	metadata->synopsis = mql_object_dup_first_string (object, "/common/topic/description");
+	metadata->rating = mql_object_dup_first_string (object, "rating");
+	metadata->genre = mql_object_dup_first_string (object, "genre");
+
+	release_date = mql_object_dup_string (object, "initial_release_date");
+	metadata->release_date = mql_parse_date (release_date);
+	g_free (release_date);
+
+	/* Film cuts, the runtime of the first is used */
+	metadata->runtime = mql_object_get_child_int (object, "runtime", "runtime");
+
+	mql_object_collect_strings (object, "directed_by", metadata->directors);
+	mql_object_collect_strings (object, "produced_by", metadata->producers);
+	mql_object_collect_child_strings (object, "starring", "actor", metadata->actors);
+
+	return metadata;
+}
+
+static void
+season_query_free (SeasonQuery *query)
+{
+	g_clear_pointer (&query->result, g_variant_unref);
+	g_free (query);
+}
+
+static void
+parse_season_thread (GTask        *task,
+                     gpointer      source_object,
+                     gpointer      task_data,
+                     GCancellable *cancellable)
+{
+	SeasonQuery *query = task_data;
+
+	g_task_return_pointer (task,
+	                       mql_parse_season (query->result, query->season),
+	                       (GDestroyNotify) g_ptr_array_unref);
+}
+
+static void
+season_query_cb (GObject      *object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+	GDataFreebaseResult *mql_result;
+	GTask *task = user_data;
+	GError *error = NULL;
+	SeasonQuery *query;
+
+	mql_result =
+		GDATA_FREEBASE_RESULT (gdata_service_query_single_entry_finish (GDATA_SERVICE (object),
+		                                                                result, &error));
+	if (error) {
+		task_return_service_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	query = g_task_get_task_data (task);
+	query->result = gdata_freebase_result_dup_variant (mql_result);
+	g_object_unref (mql_result);
+
+	g_task_run_in_thread (task, parse_season_thread);
+	g_object_unref (task);
+}
+
+static gchar *
+mql_escape_string (const gchar *str)
+{
+	GString *escaped;
+
+	escaped = g_string_new (NULL);
+
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			g_string_append_c (escaped, '\\');
+
+		if ((guchar) *str < 0x20)
+			g_string_append_printf (escaped, "\\u%04x", (guint) *str);
+		else
+			g_string_append_c (escaped, *str);
+	}
+
+	return g_string_free (escaped, FALSE);
+}
+
+/* Fetches all episodes in the season at once, with the
+ * properties we'd otherwise get from their topics.
+ */
+static void
+tmm_backend_freebase_get_season (TmmBackend          *backend,
+                                 const gchar         *series,
+                                 gint                 season,
+                                 GCancellable        *cancellable,
+                                 GAsyncReadyCallback  callback,
+                                 gpointer             user_data)
+{
+	TmmBackendFreebasePrivate *priv;
+	GDataFreebaseQuery *mql_query;
+	gchar *escaped, *str;
+	SeasonQuery *query;
+	GTask *task;
+
+	priv = tmm_backend_freebase_get_instance_private (TMM_BACKEND_FREEBASE (backend));
+
+	query = g_new0 (SeasonQuery, 1);
+	query->season = season;
+
+	task = g_task_new (backend, cancellable, callback, user_data);
+	g_task_set_task_data (task, query, (GDestroyNotify) season_query_free);
+
+	escaped = mql_escape_string (series);
+	str = g_strdup_printf ("[{ \"type\": \"/tv/tv_series_episode\","
+	                       "   \"series\": \"%s\","
+	                       "   \"season_number\": %d,"
+	                       "   \"episode_number\": null,"
+	                       "   \"id\": null,"
+	                       "   \"name\": null,"
+	                       "   \"air_date\": null,"
+	                       "   \"/common/topic/description\": [],"
+	                       "   \"director\": [],"
+	                       "   \"producers\": [],"
+	                       "   \"limit\": 500 }]",
+	                       escaped, season);
+
+	mql_query = gdata_freebase_query_new (str);
+	gdata_freebase_service_query_async (priv->service, mql_query,
+	                                    cancellable, season_query_cb, task);
+	g_object_unref (mql_query);
+	g_free (escaped);
+	g_free (str);
+}
+
+static void
+topics_query_free (TopicsQuery *query)
+{
+	g_clear_pointer (&query->result, g_variant_unref);
+	g_strfreev (query->ids);
+	g_free (query);
+}
+
+/* Replies name topics by their preferred ID, which might not be
+ * the one asked for, so they are matched on both ID and MID.
+ * Topics matching neither are left out.
+ */
+static GPtrArray *
+mql_parse_topics (TopicsQuery *query)
+{
+	GHashTable *requested;
+	TmmMetadata *metadata;
+	GPtrArray *topics;
+	GVariant *object;
+	GVariantIter iter;
+	const gchar *id;
+	gchar *ids[2];
+	guint i, j;
+
+	topics = g_ptr_array_new_with_free_func ((GDestroyNotify) tmm_metadata_free);
+
+	if (!g_variant_is_of_type (query->result, G_VARIANT_TYPE_ARRAY))
+		return topics;
+
+	requested = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (i = 0; query->ids[i]; i++)
+		g_hash_table_add (requested, query->ids[i]);
+
+	g_variant_iter_init (&iter, query->result);
+
+	while ((object = g_variant_iter_next_value (&iter)) != NULL) {
+		object = mql_value_unbox (object);
+
+		if (!object || !g_variant_is_of_type (object, G_VARIANT_TYPE_VARDICT)) {
+			g_clear_pointer (&object, g_variant_unref);
+			continue;
+		}
+
+		ids[0] = mql_object_dup_string (object, "id");
+		ids[1] = mql_object_dup_string (object, "mid");
+
+		for (j = 0, id = NULL; j < G_N_ELEMENTS (ids) && !id; j++) {
+			if (ids[j])
+				id = g_hash_table_lookup (requested, ids[j]);
+		}
+
+		if (id) {
+			if (query->is_episode)
+				metadata = mql_parse_episode (object);
+			else
+				metadata = mql_parse_film (object);
+
+			if (metadata) {
+				g_free (metadata->id);
+				metadata->id = g_strdup (id);
+				g_ptr_array_add (topics, metadata);
+			}
+		}
+
+		g_free (ids[0]);
+		g_free (ids[1]);
+		g_variant_unref (object);
+	}
+
+	g_hash_table_unref (requested);
+
+	return topics;
+}
+
+static void
+parse_topics_thread (GTask        *task,
+                     gpointer      source_object,
+                     gpointer      task_data,
+                     GCancellable *cancellable)
+{
+	g_task_return_pointer (task, mql_parse_topics (task_data),
+	                       (GDestroyNotify) g_ptr_array_unref);
+}
+
+static void
+topics_query_cb (GObject      *object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+	GDataFreebaseResult *mql_result;
+	GTask *task = user_data;
+	GError *error = NULL;
+	TopicsQuery *query;
+
+	mql_result =
+		GDATA_FREEBASE_RESULT (gdata_service_query_single_entry_finish (GDATA_SERVICE (object),
+		                                                                result, &error));
+	if (error) {
+		task_return_service_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	query = g_task_get_task_data (task);
+	query->result = gdata_freebase_result_dup_variant (mql_result);
+	g_object_unref (mql_result);
+
+	g_task_run_in_thread (task, parse_topics_thread);
+	g_object_unref (task);
+}
+
+/* A single MQL read for all of @ids, asking for the properties
+ * the topic filters would give.
+ */
+static void
+tmm_backend_freebase_get_topics (TmmBackend          *backend,
+                                 const gchar * const *ids,
+                                 gboolean             is_episode,
+                                 GCancellable        *cancellable,
+                                 GAsyncReadyCallback  callback,
+                                 gpointer             user_data)
+{
+	TmmBackendFreebasePrivate *priv;
+	GDataFreebaseQuery *mql_query;
+	TopicsQuery *query;
+	GString *str;
+	gchar *escaped;
+	GTask *task;
+	guint i;
+
+	priv = tmm_backend_freebase_get_instance_private (TMM_BACKEND_FREEBASE (backend));
+
+	query = g_new0 (TopicsQuery, 1);
+	query->ids = g_strdupv ((gchar **) ids);
+	query->is_episode = is_episode;
+
+	task = g_task_new (backend, cancellable, callback, user_data);
+	g_task_set_task_data (task, query, (GDestroyNotify) topics_query_free);
+
+	str = g_string_new ("[{ \"id|=\": [");
+
+	for (i = 0; ids[i]; i++) {
+		escaped = mql_escape_string (ids[i]);
+		g_string_append_printf (str, "%s\"%s\"", i > 0 ? ", " : "", escaped);
+		g_free (escaped);
+	}
+
+	g_string_append (str, "],"
+	                 "   \"id\": null,"
+	                 "   \"mid\": null,"
+	                 "   \"name\": null,"
+	                 "   \"/common/topic/description\": [],");
+
+	if (is_episode) {
+		g_string_append (str,
+		                 "   \"type\": \"/tv/tv_series_episode\","
+		                 "   \"season_number\": null,"
+		                 "   \"episode_number\": null,"
+		                 "   \"air_date\": null,"
+		                 "   \"director\": [],"
+		                 "   \"producers\": [],");
+	} else {
+		g_string_append (str,
+		                 "   \"type\": \"/film/film\","
+		                 "   \"initial_release_date\": null,"
+		                 "   \"directed_by\": [],"
+		                 "   \"produced_by\": [],"
+		                 "   \"starring\": [{ \"actor\": null, \"optional\": true }],"
+		                 "   \"rating\": [],"
+		                 "   \"runtime\": [{ \"runtime\": null, \"optional\": true }],"
+		                 "   \"genre\": [],");
+	}
+
+	g_string_append_printf (str, "   \"limit\": %u }]", i);
+
+	mql_query = gdata_freebase_query_new (str->str);
+	gdata_freebase_service_query_async (priv->service, mql_query,
+	                                    cancellable, topics_query_cb, task);
+	g_object_unref (mql_query);
+	g_string_free (str, TRUE);
+}
+
+static GPtrArray *
+tmm_backend_freebase_get_topics_finish (TmmBackend    *backend,
+                                        GAsyncResult  *result,
+                                        GError       **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static GPtrArray *
+tmm_backend_freebase_get_season_finish (TmmBackend    *backend,
+                                        GAsyncResult  *result,
+                                        GError       **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/* Freebase keys topics by IMDb ID in its authority namespace,
+ * so the key path works as a topic ID.
+ */
+static gchar *
+tmm_backend_freebase_id_from_imdb (TmmBackend  *backend,
+                                   const gchar *imdb_id)
+{
+	return g_strconcat ("/authority/imdb/title/", imdb_id, NULL);
+}
+
+static void
+tmm_backend_freebase_finalize (GObject *object)
+{
+	TmmBackendFreebasePrivate *priv;
+
+	priv = tmm_backend_freebase_get_instance_private (TMM_BACKEND_FREEBASE (object));
+	g_object_unref (priv->service);
+
+	G_OBJECT_CLASS (tmm_backend_freebase_parent_class)->finalize (object);
+}
+
+static void
+tmm_backend_freebase_class_init (TmmBackendFreebaseClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = tmm_backend_freebase_finalize;
+}
+
+static void
+tmm_backend_freebase_backend_init (TmmBackendInterface *iface)
+{
+	iface->get_name = tmm_backend_freebase_get_name;
+	iface->search_film = tmm_backend_freebase_search_film;
+	iface->search_film_finish = tmm_backend_freebase_search_film_finish;
+	iface->get_topic = tmm_backend_freebase_get_topic;
+	iface->get_topic_finish = tmm_backend_freebase_get_topic_finish;
+	iface->get_topics = tmm_backend_freebase_get_topics;
+	iface->get_topics_finish = tmm_backend_freebase_get_topics_finish;
+	iface->get_season = tmm_backend_freebase_get_season;
+	iface->get_season_finish = tmm_backend_freebase_get_season_finish;
+	iface->id_from_imdb = tmm_backend_freebase_id_from_imdb;
+}
+
+static void
+tmm_backend_freebase_init (TmmBackendFreebase *backend)
+{
+	TmmBackendFreebasePrivate *priv;
+
+	priv = tmm_backend_freebase_get_instance_private (backend);
+	priv->service = gdata_freebase_service_new (NULL, NULL);
+}
+
+TmmBackend *
+tmm_backend_freebase_new (void)
+{
+	return g_object_new (TMM_TYPE_BACKEND_FREEBASE, NULL);
+}
@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "tmm-backend-local.h"
+
+/* Offline backend, reading an index built beforehand by
+ * tmm-build-index. Like the lookup cache, the index is a single
+ * serialized GVariant that is mapped and looked up in place, so
+ * it opens instantly regardless of its size. It contains:
+ *
+ * - Films, as normalized title -> ID, and as "normalized title|year"
+ *   -> ID so remakes can be told apart
+ * - Episodes, as "normalized series title|season|episode" -> ID
+ * - Records, as ID -> TmmMetadata variant
+ *
+ * All three arrays are sorted by key, and searched by bisection.
+ */
+
+typedef struct _TmmBackendLocalPrivate TmmBackendLocalPrivate;
+
+struct _TmmBackendLocalPrivate
+{
+	gchar *path;
+
+	GVariant *contents;
+	GVariant *films;
+	GVariant *episodes;
+	GVariant *records;
+};
+
+enum {
+	PROP_0,
+	PROP_PATH
+};
+
+static void tmm_backend_local_backend_init (TmmBackendInterface *iface);
+static void tmm_backend_local_initable_init (GInitableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TmmBackendLocal, tmm_backend_local, G_TYPE_OBJECT,
+                         G_ADD_PRIVATE (TmmBackendLocal)
+                         G_IMPLEMENT_INTERFACE (TMM_TYPE_BACKEND,
+                                                tmm_backend_local_backend_init)
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
+                                                tmm_backend_local_initable_init))
+
+/* Both the index and the lookups go through this */
+gchar *
+tmm_backend_local_normalize_title (const gchar *title)
+{
+	gchar *normalized;
+
+	normalized = g_utf8_casefold (title, -1);
+	g_strstrip (normalized);
+
+	return normalized;
+}
+
+/* Returns the position of the first element not sorting before
+ * @key, that is where it is if the array contains it.
+ */
+static gsize
+index_array_bisect (GVariant    *array,
+                    const gchar *key)
+{
+	gsize lo, hi;
+
+	lo = 0;
+	hi = g_variant_n_children (array);
+
+	while (lo < hi) {
+		const gchar *child_key;
+		GVariant *child;
+		gsize mid;
+
+		mid = lo + (hi - lo) / 2;
+		child = g_variant_get_child_value (array, mid);
+		g_variant_get_child (child, 0, "&s", &child_key);
+
+		if (strcmp (child_key, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+
+		g_variant_unref (child);
+	}
+
+	return lo;
+}
+
+/* Returns the value for @key in a a(s*) array, or NULL */
+static GVariant *
+index_array_lookup (GVariant    *array,
+                    const gchar *key)
+{
+	const gchar *child_key;
+	GVariant *child, *value = NULL;
+	gsize pos;
+
+	pos = index_array_bisect (array, key);
+
+	if (pos >= g_variant_n_children (array))
+		return NULL;
+
+	child = g_variant_get_child_value (array, pos);
+	g_variant_get_child (child, 0, "&s", &child_key);
+
+	if (strcmp (child_key, key) == 0)
+		value = g_variant_get_child_value (child, 1);
+
+	g_variant_unref (child);
+
+	return value;
+}
+
+static TmmMetadata *
+tmm_backend_local_lookup_record (TmmBackendLocal *backend,
+                                 const gchar     *id)
+{
+	TmmBackendLocalPrivate *priv;
+	GVariant *value, *record;
+	TmmMetadata *metadata;
+
+	priv = tmm_backend_local_get_instance_private (backend);
+	value = index_array_lookup (priv->records, id);
+
+	if (!value)
+		return NULL;
+
+	record = g_variant_get_variant (value);
+	metadata = tmm_metadata_new_from_variant (record);
+	g_variant_unref (record);
+	g_variant_unref (value);
+
+	if (metadata)
+		metadata->id = g_strdup (id);
+
+	return metadata;
+}
+
+static const gchar *
+tmm_backend_local_get_name (TmmBackend *backend)
+{
+	return "local";
+}
+
+/* Lookups are synchronous, GTask still defers the
+ * callback to an idle, as with the other backends.
+ * With a year, the title released that year is looked
+ * up first, then the most voted one of any year.
+ */
+static void
+tmm_backend_local_search_film (TmmBackend          *backend,
+                               const gchar         *title,
+                               gint                 year,
+                               GCancellable        *cancellable,
+                               GAsyncReadyCallback  callback,
+                               gpointer             user_data)
+{
+	TmmBackendLocalPrivate *priv;
+	gchar *normalized, *key, *id = NULL;
+	GVariant *value = NULL;
+	GTask *task;
+
+	priv = tmm_backend_local_get_instance_private (TMM_BACKEND_LOCAL (backend));
+	task = g_task_new (backend, cancellable, callback, user_data);
+
+	normalized = tmm_backend_local_normalize_title (title);
+
+	if (year > 0) {
+		key = g_strdup_printf ("%s|%d", normalized, year);
+		value = index_array_lookup (priv->films, key);
+		g_free (key);
+	}
+
+	if (!value)
+		value = index_array_lookup (priv->films, normalized);
+
+	g_free (normalized);
+
+	if (value) {
+		id = g_variant_dup_string (value, NULL);
+		g_variant_unref (value);
+	}
+
+	g_task_return_pointer (task, id, g_free);
+	g_object_unref (task);
+}
+
+static gchar *
+tmm_backend_local_search_film_finish (TmmBackend    *backend,
+                                      GAsyncResult  *result,
+                                      GError       **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+tmm_backend_local_get_topic (TmmBackend          *backend,
+                             const gchar         *id,
+                             gboolean             is_episode,
+                             GCancellable        *cancellable,
+                             GAsyncReadyCallback  callback,
+                             gpointer             user_data)
+{
+	TmmMetadata *metadata;
+	GTask *task;
+
+	task = g_task_new (backend, cancellable, callback, user_data);
+	metadata = tmm_backend_local_lookup_record (TMM_BACKEND_LOCAL (backend), id);
+
+	if (metadata) {
+		g_task_return_pointer (task, metadata, (GDestroyNotify) tmm_metadata_free);
+	} else {
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+		                         "No record for '%s' in the index", id);
+	}
+
+	g_object_unref (task);
+}
+
+static TmmMetadata *
+tmm_backend_local_get_topic_finish (TmmBackend    *backend,
+                                    GAsyncResult  *result,
+                                    GError       **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/* Index lookups are cheap, batching saves nothing but is
+ * supported so the decorator needn't tell backends apart.
+ */
+static void
+tmm_backend_local_get_topics (TmmBackend          *backend,
+                              const gchar * const *ids,
+                              gboolean             is_episode,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data)
+{
+	TmmMetadata *metadata;
+	GPtrArray *topics;
+	GTask *task;
+	guint i;
+
+	task = g_task_new (backend, cancellable, callback, user_data);
+	topics = g_ptr_array_new_with_free_func ((GDestroyNotify) tmm_metadata_free);
+
+	for (i = 0; ids[i]; i++) {
+		metadata = tmm_backend_local_lookup_record (TMM_BACKEND_LOCAL (backend), ids[i]);
+
+		if (metadata)
+			g_ptr_array_add (topics, metadata);
+	}
+
+	g_task_return_pointer (task, topics, (GDestroyNotify) g_ptr_array_unref);
+	g_object_unref (task);
+}
+
+static GPtrArray *
+tmm_backend_local_get_topics_finish (TmmBackend    *backend,
+                                     GAsyncResult  *result,
+                                     GError       **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+tmm_backend_local_get_season (TmmBackend          *backend,
+                              const gchar         *series,
+                              gint                 season,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data)
+{
+	TmmBackendLocalPrivate *priv;
+	gchar *normalized, *prefix;
+	TmmMetadata *metadata;
+	GPtrArray *episodes;
+	gsize pos, prefix_len;
+	GTask *task;
+
+	priv = tmm_backend_local_get_instance_private (TMM_BACKEND_LOCAL (backend));
+	task = g_task_new (backend, cancellable, callback, user_data);
+	episodes = g_ptr_array_new_with_free_func ((GDestroyNotify) tmm_metadata_free);
+
+	normalized = tmm_backend_local_normalize_title (series);
+	prefix = g_strdup_printf ("%s|%d|", normalized, season);
+	prefix_len = strlen (prefix);
+	g_free (normalized);
+
+	/* All episodes in the season sort together */
+	for (pos = index_array_bisect (priv->episodes, prefix);
+	     pos < g_variant_n_children (priv->episodes); pos++) {
+		const gchar *key, *id;
+
+		g_variant_get_child (priv->episodes, pos, "(&s&s)", &key, &id);
+
+		if (strncmp (key, prefix, prefix_len) != 0)
+			break;
+
+		metadata = tmm_backend_local_lookup_record (TMM_BACKEND_LOCAL (backend), id);
+
+		if (metadata)
+			g_ptr_array_add (episodes, metadata);
+	}
+
+	g_free (prefix);
+
+	g_task_return_pointer (task, episodes, (GDestroyNotify) g_ptr_array_unref);
+	g_object_unref (task);
+}
+
+static GPtrArray *
+tmm_backend_local_get_season_finish (TmmBackend    *backend,
+                                     GAsyncResult  *result,
+                                     GError       **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/* Index records are keyed by IMDb ID already */
+static gchar *
+tmm_backend_local_id_from_imdb (TmmBackend  *backend,
+                                const gchar *imdb_id)
+{
+	TmmBackendLocalPrivate *priv;
+	GVariant *value;
+
+	priv = tmm_backend_local_get_instance_private (TMM_BACKEND_LOCAL (backend));
+	value = index_array_lookup (priv->records, imdb_id);
+
+	if (!value)
+		return NULL;
+
+	g_variant_unref (value);
+
+	return g_strdup (imdb_id);
+}
+
+static gboolean
+tmm_backend_local_initable_init_impl (GInitable     *initable,
+                                      GCancellable  *cancellable,
+                                      GError       **error)
+{
+	TmmBackendLocalPrivate *priv;
+	GMappedFile *mapped_file;
+	GBytes *bytes;
+	guint version;
+
+	priv = tmm_backend_local_get_instance_private (TMM_BACKEND_LOCAL (initable));
+	mapped_file = g_mapped_file_new (priv->path, FALSE, error);
+
+	if (!mapped_file)
+		return FALSE;
+
+	bytes = g_mapped_file_get_bytes (mapped_file);
+	g_mapped_file_unref (mapped_file);
+
+	priv->contents = g_variant_new_from_bytes (G_VARIANT_TYPE (TMM_INDEX_VARIANT_TYPE),
+	                                           bytes, FALSE);
+	g_variant_ref_sink (priv->contents);
+	g_bytes_unref (bytes);
+
+	g_variant_get (priv->contents, "(u@a(ss)@a(ss)@a(sv))", &version,
+	               &priv->films, &priv->episodes, &priv->records);
+
+	if (version != TMM_INDEX_VERSION) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+		             "Index '%s' has version %u, expected %u",
+		             priv->path, version, TMM_INDEX_VERSION);
+		return FALSE;
+	}
+
+	g_debug ("Loaded index '%s', %" G_GSIZE_FORMAT " films, %"
+	         G_GSIZE_FORMAT " episodes", priv->path,
+	         g_variant_n_children (priv->films),
+	         g_variant_n_children (priv->episodes));
+
+	return TRUE;
+}
+
+static void
+tmm_backend_local_set_property (GObject      *object,
+                                guint         prop_id,
+                                const GValue *value,
+                                GParamSpec   *pspec)
+{
+	TmmBackendLocalPrivate *priv;
+
+	priv = tmm_backend_local_get_instance_private (TMM_BACKEND_LOCAL (object));
+
+	switch (prop_id) {
+	case PROP_PATH:
+		priv->path = g_value_dup_string (value);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+tmm_backend_local_get_property (GObject    *object,
+                                guint       prop_id,
+                                GValue     *value,
+                                GParamSpec *pspec)
+{
+	TmmBackendLocalPrivate *priv;
+
+	priv = tmm_backend_local_get_instance_private (TMM_BACKEND_LOCAL (object));
+
+	switch (prop_id) {
+	case PROP_PATH:
+		g_value_set_string (value, priv->path);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+tmm_backend_local_finalize (GObject *object)
+{
+	TmmBackendLocalPrivate *priv;
+
+	priv = tmm_backend_local_get_instance_private (TMM_BACKEND_LOCAL (object));
+
+	g_clear_pointer (&priv->films, g_variant_unref);
+	g_clear_pointer (&priv->episodes, g_variant_unref);
+	g_clear_pointer (&priv->records, g_variant_unref);
+	g_clear_pointer (&priv->contents, g_variant_unref);
+	g_free (priv->path);
+
+	G_OBJECT_CLASS (tmm_backend_local_parent_class)->finalize (object);
+}
+
+static void
+tmm_backend_local_class_init (TmmBackendLocalClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->set_property = tmm_backend_local_set_property;
+	object_class->get_property = tmm_backend_local_get_property;
+	object_class->finalize = tmm_backend_local_finalize;
+
+	g_object_class_install_property (object_class,
+	                                 PROP_PATH,
+	                                 g_param_spec_string ("path",
+	                                                      "Path",
+	                                                      "Path to the index file",
+	                                                      NULL,
+	                                                      G_PARAM_READWRITE |
+	                                                      G_PARAM_CONSTRUCT_ONLY |
+	                                                      G_PARAM_STATIC_STRINGS));
+}
+
+static void
+tmm_backend_local_backend_init (TmmBackendInterface *iface)
+{
+	iface->get_name = tmm_backend_local_get_name;
+	iface->search_film = tmm_backend_local_search_film;
+	iface->search_film_finish = tmm_backend_local_search_film_finish;
+	iface->get_topic = tmm_backend_local_get_topic;
+	iface->get_topic_finish = tmm_backend_local_get_topic_finish;
+	iface->get_topics = tmm_backend_local_get_topics;
+	iface->get_topics_finish = tmm_backend_local_get_topics_finish;
+	iface->get_season = tmm_backend_local_get_season;
+	iface->get_season_finish = tmm_backend_local_get_season_finish;
+	iface->id_from_imdb = tmm_backend_local_id_from_imdb;
+}
+
+static void
+tmm_backend_local_initable_init (GInitableIface *iface)
+{
+	iface->init = tmm_backend_local_initable_init_impl;
+}
+
+static void
+tmm_backend_local_init (TmmBackendLocal *backend)
+{
+}
+
+TmmBackend *
+tmm_backend_local_new (const gchar  *path,
+                       GError      **error)
+{
+	return g_initable_new (TMM_TYPE_BACKEND_LOCAL, NULL, error,
+	                       "path", path,
+	                       NULL);
+}
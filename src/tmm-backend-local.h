@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TMM_BACKEND_LOCAL_H__
+#define __TMM_BACKEND_LOCAL_H__
+
+#include "tmm-backend.h"
+
+G_BEGIN_DECLS
+
+/* Index file format, see tmm-backend-local.c */
+#define TMM_INDEX_VERSION 2
+#define TMM_INDEX_VARIANT_TYPE "(ua(ss)a(ss)a(sv))"
+
+#define TMM_TYPE_BACKEND_LOCAL         (tmm_backend_local_get_type())
+#define TMM_BACKEND_LOCAL(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), TMM_TYPE_BACKEND_LOCAL, TmmBackendLocal))
+#define TMM_BACKEND_LOCAL_CLASS(c)     (G_TYPE_CHECK_CLASS_CAST ((c), TMM_TYPE_BACKEND_LOCAL, TmmBackendLocalClass))
+#define TMM_IS_BACKEND_LOCAL(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), TMM_TYPE_BACKEND_LOCAL))
+#define TMM_IS_BACKEND_LOCAL_CLASS(c)  (G_TYPE_CHECK_CLASS_TYPE ((c),  TMM_TYPE_BACKEND_LOCAL))
+#define TMM_BACKEND_LOCAL_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), TMM_TYPE_BACKEND_LOCAL, TmmBackendLocalClass))
+
+typedef struct _TmmBackendLocal TmmBackendLocal;
+typedef struct _TmmBackendLocalClass TmmBackendLocalClass;
+
+struct _TmmBackendLocal {
+	GObject parent_instance;
+};
+
+struct _TmmBackendLocalClass {
+	GObjectClass parent_class;
+};
+
+GType        tmm_backend_local_get_type        (void) G_GNUC_CONST;
+
+TmmBackend * tmm_backend_local_new             (const gchar  *path,
+                                                GError      **error);
+
+gchar *      tmm_backend_local_normalize_title (const gchar  *title);
+
+G_END_DECLS
+
+#endif /* __TMM_BACKEND_LOCAL_H__ */
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "tmm-backend.h"
+
+/* Metadata providers. Films are looked up by title to get their
+ * ID, and then the ID is looked up to get the metadata. Episodes
+ * are looked up a whole season at once, that gives the metadata
+ * of every episode in it.
+ *
+ * Topics can also be fetched many at once with get_topics(), so
+ * items waiting on different IDs share a request.
+ *
+ * Results must be GTasks, failed attempts at a request are told
+ * apart from successful ones with g_task_had_error().
+ *
+ * Finding nothing is not an error, search_film() then returns
+ * NULL, and get_season() an empty array. Its year is 0 if unknown,
+ * backends may use it to tell apart films sharing a title.
+ *
+ * Backends that can tell their ID for an IMDb title ID without
+ * a request implement id_from_imdb(), so films identified by
+ * an .nfo file skip the search.
+ */
+
+G_DEFINE_INTERFACE (TmmBackend, tmm_backend, G_TYPE_OBJECT)
+
+static void
+tmm_backend_default_init (TmmBackendInterface *iface)
+{
+}
+
+const gchar *
+tmm_backend_get_name (TmmBackend *backend)
+{
+	g_return_val_if_fail (TMM_IS_BACKEND (backend), NULL);
+
+	return TMM_BACKEND_GET_IFACE (backend)->get_name (backend);
+}
+
+void
+tmm_backend_search_film (TmmBackend          *backend,
+                         const gchar         *title,
+                         gint                 year,
+                         GCancellable        *cancellable,
+                         GAsyncReadyCallback  callback,
+                         gpointer             user_data)
+{
+	g_return_if_fail (TMM_IS_BACKEND (backend));
+	g_return_if_fail (title != NULL);
+
+	TMM_BACKEND_GET_IFACE (backend)->search_film (backend, title, year,
+	                                              cancellable, callback,
+	                                              user_data);
+}
+
+/* Returns the ID of the best match, or NULL if there's none */
+gchar *
+tmm_backend_search_film_finish (TmmBackend    *backend,
+                                GAsyncResult  *result,
+                                GError       **error)
+{
+	g_return_val_if_fail (TMM_IS_BACKEND (backend), NULL);
+
+	return TMM_BACKEND_GET_IFACE (backend)->search_film_finish (backend, result, error);
+}
+
+void
+tmm_backend_get_topic (TmmBackend          *backend,
+                       const gchar         *id,
+                       gboolean             is_episode,
+                       GCancellable        *cancellable,
+                       GAsyncReadyCallback  callback,
+                       gpointer             user_data)
+{
+	g_return_if_fail (TMM_IS_BACKEND (backend));
+	g_return_if_fail (id != NULL);
+
+	TMM_BACKEND_GET_IFACE (backend)->get_topic (backend, id, is_episode,
+	                                            cancellable, callback, user_data);
+}
+
+TmmMetadata *
+tmm_backend_get_topic_finish (TmmBackend    *backend,
+                              GAsyncResult  *result,
+                              GError       **error)
+{
+	g_return_val_if_fail (TMM_IS_BACKEND (backend), NULL);
+
+	return TMM_BACKEND_GET_IFACE (backend)->get_topic_finish (backend, result, error);
+}
+
+void
+tmm_backend_get_topics (TmmBackend          *backend,
+                        const gchar * const *ids,
+                        gboolean             is_episode,
+                        GCancellable        *cancellable,
+                        GAsyncReadyCallback  callback,
+                        gpointer             user_data)
+{
+	g_return_if_fail (TMM_IS_BACKEND (backend));
+	g_return_if_fail (ids != NULL);
+
+	TMM_BACKEND_GET_IFACE (backend)->get_topics (backend, ids, is_episode,
+	                                             cancellable, callback, user_data);
+}
+
+/* Returns a GPtrArray of TmmMetadata, with their ID set to the
+ * one they were asked for. IDs with no topic are left out.
+ */
+GPtrArray *
+tmm_backend_get_topics_finish (TmmBackend    *backend,
+                               GAsyncResult  *result,
+                               GError       **error)
+{
+	g_return_val_if_fail (TMM_IS_BACKEND (backend), NULL);
+
+	return TMM_BACKEND_GET_IFACE (backend)->get_topics_finish (backend, result, error);
+}
+
+void
+tmm_backend_get_season (TmmBackend          *backend,
+                        const gchar         *series,
+                        gint                 season,
+                        GCancellable        *cancellable,
+                        GAsyncReadyCallback  callback,
+                        gpointer             user_data)
+{
+	g_return_if_fail (TMM_IS_BACKEND (backend));
+	g_return_if_fail (series != NULL);
+
+	TMM_BACKEND_GET_IFACE (backend)->get_season (backend, series, season,
+	                                             cancellable, callback, user_data);
+}
+
+/* Returns a GPtrArray of TmmMetadata, with their ID set */
+GPtrArray *
+tmm_backend_get_season_finish (TmmBackend    *backend,
+                               GAsyncResult  *result,
+                               GError       **error)
+{
+	g_return_val_if_fail (TMM_IS_BACKEND (backend), NULL);
+
+	return TMM_BACKEND_GET_IFACE (backend)->get_season_finish (backend, result, error);
+}
+
+/* Returns NULL if the backend can't map IMDb IDs */
+gchar *
+tmm_backend_id_from_imdb (TmmBackend  *backend,
+                          const gchar *imdb_id)
+{
+	TmmBackendInterface *iface;
+
+	g_return_val_if_fail (TMM_IS_BACKEND (backend), NULL);
+	g_return_val_if_fail (imdb_id != NULL, NULL);
+
+	iface = TMM_BACKEND_GET_IFACE (backend);
+
+	if (!iface->id_from_imdb)
+		return NULL;
+
+	return iface->id_from_imdb (backend, imdb_id);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TMM_BACKEND_H__
+#define __TMM_BACKEND_H__
+
+#include <gio/gio.h>
+
+#include "tmm-metadata.h"
+
+G_BEGIN_DECLS
+
+#define TMM_TYPE_BACKEND           (tmm_backend_get_type ())
+#define TMM_BACKEND(o)             (G_TYPE_CHECK_INSTANCE_CAST ((o), TMM_TYPE_BACKEND, TmmBackend))
+#define TMM_IS_BACKEND(o)          (G_TYPE_CHECK_INSTANCE_TYPE ((o), TMM_TYPE_BACKEND))
+#define TMM_BACKEND_GET_IFACE(o)   (G_TYPE_INSTANCE_GET_INTERFACE ((o), TMM_TYPE_BACKEND, TmmBackendInterface))
+
+typedef struct _TmmBackend TmmBackend;
+typedef struct _TmmBackendInterface TmmBackendInterface;
+
+struct _TmmBackendInterface {
+	GTypeInterface g_iface;
+
+	const gchar * (* get_name)          (TmmBackend           *backend);
+
+	void          (* search_film)       (TmmBackend           *backend,
+	                                     const gchar          *title,
+	                                     gint                  year,
+	                                     GCancellable         *cancellable,
+	                                     GAsyncReadyCallback   callback,
+	                                     gpointer              user_data);
+	gchar *       (* search_film_finish) (TmmBackend          *backend,
+	                                      GAsyncResult        *result,
+	                                      GError             **error);
+
+	void          (* get_topic)         (TmmBackend           *backend,
+	                                     const gchar          *id,
+	                                     gboolean              is_episode,
+	                                     GCancellable         *cancellable,
+	                                     GAsyncReadyCallback   callback,
+	                                     gpointer              user_data);
+	TmmMetadata * (* get_topic_finish)  (TmmBackend           *backend,
+	                                     GAsyncResult         *result,
+	                                     GError              **error);
+
+	void          (* get_topics)        (TmmBackend           *backend,
+	                                     const gchar * const  *ids,
+	                                     gboolean              is_episode,
+	                                     GCancellable         *cancellable,
+	                                     GAsyncReadyCallback   callback,
+	                                     gpointer              user_data);
+	GPtrArray *   (* get_topics_finish) (TmmBackend           *backend,
+	                                     GAsyncResult         *result,
+	                                     GError              **error);
+
+	void          (* get_season)        (TmmBackend           *backend,
+	                                     const gchar          *series,
+	                                     gint                  season,
+	                                     GCancellable         *cancellable,
+	                                     GAsyncReadyCallback   callback,
+	                                     gpointer              user_data);
+	GPtrArray *   (* get_season_finish) (TmmBackend           *backend,
+	                                     GAsyncResult         *result,
+	                                     GError              **error);
+
+	/* Optional */
+	gchar *       (* id_from_imdb)      (TmmBackend           *backend,
+	                                     const gchar          *imdb_id);
+};
+
+GType         tmm_backend_get_type          (void) G_GNUC_CONST;
+
+const gchar * tmm_backend_get_name          (TmmBackend           *backend);
+
+void          tmm_backend_search_film       (TmmBackend           *backend,
+                                             const gchar          *title,
+                                             gint                  year,
+                                             GCancellable         *cancellable,
+                                             GAsyncReadyCallback   callback,
+                                             gpointer              user_data);
+gchar *       tmm_backend_search_film_finish (TmmBackend          *backend,
+                                              GAsyncResult        *result,
+                                              GError             **error);
+
+void          tmm_backend_get_topic         (TmmBackend           *backend,
+                                             const gchar          *id,
+                                             gboolean              is_episode,
+                                             GCancellable         *cancellable,
+                                             GAsyncReadyCallback   callback,
+                                             gpointer              user_data);
+TmmMetadata * tmm_backend_get_topic_finish  (TmmBackend           *backend,
+                                             GAsyncResult         *result,
+                                             GError              **error);
+
+void          tmm_backend_get_topics        (TmmBackend           *backend,
+                                             const gchar * const  *ids,
+                                             gboolean              is_episode,
+                                             GCancellable         *cancellable,
+                                             GAsyncReadyCallback   callback,
+                                             gpointer              user_data);
+GPtrArray *   tmm_backend_get_topics_finish (TmmBackend           *backend,
+                                             GAsyncResult         *result,
+                                             GError              **error);
+
+void          tmm_backend_get_season        (TmmBackend           *backend,
+                                             const gchar          *series,
+                                             gint                  season,
+                                             GCancellable         *cancellable,
+                                             GAsyncReadyCallback   callback,
+                                             gpointer              user_data);
+GPtrArray *   tmm_backend_get_season_finish (TmmBackend           *backend,
+                                             GAsyncResult         *result,
+                                             GError              **error);
+
+gchar *       tmm_backend_id_from_imdb      (TmmBackend           *backend,
+                                             const gchar          *imdb_id);
+
+G_END_DECLS
+
+#endif /* __TMM_BACKEND_H__ */
@@ -0,0 +1,603 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <locale.h>
+#include <stdlib.h>
+
+#include "tmm-backend-local.h"
+#include "tmm-metadata.h"
+
+/* Builds the index used by the local backend out of the IMDb
+ * datasets (https://datasets.imdbws.com/), either gzipped or not:
+ *
+ * - title.basics.tsv: films, series and episodes
+ * - title.episode.tsv: season and episode numbers
+ * - title.principals.tsv: directors, producers and actors
+ * - name.basics.tsv: artist names
+ * - title.ratings.tsv (optional): vote counts, to pick the most
+ *   popular title when several share the same name
+ */
+
+typedef struct _Title Title;
+typedef struct _IndexEntry IndexEntry;
+typedef struct _Builder Builder;
+
+typedef enum {
+	TITLE_FILM,
+	TITLE_SERIES,
+	TITLE_EPISODE
+} TitleType;
+
+struct _Title
+{
+	gchar *id;
+	gchar *series_id;
+	TitleType type;
+	gint year;
+	guint votes;
+	TmmMetadata *metadata;
+};
+
+struct _IndexEntry
+{
+	gchar *key;
+	Title *title;
+};
+
+struct _Builder
+{
+	/* ID -> Title */
+	GHashTable *titles;
+	/* Artist ID -> name, NULL until name.basics is read */
+	GHashTable *names;
+};
+
+typedef void (* RowFunc) (Builder  *builder,
+                          gchar   **fields,
+                          guint     n_fields);
+
+#define MAX_FIELDS 10
+
+static void
+title_free (Title *title)
+{
+	g_free (title->id);
+	g_free (title->series_id);
+	tmm_metadata_free (title->metadata);
+	g_free (title);
+}
+
+/* "\N" is used for missing values */
+static const gchar *
+field_value (const gchar *field)
+{
+	return strcmp (field, "\\N") == 0 ? NULL : field;
+}
+
+static gint64
+field_get_int (const gchar *field)
+{
+	gchar *end;
+	gint64 value;
+
+	if (!field_value (field))
+		return -1;
+
+	value = g_ascii_strtoll (field, &end, 10);
+
+	return *end == '\0' ? value : -1;
+}
+
+static gint64
+year_to_time (gint64 year)
+{
+	GDateTime *date_time;
+	gint64 time;
+
+	if (year <= 0)
+		return -1;
+
+	date_time = g_date_time_new_utc (year, 1, 1, 0, 0, 0);
+
+	if (!date_time)
+		return -1;
+
+	time = g_date_time_to_unix (date_time);
+	g_date_time_unref (date_time);
+
+	return time;
+}
+
+static GInputStream *
+open_dataset (const gchar  *dir,
+              const gchar  *name,
+              GError      **error)
+{
+	GFileInputStream *file_stream;
+	GZlibDecompressor *decompressor;
+	GInputStream *stream;
+	gchar *path, *gz_path;
+	GFile *file;
+
+	path = g_build_filename (dir, name, NULL);
+	gz_path = g_strconcat (path, ".gz", NULL);
+
+	if (g_file_test (path, G_FILE_TEST_EXISTS)) {
+		file = g_file_new_for_path (path);
+		file_stream = g_file_read (file, NULL, error);
+		stream = G_INPUT_STREAM (file_stream);
+	} else {
+		file = g_file_new_for_path (gz_path);
+		file_stream = g_file_read (file, NULL, error);
+		stream = NULL;
+
+		if (file_stream) {
+			decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+			stream = g_converter_input_stream_new (G_INPUT_STREAM (file_stream),
+			                                       G_CONVERTER (decompressor));
+			g_object_unref (decompressor);
+			g_object_unref (file_stream);
+		}
+	}
+
+	g_object_unref (file);
+	g_free (gz_path);
+	g_free (path);
+
+	return stream;
+}
+
+static gboolean
+read_dataset (Builder      *builder,
+              const gchar  *dir,
+              const gchar  *name,
+              RowFunc       func,
+              GError      **error)
+{
+	gchar *fields[MAX_FIELDS];
+	GDataInputStream *data_stream;
+	GInputStream *stream;
+	gboolean header = TRUE;
+	GError *inner_error = NULL;
+	gchar *line;
+
+	stream = open_dataset (dir, name, error);
+
+	if (!stream)
+		return FALSE;
+
+	g_print ("Reading %s...\n", name);
+	data_stream = g_data_input_stream_new (stream);
+	g_object_unref (stream);
+
+	while ((line = g_data_input_stream_read_line (data_stream, NULL, NULL, &inner_error)) != NULL) {
+		guint n_fields = 0;
+		gchar *pos = line;
+
+		/* Split in place */
+		fields[n_fields++] = pos;
+
+		while (n_fields < MAX_FIELDS && (pos = strchr (pos, '\t')) != NULL) {
+			*pos++ = '\0';
+			fields[n_fields++] = pos;
+		}
+
+		if (!header)
+			func (builder, fields, n_fields);
+
+		header = FALSE;
+		g_free (line);
+	}
+
+	g_object_unref (data_stream);
+
+	if (inner_error) {
+		g_propagate_error (error, inner_error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* tconst, titleType, primaryTitle, originalTitle, isAdult,
+ * startYear, endYear, runtimeMinutes, genres
+ */
+static void
+read_basics_row (Builder  *builder,
+                 gchar   **fields,
+                 guint     n_fields)
+{
+	const gchar *genres;
+	TitleType type;
+	Title *title;
+
+	if (n_fields < 9)
+		return;
+
+	if (strcmp (fields[1], "movie") == 0 ||
+	    strcmp (fields[1], "tvMovie") == 0)
+		type = TITLE_FILM;
+	else if (strcmp (fields[1], "tvSeries") == 0 ||
+	         strcmp (fields[1], "tvMiniSeries") == 0)
+		type = TITLE_SERIES;
+	else if (strcmp (fields[1], "tvEpisode") == 0)
+		type = TITLE_EPISODE;
+	else
+		return;
+
+	title = g_new0 (Title, 1);
+	title->id = g_strdup (fields[0]);
+	title->type = type;
+	title->metadata = tmm_metadata_new ();
+	title->metadata->is_episode = type == TITLE_EPISODE;
+	title->metadata->title = g_strdup (fields[2]);
+	title->year = field_get_int (fields[5]);
+	title->metadata->release_date = year_to_time (title->year);
+
+	if (type == TITLE_FILM) {
+		title->metadata->runtime = field_get_int (fields[7]);
+
+		/* FIXME: nmm:genre cardinality is 1, keep the first */
+		genres = field_value (fields[8]);
+
+		if (genres)
+			title->metadata->genre = g_strndup (genres, strcspn (genres, ","));
+	}
+
+	g_hash_table_insert (builder->titles, title->id, title);
+}
+
+/* tconst, parentTconst, seasonNumber, episodeNumber */
+static void
+read_episode_row (Builder  *builder,
+                  gchar   **fields,
+                  guint     n_fields)
+{
+	Title *title;
+
+	if (n_fields < 4)
+		return;
+
+	title = g_hash_table_lookup (builder->titles, fields[0]);
+
+	if (!title || title->type != TITLE_EPISODE)
+		return;
+
+	title->series_id = g_strdup (fields[1]);
+	title->metadata->season = (gint) field_get_int (fields[2]);
+	title->metadata->episode = (gint) field_get_int (fields[3]);
+}
+
+/* tconst, averageRating, numVotes */
+static void
+read_ratings_row (Builder  *builder,
+                  gchar   **fields,
+                  guint     n_fields)
+{
+	Title *title;
+
+	if (n_fields < 3)
+		return;
+
+	title = g_hash_table_lookup (builder->titles, fields[0]);
+
+	if (title)
+		title->votes = (guint) MAX (field_get_int (fields[2]), 0);
+}
+
+/* tconst, ordering, nconst, category, job, characters */
+static void
+read_principals_row (Builder  *builder,
+                     gchar   **fields,
+                     guint     n_fields)
+{
+	GPtrArray *artists;
+	Title *title;
+
+	if (n_fields < 4)
+		return;
+
+	title = g_hash_table_lookup (builder->titles, fields[0]);
+
+	if (!title || title->type == TITLE_SERIES)
+		return;
+
+	if (strcmp (fields[3], "director") == 0)
+		artists = title->metadata->directors;
+	else if (strcmp (fields[3], "producer") == 0)
+		artists = title->metadata->producers;
+	else if (title->type == TITLE_FILM &&
+	         (strcmp (fields[3], "actor") == 0 ||
+	          strcmp (fields[3], "actress") == 0))
+		artists = title->metadata->actors;
+	else
+		return;
+
+	/* Replaced by the name later on */
+	g_ptr_array_add (artists, g_strdup (fields[2]));
+
+	if (!g_hash_table_contains (builder->names, fields[2]))
+		g_hash_table_insert (builder->names, g_strdup (fields[2]), NULL);
+}
+
+/* nconst, primaryName, ... */
+static void
+read_names_row (Builder  *builder,
+                gchar   **fields,
+                guint     n_fields)
+{
+	if (n_fields < 2)
+		return;
+
+	/* Only artists in the index are of interest */
+	if (g_hash_table_contains (builder->names, fields[0]))
+		g_hash_table_insert (builder->names, g_strdup (fields[0]), g_strdup (fields[1]));
+}
+
+static void
+resolve_artists (Builder   *builder,
+                 GPtrArray *artists)
+{
+	const gchar *name;
+	guint i = 0;
+
+	while (i < artists->len) {
+		name = g_hash_table_lookup (builder->names, g_ptr_array_index (artists, i));
+
+		if (name) {
+			g_free (g_ptr_array_index (artists, i));
+			g_ptr_array_index (artists, i) = g_strdup (name);
+			i++;
+		} else {
+			g_ptr_array_remove_index (artists, i);
+		}
+	}
+}
+
+/* Keeps the most voted title for every key */
+static void
+index_add (GHashTable  *index,
+           gchar       *key,
+           Title       *title)
+{
+	Title *current;
+
+	current = g_hash_table_lookup (index, key);
+
+	if (!current || title->votes > current->votes)
+		g_hash_table_insert (index, key, title);
+	else
+		g_free (key);
+}
+
+static gint
+index_entry_compare (gconstpointer a,
+                     gconstpointer b)
+{
+	const IndexEntry *entry_a = a, *entry_b = b;
+
+	return strcmp (entry_a->key, entry_b->key);
+}
+
+/* Returns the index as a sorted a(ss), adding the
+ * metadata of every title in it to @records.
+ */
+static GVariant *
+index_to_variant (GHashTable *index,
+                  GHashTable *records)
+{
+	GVariantBuilder builder;
+	GHashTableIter iter;
+	IndexEntry entry;
+	GArray *entries;
+	guint i;
+
+	entries = g_array_sized_new (FALSE, FALSE, sizeof (IndexEntry),
+	                             g_hash_table_size (index));
+	g_hash_table_iter_init (&iter, index);
+
+	while (g_hash_table_iter_next (&iter, (gpointer *) &entry.key, (gpointer *) &entry.title))
+		g_array_append_val (entries, entry);
+
+	g_array_sort (entries, index_entry_compare);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ss)"));
+
+	for (i = 0; i < entries->len; i++) {
+		IndexEntry *item = &g_array_index (entries, IndexEntry, i);
+
+		g_variant_builder_add (&builder, "(ss)", item->key, item->title->id);
+		g_hash_table_add (records, item->title);
+	}
+
+	g_array_free (entries, TRUE);
+
+	return g_variant_builder_end (&builder);
+}
+
+static gint
+title_compare (gconstpointer a,
+               gconstpointer b)
+{
+	const Title *title_a = *((Title **) a), *title_b = *((Title **) b);
+
+	return strcmp (title_a->id, title_b->id);
+}
+
+static GVariant *
+records_to_variant (Builder    *builder,
+                    GHashTable *records)
+{
+	GVariantBuilder variant_builder;
+	GHashTableIter iter;
+	GPtrArray *sorted;
+	Title *title;
+	guint i;
+
+	sorted = g_ptr_array_sized_new (g_hash_table_size (records));
+	g_hash_table_iter_init (&iter, records);
+
+	while (g_hash_table_iter_next (&iter, (gpointer *) &title, NULL))
+		g_ptr_array_add (sorted, title);
+
+	g_ptr_array_sort (sorted, title_compare);
+	g_variant_builder_init (&variant_builder, G_VARIANT_TYPE ("a(sv)"));
+
+	for (i = 0; i < sorted->len; i++) {
+		title = g_ptr_array_index (sorted, i);
+
+		resolve_artists (builder, title->metadata->directors);
+		resolve_artists (builder, title->metadata->producers);
+		resolve_artists (builder, title->metadata->actors);
+
+		g_variant_builder_add (&variant_builder, "(sv)", title->id,
+		                       tmm_metadata_to_variant (title->metadata));
+	}
+
+	g_ptr_array_unref (sorted);
+
+	return g_variant_builder_end (&variant_builder);
+}
+
+static GVariant *
+builder_build_index (Builder *builder)
+{
+	GHashTable *films, *episodes, *records;
+	GVariant *films_variant, *episodes_variant, *records_variant;
+	GHashTableIter iter;
+	Title *title, *series;
+	gchar *normalized;
+
+	films = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	episodes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	records = g_hash_table_new (NULL, NULL);
+
+	g_hash_table_iter_init (&iter, builder->titles);
+
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &title)) {
+		if (title->type == TITLE_FILM) {
+			normalized = tmm_backend_local_normalize_title (title->metadata->title);
+
+			/* Remakes and namesakes are told apart by year */
+			if (title->year > 0)
+				index_add (films,
+				           g_strdup_printf ("%s|%d", normalized, title->year),
+				           title);
+
+			index_add (films, normalized, title);
+		} else if (title->type == TITLE_EPISODE &&
+		           title->series_id &&
+		           title->metadata->season > 0 &&
+		           title->metadata->episode > 0) {
+			series = g_hash_table_lookup (builder->titles, title->series_id);
+
+			if (!series || series->type != TITLE_SERIES)
+				continue;
+
+			/* Episodes compete through their series' popularity */
+			title->votes = series->votes;
+
+			normalized = tmm_backend_local_normalize_title (series->metadata->title);
+			index_add (episodes,
+			           g_strdup_printf ("%s|%d|%d", normalized,
+			                            title->metadata->season,
+			                            title->metadata->episode),
+			           title);
+			g_free (normalized);
+		}
+	}
+
+	films_variant = index_to_variant (films, records);
+	episodes_variant = index_to_variant (episodes, records);
+	records_variant = records_to_variant (builder, records);
+
+	g_print ("Indexed %u film keys, %u episodes\n",
+	         g_hash_table_size (films), g_hash_table_size (episodes));
+
+	g_hash_table_unref (films);
+	g_hash_table_unref (episodes);
+	g_hash_table_unref (records);
+
+	return g_variant_new ("(u@a(ss)@a(ss)@a(sv))", TMM_INDEX_VERSION,
+	                      films_variant, episodes_variant, records_variant);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	Builder builder;
+	GVariant *index;
+	gboolean retval;
+
+	setlocale (LC_ALL, "");
+
+	context = g_option_context_new ("DATASET-DIR OUTPUT - Build a local metadata index");
+
+	if (!g_option_context_parse (context, &argc, &argv, &error) || argc != 3) {
+		if (error) {
+			g_printerr ("%s\n", error->message);
+			g_error_free (error);
+		} else {
+			g_printerr ("Usage: %s DATASET-DIR OUTPUT\n", argv[0]);
+		}
+
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free (context);
+
+	builder.titles = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                        NULL, (GDestroyNotify) title_free);
+	builder.names = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                       g_free, g_free);
+
+	retval = (read_dataset (&builder, argv[1], "title.basics.tsv", read_basics_row, &error) &&
+	          read_dataset (&builder, argv[1], "title.episode.tsv", read_episode_row, &error) &&
+	          read_dataset (&builder, argv[1], "title.principals.tsv", read_principals_row, &error) &&
+	          read_dataset (&builder, argv[1], "name.basics.tsv", read_names_row, &error));
+
+	if (retval &&
+	    !read_dataset (&builder, argv[1], "title.ratings.tsv", read_ratings_row, &error)) {
+		g_printerr ("No ratings, picking arbitrary titles on name clashes: %s\n",
+		            error->message);
+		g_clear_error (&error);
+	}
+
+	if (retval) {
+		index = g_variant_ref_sink (builder_build_index (&builder));
+		retval = g_file_set_contents (argv[2],
+		                              g_variant_get_data (index),
+		                              g_variant_get_size (index),
+		                              &error);
+		g_variant_unref (index);
+	}
+
+	if (!retval) {
+		g_printerr ("Could not build index: %s\n", error->message);
+		g_error_free (error);
+	}
+
+	g_hash_table_unref (builder.titles);
+	g_hash_table_unref (builder.names);
+
+	return retval ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,695 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "tmm-cache.h"
+
+/* The cache file is a single serialized GVariant, so it can be
+ * mapped and looked up in place without parsing it upfront. Each
+ * tier is an array of (key, expiration time, value) tuples sorted
+ * by key, entries are found through binary search.
+ *
+ * Entries added since the file was loaded are kept in an in-memory
+ * overlay, until the cache is saved again. Saving in the background
+ * moves the overlay aside, read-only, for the saving thread to merge
+ * with the file; entries added meanwhile go to a new overlay.
+ */
+#define TMM_CACHE_VERSION 1
+#define TMM_CACHE_VARIANT_TYPE "(uaa(sxv))"
+
+typedef struct _CacheEntry CacheEntry;
+typedef struct _SaveData SaveData;
+
+struct _CacheEntry
+{
+	gint64 expires;
+	GVariant *value;
+};
+
+/* Everything the saving thread touches, it owns or only reads */
+struct _SaveData
+{
+	TmmCache *cache;
+	gchar *path;
+	GVariant *tiers[TMM_CACHE_N_TIERS];
+	GHashTable *overlay[TMM_CACHE_N_TIERS];
+
+	GMutex lock;
+	GCond cond;
+	gboolean done;
+	gboolean saved;
+	GError *error;
+};
+
+struct _TmmCache
+{
+	gchar *path;
+	GVariant *contents;
+	GVariant *tiers[TMM_CACHE_N_TIERS];
+	GHashTable *overlay[TMM_CACHE_N_TIERS];
+
+	/* Background save in progress, its entries are looked
+	 * up between the overlay and the file.
+	 */
+	SaveData *save;
+
+	guint hits[TMM_CACHE_N_TIERS];
+	guint misses[TMM_CACHE_N_TIERS];
+
+	guint dirty : 1;
+};
+
+static gint64
+current_time (void)
+{
+	return g_get_real_time () / G_USEC_PER_SEC;
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+	g_variant_unref (entry->value);
+	g_free (entry);
+}
+
+static void
+tmm_cache_unload (TmmCache *cache)
+{
+	guint i;
+
+	for (i = 0; i < TMM_CACHE_N_TIERS; i++)
+		g_clear_pointer (&cache->tiers[i], g_variant_unref);
+
+	g_clear_pointer (&cache->contents, g_variant_unref);
+}
+
+static void
+tmm_cache_load (TmmCache *cache)
+{
+	GMappedFile *mapped_file;
+	GError *error = NULL;
+	GVariant *tiers;
+	GBytes *bytes;
+	guint version, i;
+
+	mapped_file = g_mapped_file_new (cache->path, FALSE, &error);
+
+	if (!mapped_file) {
+		if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_warning ("Could not load cache '%s': %s",
+			           cache->path, error->message);
+		g_error_free (error);
+		return;
+	}
+
+	bytes = g_mapped_file_get_bytes (mapped_file);
+	g_mapped_file_unref (mapped_file);
+
+	cache->contents = g_variant_new_from_bytes (G_VARIANT_TYPE (TMM_CACHE_VARIANT_TYPE),
+	                                            bytes, FALSE);
+	g_variant_ref_sink (cache->contents);
+	g_bytes_unref (bytes);
+
+	g_variant_get (cache->contents, "(u@aa(sxv))", &version, &tiers);
+
+	if (version == TMM_CACHE_VERSION) {
+		/* Tiers unknown to an older file are left empty */
+		for (i = 0; i < MIN (g_variant_n_children (tiers), TMM_CACHE_N_TIERS); i++)
+			cache->tiers[i] = g_variant_get_child_value (tiers, i);
+	} else {
+		g_debug ("Ignoring cache '%s' with version %u", cache->path, version);
+	}
+
+	g_variant_unref (tiers);
+}
+
+TmmCache *
+tmm_cache_new (const gchar *path)
+{
+	TmmCache *cache;
+	guint i;
+
+	cache = g_new0 (TmmCache, 1);
+	cache->path = g_strdup (path);
+
+	for (i = 0; i < TMM_CACHE_N_TIERS; i++) {
+		cache->overlay[i] = g_hash_table_new_full (g_str_hash, g_str_equal,
+		                                           (GDestroyNotify) g_free,
+		                                           (GDestroyNotify) cache_entry_free);
+	}
+
+	tmm_cache_load (cache);
+
+	return cache;
+}
+
+static void tmm_cache_wait_save (TmmCache *cache);
+
+void
+tmm_cache_free (TmmCache *cache)
+{
+	guint i;
+
+	tmm_cache_wait_save (cache);
+	tmm_cache_unload (cache);
+
+	for (i = 0; i < TMM_CACHE_N_TIERS; i++)
+		g_hash_table_unref (cache->overlay[i]);
+
+	g_free (cache->path);
+	g_free (cache);
+}
+
+static gboolean
+tier_lookup (GVariant     *tier,
+             const gchar  *key,
+             gint64       *expires,
+             GVariant    **value)
+{
+	gsize lo, hi;
+
+	lo = 0;
+	hi = g_variant_n_children (tier);
+
+	while (lo < hi) {
+		const gchar *child_key;
+		GVariant *child;
+		gsize mid;
+		gint cmp;
+
+		mid = lo + (hi - lo) / 2;
+		child = g_variant_get_child_value (tier, mid);
+		g_variant_get_child (child, 0, "&s", &child_key);
+		cmp = strcmp (key, child_key);
+
+		if (cmp == 0) {
+			g_variant_get (child, "(&sxv)", NULL, expires, value);
+			g_variant_unref (child);
+			return TRUE;
+		}
+
+		g_variant_unref (child);
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return FALSE;
+}
+
+/* Returns a new reference to the value, or NULL if there is
+ * no entry for @key, or it expired already.
+ */
+GVariant *
+tmm_cache_lookup (TmmCache     *cache,
+                  TmmCacheTier  tier,
+                  const gchar  *key)
+{
+	GVariant *value = NULL;
+	gint64 expires = 0;
+	CacheEntry *entry;
+
+	g_return_val_if_fail (tier < TMM_CACHE_N_TIERS, NULL);
+
+	entry = g_hash_table_lookup (cache->overlay[tier], key);
+
+	if (!entry && cache->save)
+		entry = g_hash_table_lookup (cache->save->overlay[tier], key);
+
+	if (entry) {
+		expires = entry->expires;
+		value = g_variant_ref (entry->value);
+	} else if (cache->tiers[tier]) {
+		tier_lookup (cache->tiers[tier], key, &expires, &value);
+	}
+
+	if (value && expires <= current_time ())
+		g_clear_pointer (&value, g_variant_unref);
+
+	if (value)
+		cache->hits[tier]++;
+	else
+		cache->misses[tier]++;
+
+	return value;
+}
+
+/* @ttl is given in seconds */
+void
+tmm_cache_insert (TmmCache     *cache,
+                  TmmCacheTier  tier,
+                  const gchar  *key,
+                  GVariant     *value,
+                  gint64        ttl)
+{
+	CacheEntry *entry;
+
+	g_return_if_fail (tier < TMM_CACHE_N_TIERS);
+
+	entry = g_new0 (CacheEntry, 1);
+	entry->expires = current_time () + ttl;
+	entry->value = g_variant_ref_sink (value);
+
+	g_hash_table_replace (cache->overlay[tier], g_strdup (key), entry);
+	cache->dirty = TRUE;
+}
+
+/* Leaves an expired entry in the overlay, that hides the one in
+ * the file until the cache is saved without either.
+ */
+void
+tmm_cache_remove (TmmCache     *cache,
+                  TmmCacheTier  tier,
+                  const gchar  *key)
+{
+	CacheEntry *entry;
+
+	g_return_if_fail (tier < TMM_CACHE_N_TIERS);
+
+	entry = g_new0 (CacheEntry, 1);
+	entry->expires = 0;
+	entry->value = g_variant_ref_sink (g_variant_new ("()"));
+
+	g_hash_table_replace (cache->overlay[tier], g_strdup (key), entry);
+	cache->dirty = TRUE;
+}
+
+/* Calls @func on every entry in @tier that didn't expire yet,
+ * in no particular order. Doesn't count as hits.
+ */
+void
+tmm_cache_foreach (TmmCache            *cache,
+                   TmmCacheTier         tier,
+                   TmmCacheForeachFunc  func,
+                   gpointer             user_data)
+{
+	GHashTableIter iter;
+	CacheEntry *entry;
+	gint64 now;
+	gchar *key;
+	gsize i;
+
+	g_return_if_fail (tier < TMM_CACHE_N_TIERS);
+
+	now = current_time ();
+
+	for (i = 0; cache->tiers[tier] && i < g_variant_n_children (cache->tiers[tier]); i++) {
+		const gchar *child_key;
+		GVariant *value;
+		gint64 expires;
+
+		g_variant_get_child (cache->tiers[tier], i, "(&sxv)",
+		                     &child_key, &expires, &value);
+
+		if (expires > now &&
+		    !g_hash_table_contains (cache->overlay[tier], child_key) &&
+		    !(cache->save && g_hash_table_contains (cache->save->overlay[tier], child_key)))
+			func (child_key, value, user_data);
+
+		g_variant_unref (value);
+	}
+
+	if (cache->save) {
+		g_hash_table_iter_init (&iter, cache->save->overlay[tier]);
+
+		while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &entry)) {
+			if (entry->expires > now &&
+			    !g_hash_table_contains (cache->overlay[tier], key))
+				func (key, entry->value, user_data);
+		}
+	}
+
+	g_hash_table_iter_init (&iter, cache->overlay[tier]);
+
+	while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &entry)) {
+		if (entry->expires > now)
+			func (key, entry->value, user_data);
+	}
+}
+
+gboolean
+tmm_cache_is_dirty (TmmCache *cache)
+{
+	return cache->dirty;
+}
+
+/* Entries held in memory until the next save, not counting
+ * those a background save is writing.
+ */
+guint
+tmm_cache_get_n_pending (TmmCache *cache)
+{
+	guint i, n_pending = 0;
+
+	for (i = 0; i < TMM_CACHE_N_TIERS; i++)
+		n_pending += g_hash_table_size (cache->overlay[i]);
+
+	return n_pending;
+}
+
+/* Entries in the file, expired ones included */
+guint
+tmm_cache_get_n_saved (TmmCache *cache)
+{
+	guint i, n_saved = 0;
+
+	for (i = 0; i < TMM_CACHE_N_TIERS; i++) {
+		if (cache->tiers[i])
+			n_saved += g_variant_n_children (cache->tiers[i]);
+	}
+
+	return n_saved;
+}
+
+typedef struct _MergeEntry MergeEntry;
+
+struct _MergeEntry
+{
+	gchar *key;
+	gint64 expires;
+	GVariant *value;
+};
+
+static gint
+merge_entry_compare (gconstpointer a,
+                     gconstpointer b)
+{
+	const MergeEntry *entry_a = a, *entry_b = b;
+
+	return strcmp (entry_a->key, entry_b->key);
+}
+
+static GVariant *
+build_tier (GVariant   *tier,
+            GHashTable *overlay,
+            gint64      now)
+{
+	GVariantBuilder builder;
+	GHashTableIter iter;
+	CacheEntry *entry;
+	MergeEntry merge;
+	GArray *entries;
+	gchar *key;
+	guint i;
+
+	entries = g_array_new (FALSE, FALSE, sizeof (MergeEntry));
+
+	/* Entries from the file that weren't replaced nor expired */
+	for (i = 0; tier && i < g_variant_n_children (tier); i++) {
+		g_variant_get_child (tier, i, "(sxv)",
+		                     &merge.key, &merge.expires, &merge.value);
+
+		if (merge.expires <= now ||
+		    g_hash_table_contains (overlay, merge.key)) {
+			g_free (merge.key);
+			g_variant_unref (merge.value);
+			continue;
+		}
+
+		g_array_append_val (entries, merge);
+	}
+
+	g_hash_table_iter_init (&iter, overlay);
+
+	while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &entry)) {
+		if (entry->expires <= now)
+			continue;
+
+		merge.key = g_strdup (key);
+		merge.expires = entry->expires;
+		merge.value = g_variant_ref (entry->value);
+		g_array_append_val (entries, merge);
+	}
+
+	g_array_sort (entries, merge_entry_compare);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sxv)"));
+
+	for (i = 0; i < entries->len; i++) {
+		MergeEntry *item = &g_array_index (entries, MergeEntry, i);
+
+		g_variant_builder_add (&builder, "(sxv)",
+		                       item->key, item->expires, item->value);
+		g_free (item->key);
+		g_variant_unref (item->value);
+	}
+
+	g_array_free (entries, TRUE);
+
+	return g_variant_builder_end (&builder);
+}
+
+/* Merges @overlay into @tiers, and writes the result to @path */
+static gboolean
+write_file (const gchar  *path,
+            GVariant    **tiers,
+            GHashTable  **overlay,
+            GError      **error)
+{
+	GVariantBuilder builder;
+	GVariant *contents;
+	gboolean retval;
+	gchar *dir;
+	gint64 now;
+	guint i;
+
+	now = current_time ();
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa(sxv)"));
+
+	for (i = 0; i < TMM_CACHE_N_TIERS; i++)
+		g_variant_builder_add_value (&builder, build_tier (tiers[i], overlay[i], now));
+
+	contents = g_variant_new ("(u@aa(sxv))", TMM_CACHE_VERSION,
+	                          g_variant_builder_end (&builder));
+	g_variant_ref_sink (contents);
+
+	dir = g_path_get_dirname (path);
+
+	if (g_mkdir_with_parents (dir, 0700) < 0) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+		             "Could not create directory '%s': %s",
+		             dir, g_strerror (errno));
+		retval = FALSE;
+	} else {
+		retval = g_file_set_contents (path,
+		                              g_variant_get_data (contents),
+		                              g_variant_get_size (contents),
+		                              error);
+	}
+
+	g_variant_unref (contents);
+	g_free (dir);
+
+	return retval;
+}
+
+static void
+save_data_free (SaveData *save)
+{
+	guint i;
+
+	for (i = 0; i < TMM_CACHE_N_TIERS; i++) {
+		g_clear_pointer (&save->tiers[i], g_variant_unref);
+		g_clear_pointer (&save->overlay[i], g_hash_table_unref);
+	}
+
+	g_mutex_clear (&save->lock);
+	g_cond_clear (&save->cond);
+	g_clear_error (&save->error);
+	g_free (save->path);
+	g_free (save);
+}
+
+static void
+save_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+	SaveData *save = task_data;
+	GError *error = NULL;
+	gboolean saved;
+
+	saved = write_file (save->path, save->tiers, save->overlay, &error);
+
+	g_mutex_lock (&save->lock);
+	save->saved = saved;
+	save->error = error;
+	save->done = TRUE;
+	g_cond_signal (&save->cond);
+	g_mutex_unlock (&save->lock);
+
+	g_task_return_boolean (task, TRUE);
+}
+
+/* Runs in the main thread once the saving thread is done. The
+ * file is mapped again, or on failure the entries go back to
+ * the overlay, unless replaced in the meantime.
+ */
+static void
+tmm_cache_finish_save (TmmCache *cache)
+{
+	SaveData *save = cache->save;
+	GHashTableIter iter;
+	CacheEntry *entry;
+	gchar *key;
+	guint i;
+
+	cache->save = NULL;
+	save->cache = NULL;
+
+	if (save->saved) {
+		tmm_cache_unload (cache);
+		tmm_cache_load (cache);
+		return;
+	}
+
+	g_warning ("Could not save cache '%s': %s",
+	           save->path, save->error->message);
+
+	for (i = 0; i < TMM_CACHE_N_TIERS; i++) {
+		g_hash_table_iter_init (&iter, save->overlay[i]);
+
+		while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &entry)) {
+			if (g_hash_table_contains (cache->overlay[i], key))
+				continue;
+
+			g_hash_table_iter_steal (&iter);
+			g_hash_table_insert (cache->overlay[i], key, entry);
+		}
+	}
+
+	cache->dirty = TRUE;
+}
+
+/* Blocks until the background save, if any, is done */
+static void
+tmm_cache_wait_save (TmmCache *cache)
+{
+	SaveData *save = cache->save;
+
+	if (!save)
+		return;
+
+	g_mutex_lock (&save->lock);
+
+	while (!save->done)
+		g_cond_wait (&save->cond, &save->lock);
+
+	g_mutex_unlock (&save->lock);
+
+	tmm_cache_finish_save (cache);
+}
+
+static void
+save_done_cb (GObject      *object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+	SaveData *save = user_data;
+
+	/* Finished already by tmm_cache_wait_save() */
+	if (save->cache)
+		tmm_cache_finish_save (save->cache);
+
+	save_data_free (save);
+}
+
+/* Saves the cache from a thread, failures are logged. Does
+ * nothing if a background save is in progress already.
+ */
+void
+tmm_cache_save_in_background (TmmCache *cache)
+{
+	SaveData *save;
+	GTask *task;
+	guint i;
+
+	if (!cache->dirty || cache->save)
+		return;
+
+	save = g_new0 (SaveData, 1);
+	save->cache = cache;
+	save->path = g_strdup (cache->path);
+	g_mutex_init (&save->lock);
+	g_cond_init (&save->cond);
+
+	for (i = 0; i < TMM_CACHE_N_TIERS; i++) {
+		if (cache->tiers[i])
+			save->tiers[i] = g_variant_ref (cache->tiers[i]);
+
+		save->overlay[i] = cache->overlay[i];
+		cache->overlay[i] = g_hash_table_new_full (g_str_hash, g_str_equal,
+		                                           (GDestroyNotify) g_free,
+		                                           (GDestroyNotify) cache_entry_free);
+	}
+
+	cache->save = save;
+	cache->dirty = FALSE;
+
+	task = g_task_new (NULL, NULL, save_done_cb, save);
+	g_task_set_task_data (task, save, NULL);
+	g_task_run_in_thread (task, save_thread);
+	g_object_unref (task);
+}
+
+/* Waits for any background save first */
+gboolean
+tmm_cache_save (TmmCache  *cache,
+                GError   **error)
+{
+	guint i;
+
+	tmm_cache_wait_save (cache);
+
+	if (!cache->dirty)
+		return TRUE;
+
+	if (!write_file (cache->path, cache->tiers, cache->overlay, error))
+		return FALSE;
+
+	/* Everything is in the file now, map it again */
+	tmm_cache_unload (cache);
+
+	for (i = 0; i < TMM_CACHE_N_TIERS; i++)
+		g_hash_table_remove_all (cache->overlay[i]);
+
+	tmm_cache_load (cache);
+	cache->dirty = FALSE;
+
+	return TRUE;
+}
+
+void
+tmm_cache_get_stats (TmmCache     *cache,
+                     TmmCacheTier  tier,
+                     guint        *hits,
+                     guint        *misses)
+{
+	g_return_if_fail (tier < TMM_CACHE_N_TIERS);
+
+	if (hits)
+		*hits = cache->hits[tier];
+	if (misses)
+		*misses = cache->misses[tier];
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TMM_CACHE_H__
+#define __TMM_CACHE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TmmCache TmmCache;
+
+typedef enum {
+	TMM_CACHE_IDS,    /* Lookup key -> ID, as "s" */
+	TMM_CACHE_TOPICS, /* ID -> TmmMetadata variant */
+	TMM_CACHE_MISSES, /* Lookup key -> (failures, retry time), as "(ux)" */
+	TMM_CACHE_HASHES, /* Content hash -> ID, as "s" */
+	TMM_CACHE_WRITTEN, /* URN -> (metadata, lookup key, content hash) last written, as "(vss)" */
+	TMM_CACHE_SCHEDULE, /* URN -> (enrichment time, confidence, release date, refreshing), as "(xdxb)" */
+	TMM_CACHE_JOURNAL, /* URN -> progress of an unfinished lookup, as "(ssiiisb)" */
+	TMM_CACHE_N_TIERS
+} TmmCacheTier;
+
+typedef void (* TmmCacheForeachFunc) (const gchar *key,
+                                      GVariant    *value,
+                                      gpointer     user_data);
+
+TmmCache * tmm_cache_new           (const gchar         *path);
+void       tmm_cache_free          (TmmCache            *cache);
+
+GVariant * tmm_cache_lookup        (TmmCache            *cache,
+                                    TmmCacheTier         tier,
+                                    const gchar         *key);
+void       tmm_cache_insert        (TmmCache            *cache,
+                                    TmmCacheTier         tier,
+                                    const gchar         *key,
+                                    GVariant            *value,
+                                    gint64               ttl);
+void       tmm_cache_remove        (TmmCache            *cache,
+                                    TmmCacheTier         tier,
+                                    const gchar         *key);
+
+void       tmm_cache_foreach       (TmmCache            *cache,
+                                    TmmCacheTier         tier,
+                                    TmmCacheForeachFunc  func,
+                                    gpointer             user_data);
+
+gboolean   tmm_cache_is_dirty      (TmmCache            *cache);
+guint      tmm_cache_get_n_pending (TmmCache            *cache);
+guint      tmm_cache_get_n_saved   (TmmCache            *cache);
+gboolean   tmm_cache_save          (TmmCache            *cache,
+                                    GError             **error);
+void       tmm_cache_save_in_background (TmmCache       *cache);
+
+void       tmm_cache_get_stats     (TmmCache            *cache,
+                                    TmmCacheTier         tier,
+                                    guint               *hits,
+                                    guint               *misses);
+
+G_END_DECLS
+
+#endif /* __TMM_CACHE_H__ */
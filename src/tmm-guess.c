@@ -0,0 +1,588 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "tmm-guess.h"
+
+/* Release, quality and codec tags, never part of a title. These are
+ * looked up through a perfect hash of the lowercase token: seeded
+ * FNV-1a, with the seed picked so no two tags share a slot.
+ */
+#define TAG_HASH_SEED 8u
+#define TAG_HASH_SIZE 1024
+
+static const gchar *tags[] = {
+	"1080i", "1080p", "10bit", "2160p", "2ch", "480p", "4k",
+	"576p", "6ch", "720p", "8bit", "aac", "aac2", "ac3", "amzn",
+	"atmos", "avc", "bdremux", "bdrip", "blu-ray", "bluray",
+	"brrip", "dd5", "ddp5", "divx", "dolbyvision", "dsnp", "dsr",
+	"dts", "dts-hd", "dtshd", "dubbed", "dvd5", "dvd9", "dvdr",
+	"dvdrip", "dvdscr", "dvdscreener", "eac3", "extended", "flac",
+	"h264", "h265", "hdcam", "hddvd", "hdr", "hdr10", "hdr10+",
+	"hdrip", "hdtv", "hevc", "hi10p", "hmax", "hulu", "internal",
+	"limited", "mp3", "mpeg2", "multisub", "nf", "pdtv", "ppv",
+	"proper", "r5", "remastered", "remux", "repack", "rerip",
+	"screener", "sdtv", "subbed", "telecine", "telesync", "truehd",
+	"uhd", "uncut", "unrated", "vc1", "vhsrip", "vostfr", "web-dl",
+	"webdl", "webrip", "x264", "x265", "xvid",
+};
+
+/* Index into tags[] plus one, 0 for empty slots */
+static const guint8 tag_slots[TAG_HASH_SIZE] = {
+	0, 0, 0, 0, 0, 70, 0, 0, 0, 55, 0, 0, 0, 0, 0, 23,
+	0, 0, 0, 22, 0, 0, 0, 0, 0, 0, 0, 0, 60, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 74, 83, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 71, 0, 0, 0, 0, 0, 0,
+	0, 0, 37, 47, 0, 0, 0, 0, 0, 0, 0, 75, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 28, 0, 0, 0, 0, 0, 0, 0, 0, 0, 77,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 31, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 59, 0, 0,
+	0, 0, 15, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 50, 11, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 33, 0, 0, 0, 0, 0, 86,
+	0, 64, 0, 73, 0, 0, 0, 0, 48, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 41, 85,
+	68, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 0, 0, 0, 0, 0,
+	0, 25, 0, 0, 0, 72, 65, 0, 0, 29, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 30, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 61, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 27, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 20, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 6, 0, 0, 0, 0, 9, 57, 0, 0, 0, 0, 0,
+	0, 0, 63, 0, 0, 0, 0, 0, 0, 0, 56, 0, 42, 0, 52, 0,
+	0, 0, 0, 2, 54, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 10, 0, 0, 0, 0, 0, 0, 0, 0, 79, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 35, 5, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 44, 0, 36, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 21, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 18,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 76, 0, 0, 3, 58, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 24,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 78, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 46, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 17, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 14, 0, 0, 0, 0, 0, 0, 0, 40, 62, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 13,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 7, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 19, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 43,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 32, 0, 0, 0, 0, 0, 0, 0, 0, 69, 0, 0, 0, 0,
+	0, 81, 0, 0, 0, 0, 82, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	39, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 38, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 45, 0, 84, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 51, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 66, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 26, 0, 0, 0, 0, 0, 0, 0, 0, 49, 0, 34, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 12, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 67, 0, 53, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+typedef struct _Token Token;
+typedef struct _ComponentParse ComponentParse;
+
+struct _Token
+{
+	const gchar *str;
+	gsize len;
+};
+
+struct _ComponentParse
+{
+	gchar title[TMM_GUESS_TITLE_MAX];
+	gsize title_len;
+	guint is_file    : 1;
+	guint title_done : 1;
+};
+
+static guint32
+tag_hash (const gchar *str,
+          gsize        len)
+{
+	guint32 hash = TAG_HASH_SEED;
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (guchar) g_ascii_tolower (str[i]);
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+static gboolean
+str_is_tag (const gchar *str,
+            gsize        len)
+{
+	const gchar *tag;
+	guint8 slot;
+
+	slot = tag_slots[tag_hash (str, len) & (TAG_HASH_SIZE - 1)];
+
+	if (slot == 0)
+		return FALSE;
+
+	tag = tags[slot - 1];
+
+	return strlen (tag) == len && g_ascii_strncasecmp (tag, str, len) == 0;
+}
+
+static gboolean
+token_is_tag (const Token *token)
+{
+	const gchar *dash;
+
+	if (str_is_tag (token->str, token->len))
+		return TRUE;
+
+	/* Tags with a release group attached, as in "x264-GROUP" */
+	dash = memchr (token->str, '-', token->len);
+
+	return dash && dash > token->str &&
+		str_is_tag (token->str, dash - token->str);
+}
+
+static gboolean
+token_is_word (const Token *token,
+               const gchar *word)
+{
+	return strlen (word) == token->len &&
+		g_ascii_strncasecmp (token->str, word, token->len) == 0;
+}
+
+static gboolean
+token_is_bracketed (const Token *token)
+{
+	return token->str[0] == '[' || token->str[0] == '(' || token->str[0] == '{';
+}
+
+/* Strips the brackets around @token, the closing one may be missing */
+static void
+token_get_bracketed (const Token *token,
+                     Token       *inner)
+{
+	inner->str = token->str + 1;
+	inner->len = token->len - 1;
+
+	if (inner->len > 0 && (inner->str[inner->len - 1] == ')' ||
+	                       inner->str[inner->len - 1] == ']' ||
+	                       inner->str[inner->len - 1] == '}'))
+		inner->len--;
+}
+
+static gboolean
+token_is_dash (const Token *token)
+{
+	gsize i;
+
+	for (i = 0; i < token->len; i++) {
+		if (token->str[i] != '-')
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Parses up to @max_digits digits, returns -1 if there are none */
+static gint
+parse_number (const gchar **pos,
+              const gchar  *end,
+              gint          max_digits)
+{
+	gint value = 0, n_digits = 0;
+
+	while (*pos < end && g_ascii_isdigit (**pos) && n_digits < max_digits) {
+		value = (value * 10) + (**pos - '0');
+		n_digits++;
+		(*pos)++;
+	}
+
+	return n_digits > 0 ? value : -1;
+}
+
+static gboolean
+token_get_number (const Token *token,
+                  gint        *value)
+{
+	const gchar *pos = token->str;
+
+	*value = parse_number (&pos, token->str + token->len, 4);
+
+	return *value >= 0 && pos == token->str + token->len;
+}
+
+static gboolean
+token_is_year (const Token *token,
+               gint        *year)
+{
+	/* Screw you, 22nd century! */
+	return token->len == 4 &&
+		((token->str[0] == '1' && token->str[1] == '9') ||
+		 (token->str[0] == '2' && token->str[1] == '0')) &&
+		token_get_number (token, year);
+}
+
+/* Handles S01E02, S01E02E03, S01E02-E03, S01E02-03, 1x02, and
+ * E02 if the season is known already (e.g. from the directory).
+ */
+static gboolean
+token_parse_episode (const Token *token,
+                     TmmGuess    *guess)
+{
+	const gchar *pos, *end, *start;
+	gint season, episode, last;
+
+	pos = token->str;
+	end = token->str + token->len;
+
+	if (*pos == 's' || *pos == 'S') {
+		pos++;
+		season = parse_number (&pos, end, 2);
+
+		if (season < 0 || pos == end || (*pos != 'e' && *pos != 'E'))
+			return FALSE;
+
+		pos++;
+		episode = parse_number (&pos, end, 3);
+	} else if (g_ascii_isdigit (*pos)) {
+		season = parse_number (&pos, end, 2);
+
+		if (pos == end || (*pos != 'x' && *pos != 'X'))
+			return FALSE;
+
+		pos++;
+		start = pos;
+		episode = parse_number (&pos, end, 3);
+
+		if (pos - start < 2)
+			return FALSE;
+	} else if ((*pos == 'e' || *pos == 'E') && guess->season > 0) {
+		pos++;
+		season = guess->season;
+		episode = parse_number (&pos, end, 3);
+	} else {
+		return FALSE;
+	}
+
+	if (episode <= 0)
+		return FALSE;
+
+	last = episode;
+
+	/* Multi-episode files */
+	while (pos < end) {
+		if (*pos == '-')
+			pos++;
+		if (pos < end && (*pos == 'e' || *pos == 'E'))
+			pos++;
+
+		last = parse_number (&pos, end, 3);
+
+		if (last < 0)
+			return FALSE;
+	}
+
+	guess->season = season;
+	guess->episode = episode;
+	guess->last_episode = MAX (episode, last);
+
+	return TRUE;
+}
+
+/* "S01" as a whole directory name */
+static gboolean
+token_parse_season (const Token *token,
+                    TmmGuess    *guess)
+{
+	const gchar *pos, *end;
+	gint season;
+
+	pos = token->str;
+	end = token->str + token->len;
+
+	if (*pos != 's' && *pos != 'S')
+		return FALSE;
+
+	pos++;
+	season = parse_number (&pos, end, 2);
+
+	if (season <= 0 || pos != end)
+		return FALSE;
+
+	guess->season = season;
+
+	return TRUE;
+}
+
+static gboolean
+next_token (const gchar **pos,
+            const gchar  *end,
+            Token        *token)
+{
+	const gchar *p = *pos, *closing;
+
+	while (p < end && (*p == ' ' || *p == '.' || *p == '_'))
+		p++;
+
+	if (p == end)
+		return FALSE;
+
+	token->str = p;
+
+	if (*p == '[' || *p == '(' || *p == '{') {
+		closing = memchr (p, *p == '[' ? ']' : *p == '(' ? ')' : '}', end - p);
+		p = closing ? closing + 1 : end;
+	} else {
+		while (p < end &&
+		       *p != ' ' && *p != '.' && *p != '_' &&
+		       *p != '[' && *p != '(' && *p != '{')
+			p++;
+	}
+
+	token->len = p - token->str;
+	*pos = p;
+
+	return TRUE;
+}
+
+static void
+component_parse_append (ComponentParse *parse,
+                        const Token    *token)
+{
+	gsize len;
+
+	len = token->len + (parse->title_len > 0 ? 1 : 0);
+
+	if (parse->title_len + len >= TMM_GUESS_TITLE_MAX) {
+		parse->title_done = TRUE;
+		return;
+	}
+
+	if (parse->title_len > 0)
+		parse->title[parse->title_len++] = ' ';
+
+	memcpy (&parse->title[parse->title_len], token->str, token->len);
+	parse->title_len += token->len;
+	parse->title[parse->title_len] = '\0';
+}
+
+/* Parses a single path component, the title is made of the words
+ * found until the first token that's not part of it (episode
+ * number, year, release tag, anything in brackets...).
+ */
+static void
+component_parse (ComponentParse *parse,
+                 const gchar    *str,
+                 const gchar    *end,
+                 TmmGuess       *guess)
+{
+	const gchar *pos = str, *lookahead;
+	gboolean first = TRUE, dash = FALSE;
+	Token token, next, inner;
+	gint value, next_value;
+
+	while (next_token (&pos, end, &token)) {
+		gboolean is_first = first, after_dash = dash;
+
+		first = FALSE;
+		dash = FALSE;
+
+		if (token_is_bracketed (&token)) {
+			token_get_bracketed (&token, &inner);
+
+			if (token_is_year (&inner, &value))
+				guess->year = value;
+
+			parse->title_done |= parse->title_len > 0;
+			continue;
+		}
+
+		if (token_is_dash (&token)) {
+			dash = TRUE;
+			continue;
+		}
+
+		if (token_parse_episode (&token, guess) ||
+		    (!parse->is_file && token_parse_season (&token, guess))) {
+			parse->title_done = TRUE;
+			continue;
+		}
+
+		if (token_is_word (&token, "season") || token_is_word (&token, "series") ||
+		    token_is_word (&token, "episode") || token_is_word (&token, "ep")) {
+			lookahead = pos;
+
+			if (next_token (&lookahead, end, &next) &&
+			    token_get_number (&next, &value) && value > 0) {
+				if (token.str[0] == 's' || token.str[0] == 'S') {
+					guess->season = value;
+				} else {
+					guess->episode = value;
+					guess->last_episode = value;
+				}
+
+				parse->title_done = TRUE;
+				pos = lookahead;
+				continue;
+			}
+		}
+
+		if (parse->title_len > 0 && token_is_year (&token, &value)) {
+			gboolean next_is_year = FALSE;
+
+			lookahead = pos;
+
+			if (next_token (&lookahead, end, &next)) {
+				if (token_is_bracketed (&next)) {
+					token_get_bracketed (&next, &inner);
+					next = inner;
+				}
+
+				next_is_year = token_is_year (&next, &next_value);
+			}
+
+			/* "Blade Runner 2049 2017" or "Blade Runner 2049 (2017)",
+			 * the first one is part of the title.
+			 */
+			if (!next_is_year) {
+				guess->year = value;
+				parse->title_done = TRUE;
+				continue;
+			}
+		}
+
+		if (token_is_tag (&token)) {
+			parse->title_done |= parse->title_len > 0;
+			continue;
+		}
+
+		/* "02 - Pilot.mkv" inside a season directory */
+		if (parse->is_file && is_first && guess->season > 0 &&
+		    guess->episode == 0 && token.len <= 3 &&
+		    token_get_number (&token, &value) && value > 0) {
+			guess->episode = value;
+			guess->last_episode = value;
+			parse->title_done = TRUE;
+			continue;
+		}
+
+		/* "[Group] Show - 01 [720p].mkv", absolute episode
+		 * numbering, taken as the first season.
+		 */
+		if (parse->is_file && after_dash && parse->title_len > 0 &&
+		    guess->episode == 0 && token.len <= 3 &&
+		    token_get_number (&token, &value) && value > 0) {
+			if (guess->season == 0)
+				guess->season = 1;
+			guess->episode = value;
+			guess->last_episode = value;
+			parse->title_done = TRUE;
+			continue;
+		}
+
+		if (!parse->title_done)
+			component_parse_append (parse, &token);
+	}
+}
+
+static const gchar *
+component_start (const gchar *path,
+                 const gchar *end)
+{
+	while (end > path && end[-1] != G_DIR_SEPARATOR)
+		end--;
+
+	return end;
+}
+
+/**
+ * tmm_guess_parse:
+ * @path: path or basename of a video file
+ * @guess: return location for the guessed data
+ *
+ * Guesses the title of a film or series, and the season and episode
+ * number, from the file name. Single pass over the path, with no
+ * allocations.
+ **/
+void
+tmm_guess_parse (const gchar *path,
+                 TmmGuess    *guess)
+{
+	const gchar *end, *basename, *ext, *parent, *grandparent;
+	ComponentParse file = { { 0 }, 0 }, dir = { { 0 }, 0 };
+	gboolean season_dir = FALSE;
+
+	memset (guess, 0, sizeof (TmmGuess));
+
+	end = path + strlen (path);
+	basename = component_start (path, end);
+
+	ext = strrchr (basename, '.');
+	if (ext && ext > basename)
+		end = ext;
+
+	/* Directories go first, the season they tell is needed
+	 * to make sense of file names like "02 - Pilot.mkv".
+	 */
+	if (basename > path) {
+		parent = component_start (path, basename - 1);
+		component_parse (&dir, parent, basename - 1, guess);
+
+		/* Season directory, the series is one level up */
+		if (dir.title_len == 0 && guess->season > 0 && parent > path) {
+			season_dir = TRUE;
+			dir.title_done = FALSE;
+			grandparent = component_start (path, parent - 1);
+			component_parse (&dir, grandparent, parent - 1, guess);
+		}
+	}
+
+	file.is_file = TRUE;
+	component_parse (&file, basename, end, guess);
+
+	/* Files in season directories are often named after the
+	 * episode, the series title is more reliable there.
+	 */
+	if (file.title_len > 0 && !(season_dir && dir.title_len > 0)) {
+		memcpy (guess->title, file.title, file.title_len + 1);
+	} else if (dir.title_len > 0) {
+		memcpy (guess->title, dir.title, dir.title_len + 1);
+	} else {
+		gsize len = MIN ((gsize) (end - basename), TMM_GUESS_TITLE_MAX - 1);
+
+		memcpy (guess->title, basename, len);
+		guess->title[len] = '\0';
+	}
+}
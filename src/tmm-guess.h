@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TMM_GUESS_H__
+#define __TMM_GUESS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define TMM_GUESS_TITLE_MAX 256
+
+typedef struct _TmmGuess TmmGuess;
+
+struct _TmmGuess
+{
+	gchar title[TMM_GUESS_TITLE_MAX];
+	gint year;
+
+	/* Series only, 0 otherwise */
+	gint season;
+	gint episode;
+	gint last_episode;
+};
+
+void tmm_guess_parse (const gchar *path,
+                      TmmGuess    *guess);
+
+G_END_DECLS
+
+#endif /* __TMM_GUESS_H__ */
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "tmm-hash.h"
+
+/* The "OpenSubtitles" hash: the file size plus the sum of the 64 bit
+ * little endian words in the first and last 64 KiB. It only reads
+ * 128 KiB whatever the file size, and survives renames and moves.
+ */
+#define CHUNK_SIZE (64 * 1024)
+
+static gboolean
+sum_chunk (gint      fd,
+           goffset   offset,
+           guint64  *hash,
+           GError  **error)
+{
+	guint64 buffer[CHUNK_SIZE / sizeof (guint64)];
+	gssize n_read, total = 0;
+	guint i;
+
+	while (total < CHUNK_SIZE) {
+		n_read = pread (fd, (gchar *) buffer + total,
+		                CHUNK_SIZE - total, offset + total);
+
+		if (n_read < 0 && errno == EINTR)
+			continue;
+
+		if (n_read <= 0) {
+			g_set_error (error, G_FILE_ERROR,
+			             n_read < 0 ? g_file_error_from_errno (errno) : G_FILE_ERROR_FAILED,
+			             "Could not read file: %s",
+			             n_read < 0 ? g_strerror (errno) : "Unexpected end of file");
+			return FALSE;
+		}
+
+		total += n_read;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (buffer); i++)
+		*hash += GUINT64_FROM_LE (buffer[i]);
+
+	return TRUE;
+}
+
+gboolean
+tmm_hash_compute (const gchar  *path,
+                  guint64      *hash,
+                  GError      **error)
+{
+	struct stat st;
+	gboolean retval;
+	gint fd;
+
+	fd = g_open (path, O_RDONLY | O_CLOEXEC, 0);
+
+	if (fd < 0 || fstat (fd, &st) < 0) {
+		gint saved_errno = errno;
+
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+		             "Could not open '%s': %s", path, g_strerror (saved_errno));
+		if (fd >= 0)
+			close (fd);
+		return FALSE;
+	}
+
+	if (st.st_size < CHUNK_SIZE) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+		             "'%s' is too small to be hashed", path);
+		close (fd);
+		return FALSE;
+	}
+
+	*hash = st.st_size;
+	retval = (sum_chunk (fd, 0, hash, error) &&
+	          sum_chunk (fd, st.st_size - CHUNK_SIZE, hash, error));
+	close (fd);
+
+	return retval;
+}
+
+gchar *
+tmm_hash_to_string (guint64 hash)
+{
+	return g_strdup_printf ("%016" G_GINT64_MODIFIER "x", hash);
+}
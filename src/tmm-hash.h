@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TMM_HASH_H__
+#define __TMM_HASH_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define TMM_HASH_ALGORITHM "OSHash"
+
+gboolean tmm_hash_compute   (const gchar  *path,
+                             guint64      *hash,
+                             GError      **error);
+gchar *  tmm_hash_to_string (guint64       hash);
+
+G_END_DECLS
+
+#endif /* __TMM_HASH_H__ */
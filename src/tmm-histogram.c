@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "tmm-histogram.h"
+
+/* Values are counted in log-linear buckets, each power of two
+ * is split in SUB_BUCKETS, so percentiles are within ~12% of the
+ * recorded value while the histogram stays a fixed size.
+ */
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define N_BUCKETS ((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+struct _TmmHistogram
+{
+	guint64 buckets[N_BUCKETS];
+	guint64 count;
+};
+
+static guint
+bucket_index (guint64 value)
+{
+	guint exponent;
+
+	if (value < SUB_BUCKETS)
+		return value;
+
+	exponent = g_bit_storage (value) - 1;
+
+	return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS +
+		((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/* Highest value falling in @index */
+static guint64
+bucket_upper_bound (guint index)
+{
+	guint exponent, sub;
+
+	if (index < SUB_BUCKETS)
+		return index;
+
+	exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+	sub = index % SUB_BUCKETS;
+
+	return ((guint64) (SUB_BUCKETS + sub + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+TmmHistogram *
+tmm_histogram_new (void)
+{
+	return g_new0 (TmmHistogram, 1);
+}
+
+void
+tmm_histogram_free (TmmHistogram *histogram)
+{
+	g_free (histogram);
+}
+
+void
+tmm_histogram_add (TmmHistogram *histogram,
+                   guint64       value)
+{
+	histogram->buckets[bucket_index (value)]++;
+	histogram->count++;
+}
+
+void
+tmm_histogram_reset (TmmHistogram *histogram)
+{
+	memset (histogram, 0, sizeof (TmmHistogram));
+}
+
+guint64
+tmm_histogram_get_count (TmmHistogram *histogram)
+{
+	return histogram->count;
+}
+
+/* @percentile is in the 0..1 range, returns 0 if nothing was added */
+guint64
+tmm_histogram_get_percentile (TmmHistogram *histogram,
+                              gdouble       percentile)
+{
+	guint64 rank, seen = 0;
+	guint i;
+
+	if (histogram->count == 0)
+		return 0;
+
+	rank = MAX (1, (guint64) (CLAMP (percentile, 0, 1) * histogram->count + 0.5));
+
+	for (i = 0; i < N_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+
+		if (seen >= rank)
+			return bucket_upper_bound (i);
+	}
+
+	return bucket_upper_bound (N_BUCKETS - 1);
+}
@@ -0,0 +1,665 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmm-guess.h"
+#include "tmm-import.h"
+
+/* Bulk import runs the decorator lookups over a fixed set of
+ * files rather than over the items the decorator hands out:
+ *
+ *  - Files are enumerated and their names guessed in threads, then
+ *    sorted by guessed title, so duplicate queries and sibling
+ *    episodes are requested close together and get coalesced, or
+ *    answered from the cache.
+ *  - URNs are resolved in batches, files unknown to the store or
+ *    processed already are skipped, so an import can be resumed.
+ *  - Updates are written in large batches instead of per item.
+ */
+#define RESOLVE_BATCH_SIZE 100
+#define WRITE_BATCH_SIZE 500
+#define PROGRESS_INTERVAL 5
+
+typedef struct _ImportData ImportData;
+typedef struct _ImportItem ImportItem;
+
+struct _ImportItem
+{
+	ImportData *import;
+	GFile *file;
+	gchar *uri;
+	gchar *urn;
+	TrackerSparqlBuilder *sparql;
+	TmmGuess guess;
+};
+
+struct _ImportData
+{
+	GTask *task;
+	TmmDecorator *decorator;
+	TrackerSparqlConnection *conn;
+	gchar **sources;
+
+	GPtrArray *items;
+	guint next_resolve;
+	GHashTable *resolving;
+	GQueue pending;
+
+	/* Updates and the URNs they are for, the URNs are
+	 * handed to tmm_decorator_file_committed() once written.
+	 */
+	GPtrArray *updates;
+	GPtrArray *update_urns;
+	GPtrArray *writing;
+	GPtrArray *writing_urns;
+
+	guint max_active_items;
+	guint n_active;
+	guint n_done;
+	guint n_skipped;
+	guint n_failed;
+
+	gint64 start_time;
+	guint progress_id;
+};
+
+static void import_process_more (ImportData *data);
+
+static ImportItem *
+import_item_new (ImportData *data,
+                 GFile      *file)
+{
+	ImportItem *item;
+
+	item = g_new0 (ImportItem, 1);
+	item->import = data;
+	item->file = g_object_ref (file);
+	item->uri = g_file_get_uri (file);
+
+	return item;
+}
+
+static void
+import_item_free (ImportItem *item)
+{
+	g_object_unref (item->file);
+	g_clear_object (&item->sparql);
+	g_free (item->uri);
+	g_free (item->urn);
+	g_free (item);
+}
+
+static void
+import_data_free (ImportData *data)
+{
+	if (data->progress_id)
+		g_source_remove (data->progress_id);
+
+	g_queue_clear (&data->pending);
+	g_clear_pointer (&data->resolving, g_hash_table_unref);
+	g_clear_pointer (&data->items, g_ptr_array_unref);
+	g_clear_pointer (&data->writing, g_ptr_array_unref);
+	g_clear_pointer (&data->writing_urns, g_ptr_array_unref);
+	g_ptr_array_unref (data->updates);
+	g_ptr_array_unref (data->update_urns);
+	g_strfreev (data->sources);
+	g_object_unref (data->decorator);
+	g_free (data);
+}
+
+static gboolean
+content_type_is_video (const gchar *content_type)
+{
+	return content_type && g_str_has_prefix (content_type, "video/");
+}
+
+static void
+scan_directory (ImportData   *data,
+                GFile        *dir,
+                GCancellable *cancellable)
+{
+	GFileEnumerator *enumerator;
+	GError *error = NULL;
+	GFileInfo *file_info;
+
+	enumerator = g_file_enumerate_children (dir,
+	                                        G_FILE_ATTRIBUTE_STANDARD_NAME ","
+	                                        G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+	                                        G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE,
+	                                        G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+	                                        cancellable, &error);
+	if (!enumerator) {
+		g_warning ("Could not enumerate directory: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	while ((file_info = g_file_enumerator_next_file (enumerator, cancellable, NULL))) {
+		const gchar *content_type;
+		GFile *child;
+
+		if (g_file_info_get_name (file_info)[0] == '.') {
+			g_object_unref (file_info);
+			continue;
+		}
+
+		child = g_file_enumerator_get_child (enumerator, file_info);
+		content_type = g_file_info_get_attribute_string (file_info,
+		                                                 G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+
+		if (g_file_info_get_file_type (file_info) == G_FILE_TYPE_DIRECTORY)
+			scan_directory (data, child, cancellable);
+		else if (content_type_is_video (content_type))
+			g_ptr_array_add (data->items, import_item_new (data, child));
+
+		g_object_unref (child);
+		g_object_unref (file_info);
+	}
+
+	g_object_unref (enumerator);
+}
+
+/* Lists have a path or URI per line */
+static gboolean
+scan_list (ImportData    *data,
+           GFile         *list,
+           GCancellable  *cancellable,
+           GError       **error)
+{
+	gchar *contents, **lines;
+	guint i;
+
+	if (!g_file_load_contents (list, cancellable, &contents, NULL, NULL, error))
+		return FALSE;
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	for (i = 0; lines[i]; i++) {
+		GFile *file;
+
+		g_strstrip (lines[i]);
+
+		if (lines[i][0] == '\0' || lines[i][0] == '#')
+			continue;
+
+		file = g_file_new_for_commandline_arg (lines[i]);
+		g_ptr_array_add (data->items, import_item_new (data, file));
+		g_object_unref (file);
+	}
+
+	g_strfreev (lines);
+
+	return TRUE;
+}
+
+static void
+guess_item (gpointer item_data,
+            gpointer user_data)
+{
+	ImportItem *item = item_data;
+	gchar *path;
+
+	/* As the decorator would, it takes the guess over */
+	path = g_file_get_path (item->file);
+
+	if (!path)
+		path = g_file_get_basename (item->file);
+
+	tmm_guess_parse (path, &item->guess);
+	g_free (path);
+}
+
+static gint
+import_item_compare (gconstpointer a,
+                     gconstpointer b)
+{
+	const ImportItem *item_a = *((ImportItem **) a);
+	const ImportItem *item_b = *((ImportItem **) b);
+	gint cmp;
+
+	cmp = g_ascii_strcasecmp (item_a->guess.title, item_b->guess.title);
+	if (cmp != 0)
+		return cmp;
+
+	if (item_a->guess.season != item_b->guess.season)
+		return item_a->guess.season - item_b->guess.season;
+
+	return item_a->guess.episode - item_b->guess.episode;
+}
+
+static void
+scan_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+	ImportData *data = task_data;
+	GThreadPool *pool;
+	GError *error = NULL;
+	guint i;
+
+	for (i = 0; data->sources[i]; i++) {
+		GFile *file;
+
+		file = g_file_new_for_commandline_arg (data->sources[i]);
+
+		if (g_file_query_file_type (file, 0, cancellable) == G_FILE_TYPE_DIRECTORY)
+			scan_directory (data, file, cancellable);
+		else
+			scan_list (data, file, cancellable, &error);
+
+		g_object_unref (file);
+
+		if (error) {
+			g_task_return_error (task, error);
+			return;
+		}
+	}
+
+	if (g_task_return_error_if_cancelled (task))
+		return;
+
+	pool = g_thread_pool_new (guess_item, NULL, g_get_num_processors (),
+	                          TRUE, NULL);
+
+	for (i = 0; i < data->items->len; i++)
+		g_thread_pool_push (pool, g_ptr_array_index (data->items, i), NULL);
+
+	/* Waits for all guesses to finish */
+	g_thread_pool_free (pool, FALSE, TRUE);
+
+	g_ptr_array_sort (data->items, import_item_compare);
+	g_task_return_boolean (task, TRUE);
+}
+
+static gboolean
+import_progress_cb (gpointer user_data)
+{
+	ImportData *data = user_data;
+	TmmDecoratorStats stats;
+	gdouble elapsed;
+
+	/* RSS is printed along so a long import shows whether memory
+	 * stays flat while files go through.
+	 */
+	tmm_decorator_get_stats (data->decorator, &stats);
+
+	elapsed = (gdouble) (g_get_monotonic_time () - data->start_time) / G_USEC_PER_SEC;
+	g_print ("Imported %u of %u files (%u skipped, %u failed), %.1f files/s, "
+	         "%u in flight, RSS %" G_GUINT64_FORMAT " KiB\n",
+	         data->n_done, data->items->len, data->n_skipped, data->n_failed,
+	         data->n_done / elapsed, stats.n_live_items, stats.rss);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+import_is_idle (ImportData *data)
+{
+	return data->n_active == 0 && !data->resolving && !data->writing &&
+		g_queue_is_empty (&data->pending);
+}
+
+static void
+import_print_stats (ImportData *data)
+{
+	TmmDecoratorStats stats;
+
+	tmm_decorator_get_stats (data->decorator, &stats);
+
+	g_print ("Looked up %" G_GUINT64_FORMAT " files, %.1f files/s, "
+	         "%.2f requests per file\n",
+	         stats.n_items, stats.items_per_second, stats.requests_per_item);
+	g_print ("Latency per file: p50 %.1fms, p95 %.1fms, p99 %.1fms\n",
+	         stats.latency_p50 / 1000.0, stats.latency_p95 / 1000.0,
+	         stats.latency_p99 / 1000.0);
+	g_print ("Peak RSS: %" G_GUINT64_FORMAT " KiB, %u files still held "
+	         "(%" G_GUINT64_FORMAT " bytes)\n",
+	         stats.peak_rss, stats.n_live_items, stats.live_bytes);
+}
+
+static void
+import_return (ImportData *data)
+{
+	GTask *task = data->task;
+
+	if (data->progress_id) {
+		g_source_remove (data->progress_id);
+		data->progress_id = 0;
+	}
+
+	import_progress_cb (data);
+	import_print_stats (data);
+
+	if (!g_task_return_error_if_cancelled (task))
+		g_task_return_boolean (task, TRUE);
+
+	g_object_unref (task);
+}
+
+static void
+import_write_cb (GObject      *object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+	ImportData *data = user_data;
+	GError *error = NULL;
+	GPtrArray *errors;
+	guint i;
+
+	errors = tracker_sparql_connection_update_array_finish (TRACKER_SPARQL_CONNECTION (object),
+	                                                        result, &error);
+	if (error) {
+		g_warning ("Could not write %u updates: %s",
+		           data->writing->len, error->message);
+		data->n_failed += data->writing->len;
+		data->n_done -= data->writing->len;
+
+		for (i = 0; i < data->writing_urns->len; i++)
+			tmm_decorator_file_committed (data->decorator,
+			                              g_ptr_array_index (data->writing_urns, i),
+			                              FALSE);
+		g_error_free (error);
+	} else {
+		for (i = 0; i < errors->len; i++) {
+			GError *item_error = g_ptr_array_index (errors, i);
+
+			tmm_decorator_file_committed (data->decorator,
+			                              g_ptr_array_index (data->writing_urns, i),
+			                              item_error == NULL);
+			if (!item_error)
+				continue;
+
+			g_debug ("Could not write update: %s", item_error->message);
+			data->n_failed++;
+			data->n_done--;
+		}
+
+		g_ptr_array_unref (errors);
+	}
+
+	g_clear_pointer (&data->writing, g_ptr_array_unref);
+	g_clear_pointer (&data->writing_urns, g_ptr_array_unref);
+	import_process_more (data);
+}
+
+static void
+import_write (ImportData *data)
+{
+	if (data->writing || data->updates->len == 0)
+		return;
+
+	data->writing = data->updates;
+	data->writing_urns = data->update_urns;
+	data->updates = g_ptr_array_new_with_free_func (g_free);
+	data->update_urns = g_ptr_array_new_with_free_func (g_free);
+
+	tracker_sparql_connection_update_array_async (data->conn,
+	                                              (gchar **) data->writing->pdata,
+	                                              data->writing->len,
+	                                              G_PRIORITY_LOW,
+	                                              NULL, import_write_cb, data);
+}
+
+static void
+import_process_cb (GObject      *object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+	ImportItem *item = user_data;
+	ImportData *data = item->import;
+	GError *error = NULL;
+
+	if (tmm_decorator_process_file_finish (TMM_DECORATOR (object), result, &error)) {
+		g_ptr_array_add (data->updates,
+		                 g_strdup (tracker_sparql_builder_get_result (item->sparql)));
+		g_ptr_array_add (data->update_urns, g_strdup (item->urn));
+		data->n_done++;
+	} else {
+		g_debug ("Could not import '%s': %s", item->uri, error->message);
+		g_error_free (error);
+		data->n_failed++;
+	}
+
+	/* Only the SPARQL was needed, leave the memory to other items */
+	g_clear_object (&item->sparql);
+
+	data->n_active--;
+	import_process_more (data);
+}
+
+static void
+import_resolve_next_cb (GObject      *object,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+	TrackerSparqlCursor *cursor = TRACKER_SPARQL_CURSOR (object);
+	ImportData *data = user_data;
+	GHashTableIter iter;
+	ImportItem *item;
+
+	if (tracker_sparql_cursor_next_finish (cursor, result, NULL)) {
+		item = g_hash_table_lookup (data->resolving,
+		                            tracker_sparql_cursor_get_string (cursor, 0, NULL));
+		if (item && !item->urn)
+			item->urn = g_strdup (tracker_sparql_cursor_get_string (cursor, 1, NULL));
+
+		tracker_sparql_cursor_next_async (cursor, NULL,
+		                                  import_resolve_next_cb, data);
+		return;
+	}
+
+	g_object_unref (cursor);
+
+	/* Items not returned are unknown to the store, or done already */
+	g_hash_table_iter_init (&iter, data->resolving);
+
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &item)) {
+		if (!item->urn)
+			data->n_skipped++;
+	}
+
+	g_clear_pointer (&data->resolving, g_hash_table_unref);
+	import_process_more (data);
+}
+
+static void
+import_resolve_cb (GObject      *object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+	TrackerSparqlCursor *cursor;
+	ImportData *data = user_data;
+	GError *error = NULL;
+
+	cursor = tracker_sparql_connection_query_finish (TRACKER_SPARQL_CONNECTION (object),
+	                                                 result, &error);
+	if (error) {
+		g_warning ("Could not resolve files in the store: %s", error->message);
+		data->n_skipped += g_hash_table_size (data->resolving);
+		g_clear_pointer (&data->resolving, g_hash_table_unref);
+		g_error_free (error);
+		import_process_more (data);
+		return;
+	}
+
+	tracker_sparql_cursor_next_async (cursor, NULL,
+	                                  import_resolve_next_cb, data);
+}
+
+/* Looks up the URNs for the next batch of items, only
+ * videos not processed already are returned.
+ */
+static void
+import_resolve (ImportData *data)
+{
+	GString *query;
+	guint i, end;
+
+	query = g_string_new ("SELECT ?url ?urn {"
+	                      "  ?urn a nfo:Video ;"
+	                      "       nie:url ?url ."
+	                      "  FILTER (?url IN (");
+
+	data->resolving = g_hash_table_new (g_str_hash, g_str_equal);
+	end = MIN (data->next_resolve + RESOLVE_BATCH_SIZE, data->items->len);
+
+	for (i = data->next_resolve; i < end; i++) {
+		ImportItem *item = g_ptr_array_index (data->items, i);
+		gchar *escaped;
+
+		escaped = tracker_sparql_escape_string (item->uri);
+		g_string_append_printf (query, "%s\"%s\"",
+		                        i == data->next_resolve ? "" : ", ",
+		                        escaped);
+		g_free (escaped);
+
+		g_hash_table_insert (data->resolving, item->uri, item);
+		g_queue_push_tail (&data->pending, item);
+	}
+
+	g_string_append (query,
+	                 "))"
+	                 "  FILTER NOT EXISTS { ?urn nie:dataSource <" TMM_DATA_SOURCE "> }"
+	                 "}");
+
+	data->next_resolve = end;
+	tracker_sparql_connection_query_async (data->conn, query->str,
+	                                       NULL, import_resolve_cb, data);
+	g_string_free (query, TRUE);
+}
+
+static void
+import_process_more (ImportData *data)
+{
+	GCancellable *cancellable;
+	ImportItem *item;
+
+	cancellable = g_task_get_cancellable (data->task);
+
+	/* Items queued before the batch they belong to is resolved
+	 * wait at the head of the queue, so the order is kept.
+	 */
+	while (!g_cancellable_is_cancelled (cancellable) &&
+	       data->n_active < data->max_active_items &&
+	       (item = g_queue_peek_head (&data->pending)) != NULL) {
+		if (data->resolving && g_hash_table_contains (data->resolving, item->uri))
+			break;
+
+		g_queue_pop_head (&data->pending);
+
+		if (!item->urn)
+			continue;
+
+		data->n_active++;
+		item->sparql = tracker_sparql_builder_new_update ();
+		tmm_decorator_process_file_async (data->decorator, item->file,
+		                                  item->urn, &item->guess,
+		                                  item->sparql,
+		                                  cancellable,
+		                                  import_process_cb, item);
+	}
+
+	if (g_cancellable_is_cancelled (cancellable))
+		g_queue_clear (&data->pending);
+
+	/* Resolve ahead while the window drains */
+	if (!data->resolving && !g_cancellable_is_cancelled (cancellable) &&
+	    data->next_resolve < data->items->len &&
+	    g_queue_get_length (&data->pending) < data->max_active_items)
+		import_resolve (data);
+
+	if (data->updates->len >= WRITE_BATCH_SIZE ||
+	    (data->updates->len > 0 && data->n_active == 0 && !data->resolving))
+		import_write (data);
+
+	if (import_is_idle (data) && data->updates->len == 0 &&
+	    (data->next_resolve == data->items->len ||
+	     g_cancellable_is_cancelled (cancellable)))
+		import_return (data);
+}
+
+static void
+import_scan_cb (GObject      *object,
+                GAsyncResult *result,
+                gpointer      user_data)
+{
+	ImportData *data = user_data;
+	GError *error = NULL;
+
+	if (!g_task_propagate_boolean (G_TASK (result), &error)) {
+		g_task_return_error (data->task, error);
+		g_object_unref (data->task);
+		return;
+	}
+
+	g_print ("Found %u files to import\n", data->items->len);
+
+	data->start_time = g_get_monotonic_time ();
+	data->progress_id = g_timeout_add_seconds (PROGRESS_INTERVAL,
+	                                           import_progress_cb, data);
+	import_process_more (data);
+}
+
+void
+tmm_import_async (TmmDecorator         *decorator,
+                  const gchar * const  *sources,
+                  GCancellable         *cancellable,
+                  GAsyncReadyCallback   callback,
+                  gpointer              user_data)
+{
+	ImportData *data;
+	GTask *scan_task;
+
+	g_return_if_fail (TMM_IS_DECORATOR (decorator));
+	g_return_if_fail (sources != NULL);
+
+	data = g_new0 (ImportData, 1);
+	data->decorator = g_object_ref (decorator);
+	data->conn = tracker_miner_get_connection (TRACKER_MINER (decorator));
+	data->sources = g_strdupv ((gchar **) sources);
+	data->items = g_ptr_array_new_with_free_func ((GDestroyNotify) import_item_free);
+	data->updates = g_ptr_array_new_with_free_func (g_free);
+	data->update_urns = g_ptr_array_new_with_free_func (g_free);
+	g_queue_init (&data->pending);
+
+	g_object_get (decorator, "max-active-items", &data->max_active_items, NULL);
+
+	/* Released once the import returns */
+	data->task = g_task_new (decorator, cancellable, callback, user_data);
+	g_task_set_task_data (data->task, data, (GDestroyNotify) import_data_free);
+
+	scan_task = g_task_new (NULL, cancellable, import_scan_cb, data);
+	g_task_set_task_data (scan_task, data, NULL);
+	g_task_run_in_thread (scan_task, scan_thread);
+	g_object_unref (scan_task);
+}
+
+gboolean
+tmm_import_finish (TmmDecorator  *decorator,
+                   GAsyncResult  *result,
+                   GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, decorator), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
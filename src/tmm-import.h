@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TMM_IMPORT_H__
+#define __TMM_IMPORT_H__
+
+#include <gio/gio.h>
+#include "tracker-miner-media.h"
+
+G_BEGIN_DECLS
+
+void     tmm_import_async  (TmmDecorator         *decorator,
+                            const gchar * const  *sources,
+                            GCancellable         *cancellable,
+                            GAsyncReadyCallback   callback,
+                            gpointer              user_data);
+gboolean tmm_import_finish (TmmDecorator         *decorator,
+                            GAsyncResult         *result,
+                            GError              **error);
+
+G_END_DECLS
+
+#endif /* __TMM_IMPORT_H__ */
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "tmm-metadata.h"
+
+/* Serialized form, see tmm_metadata_to_variant() */
+#define TMM_METADATA_VARIANT_TYPE "(ssxbiissxasasas)"
+
+TmmMetadata *
+tmm_metadata_new (void)
+{
+	TmmMetadata *metadata;
+
+	metadata = g_new0 (TmmMetadata, 1);
+	metadata->release_date = -1;
+	metadata->runtime = -1;
+	metadata->directors = g_ptr_array_new_with_free_func ((GDestroyNotify) g_free);
+	metadata->producers = g_ptr_array_new_with_free_func ((GDestroyNotify) g_free);
+	metadata->actors = g_ptr_array_new_with_free_func ((GDestroyNotify) g_free);
+
+	return metadata;
+}
+
+void
+tmm_metadata_free (TmmMetadata *metadata)
+{
+	g_free (metadata->id);
+	g_free (metadata->title);
+	g_free (metadata->synopsis);
+	g_free (metadata->rating);
+	g_free (metadata->genre);
+	g_ptr_array_unref (metadata->directors);
+	g_ptr_array_unref (metadata->producers);
+	g_ptr_array_unref (metadata->actors);
+	g_free (metadata);
+}
+
+static GVariant *
+artists_to_variant (GPtrArray *artists)
+{
+	return g_variant_new_strv ((const gchar * const *) artists->pdata,
+	                           artists->len);
+}
+
+static void
+artists_from_variant (GPtrArray *artists,
+                      GVariant  *variant)
+{
+	GVariantIter iter;
+	gchar *name;
+
+	g_variant_iter_init (&iter, variant);
+
+	while (g_variant_iter_next (&iter, "s", &name))
+		g_ptr_array_add (artists, name);
+}
+
+static gsize
+string_array_get_size (GPtrArray *array)
+{
+	gsize size;
+	guint i;
+
+	size = sizeof (GPtrArray) + array->len * sizeof (gpointer);
+
+	for (i = 0; i < array->len; i++)
+		size += strlen (g_ptr_array_index (array, i)) + 1;
+
+	return size;
+}
+
+/* Approximate heap usage, for memory accounting */
+gsize
+tmm_metadata_get_size (TmmMetadata *metadata)
+{
+	gsize size = sizeof (TmmMetadata);
+	gchar *strings[] = {
+		metadata->id, metadata->title, metadata->synopsis,
+		metadata->rating, metadata->genre
+	};
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (strings); i++) {
+		if (strings[i])
+			size += strlen (strings[i]) + 1;
+	}
+
+	size += string_array_get_size (metadata->directors);
+	size += string_array_get_size (metadata->producers);
+	size += string_array_get_size (metadata->actors);
+
+	return size;
+}
+
+/* Strings are stored as "" when unset, the variant
+ * format has no room for maybe types we'd need.
+ */
+GVariant *
+tmm_metadata_to_variant (TmmMetadata *metadata)
+{
+	return g_variant_new ("(ssxbiissx@as@as@as)",
+	                      metadata->title ? metadata->title : "",
+	                      metadata->synopsis ? metadata->synopsis : "",
+	                      metadata->release_date,
+	                      metadata->is_episode,
+	                      metadata->season,
+	                      metadata->episode,
+	                      metadata->rating ? metadata->rating : "",
+	                      metadata->genre ? metadata->genre : "",
+	                      metadata->runtime,
+	                      artists_to_variant (metadata->directors),
+	                      artists_to_variant (metadata->producers),
+	                      artists_to_variant (metadata->actors));
+}
+
+static gchar *
+variant_dup_nonempty_string (GVariant *variant,
+                             gsize     index)
+{
+	const gchar *str;
+	GVariant *child;
+	gchar *retval;
+
+	child = g_variant_get_child_value (variant, index);
+	str = g_variant_get_string (child, NULL);
+	retval = str[0] != '\0' ? g_strdup (str) : NULL;
+	g_variant_unref (child);
+
+	return retval;
+}
+
+gboolean
+tmm_metadata_variant_is_valid (GVariant *variant)
+{
+	return g_variant_is_of_type (variant, G_VARIANT_TYPE (TMM_METADATA_VARIANT_TYPE));
+}
+
+TmmMetadata *
+tmm_metadata_new_from_variant (GVariant *variant)
+{
+	GVariant *directors, *producers, *actors;
+	TmmMetadata *metadata;
+
+	if (!tmm_metadata_variant_is_valid (variant))
+		return NULL;
+
+	metadata = tmm_metadata_new ();
+	metadata->title = variant_dup_nonempty_string (variant, 0);
+	metadata->synopsis = variant_dup_nonempty_string (variant, 1);
+	metadata->rating = variant_dup_nonempty_string (variant, 6);
+	metadata->genre = variant_dup_nonempty_string (variant, 7);
+
+	g_variant_get (variant, "(&s&sxbii&s&sx@as@as@as)",
+	               NULL, NULL,
+	               &metadata->release_date,
+	               &metadata->is_episode,
+	               &metadata->season,
+	               &metadata->episode,
+	               NULL, NULL,
+	               &metadata->runtime,
+	               &directors, &producers, &actors);
+
+	artists_from_variant (metadata->directors, directors);
+	artists_from_variant (metadata->producers, producers);
+	artists_from_variant (metadata->actors, actors);
+
+	g_variant_unref (directors);
+	g_variant_unref (producers);
+	g_variant_unref (actors);
+
+	return metadata;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TMM_METADATA_H__
+#define __TMM_METADATA_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TmmMetadata TmmMetadata;
+
+struct _TmmMetadata
+{
+	/* Backend ID, not serialized */
+	gchar *id;
+
+	gchar *title;
+	gchar *synopsis;
+	gint64 release_date;
+
+	gboolean is_episode;
+	gint season;
+	gint episode;
+
+	/* Films only */
+	gchar *rating;
+	gchar *genre;
+	gint64 runtime;
+
+	/* Artist names */
+	GPtrArray *directors;
+	GPtrArray *producers;
+	GPtrArray *actors;
+};
+
+TmmMetadata * tmm_metadata_new              (void);
+void          tmm_metadata_free             (TmmMetadata *metadata);
+gsize         tmm_metadata_get_size         (TmmMetadata *metadata);
+
+GVariant *    tmm_metadata_to_variant       (TmmMetadata *metadata);
+TmmMetadata * tmm_metadata_new_from_variant (GVariant    *variant);
+gboolean      tmm_metadata_variant_is_valid (GVariant    *variant);
+
+G_END_DECLS
+
+#endif /* __TMM_METADATA_H__ */
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "tmm-request.h"
+
+/* Backend requests with a deadline, and a hedged duplicate sent
+ * if the first attempt is slow to answer. Whichever attempt
+ * answers first is handed to the callback, the other one is
+ * cancelled. Past the deadline the callback gets a
+ * G_IO_ERROR_TIMED_OUT error instead.
+ *
+ * Results are expected to be GTasks, as the backends return.
+ */
+
+#define MAX_ATTEMPTS 2
+
+typedef struct _TmmRequest TmmRequest;
+
+struct _TmmRequest
+{
+	GObject *source_object;
+	TmmRequestSendFunc send_func;
+	GAsyncReadyCallback callback;
+	gpointer user_data;
+
+	/* Pausing the miner cancels every attempt */
+	GCancellable *cancellable;
+	gulong cancelled_id;
+
+	GCancellable *attempts[MAX_ATTEMPTS];
+	guint n_attempts;
+	guint n_pending;
+
+	guint timeout;
+	guint timeout_id;
+	guint hedge_id;
+	gboolean done;
+};
+
+static void
+tmm_request_free (TmmRequest *request)
+{
+	guint i;
+
+	for (i = 0; i < request->n_attempts; i++)
+		g_object_unref (request->attempts[i]);
+
+	g_clear_object (&request->cancellable);
+	g_object_unref (request->source_object);
+	g_free (request);
+}
+
+static void
+tmm_request_cancel_attempts (TmmRequest *request)
+{
+	guint i;
+
+	for (i = 0; i < request->n_attempts; i++)
+		g_cancellable_cancel (request->attempts[i]);
+}
+
+static void
+tmm_request_cancelled_cb (GCancellable *cancellable,
+                          TmmRequest   *request)
+{
+	tmm_request_cancel_attempts (request);
+}
+
+/* No more answers are wanted */
+static void
+tmm_request_done (TmmRequest *request)
+{
+	request->done = TRUE;
+
+	if (request->timeout_id) {
+		g_source_remove (request->timeout_id);
+		request->timeout_id = 0;
+	}
+
+	if (request->hedge_id) {
+		g_source_remove (request->hedge_id);
+		request->hedge_id = 0;
+	}
+
+	if (request->cancelled_id) {
+		g_cancellable_disconnect (request->cancellable, request->cancelled_id);
+		request->cancelled_id = 0;
+	}
+
+	tmm_request_cancel_attempts (request);
+}
+
+static void
+tmm_request_attempt_cb (GObject      *object,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+	TmmRequest *request = user_data;
+
+	g_assert (request->n_pending > 0);
+	request->n_pending--;
+
+	/* A failed attempt isn't final while another one may succeed */
+	if (!request->done &&
+	    (request->n_pending == 0 ||
+	     !G_IS_TASK (result) || !g_task_had_error (G_TASK (result)))) {
+		tmm_request_done (request);
+		request->callback (object, result, request->user_data);
+	}
+
+	if (request->done && request->n_pending == 0)
+		tmm_request_free (request);
+}
+
+static void
+tmm_request_send_attempt (TmmRequest *request)
+{
+	GCancellable *cancellable;
+	guint attempt;
+
+	attempt = request->n_attempts;
+	cancellable = g_cancellable_new ();
+	request->attempts[attempt] = cancellable;
+	request->n_attempts++;
+	request->n_pending++;
+
+	if (request->cancellable && g_cancellable_is_cancelled (request->cancellable))
+		g_cancellable_cancel (cancellable);
+
+	request->send_func (cancellable, attempt,
+	                    tmm_request_attempt_cb, request,
+	                    request->user_data);
+}
+
+static gboolean
+tmm_request_hedge_cb (gpointer user_data)
+{
+	TmmRequest *request = user_data;
+
+	request->hedge_id = 0;
+
+	if (request->n_attempts < MAX_ATTEMPTS)
+		tmm_request_send_attempt (request);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+tmm_request_timeout_cb (gpointer user_data)
+{
+	TmmRequest *request = user_data;
+	GTask *task;
+
+	request->timeout_id = 0;
+	tmm_request_done (request);
+
+	task = g_task_new (request->source_object, NULL,
+	                   request->callback, request->user_data);
+	g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+	                         "No reply after %u seconds", request->timeout);
+	g_object_unref (task);
+
+	/* Attempts still finish, the request is freed after them */
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * tmm_request_send:
+ * @source_object: object the results come from
+ * @send_func: starts an attempt at the request
+ * @cancellable: (allow-none): cancels every attempt
+ * @timeout: seconds before giving up, or 0 for no deadline
+ * @hedge_delay: milliseconds before sending a duplicate, or 0 for none
+ * @callback: called with the first answer
+ * @user_data: data for @send_func and @callback
+ *
+ * Sends a request through @send_func, and calls @callback once,
+ * with the first attempt to succeed or the last to fail.
+ **/
+void
+tmm_request_send (GObject             *source_object,
+                  TmmRequestSendFunc   send_func,
+                  GCancellable        *cancellable,
+                  guint                timeout,
+                  guint                hedge_delay,
+                  GAsyncReadyCallback  callback,
+                  gpointer             user_data)
+{
+	TmmRequest *request;
+
+	g_return_if_fail (G_IS_OBJECT (source_object));
+	g_return_if_fail (send_func != NULL);
+	g_return_if_fail (callback != NULL);
+
+	/* Queued before the miner was paused or stopped, nothing is sent */
+	if (cancellable && g_cancellable_is_cancelled (cancellable)) {
+		GTask *task;
+
+		task = g_task_new (source_object, NULL, callback, user_data);
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+		                         "Request cancelled before being sent");
+		g_object_unref (task);
+		return;
+	}
+
+	request = g_new0 (TmmRequest, 1);
+	request->source_object = g_object_ref (source_object);
+	request->send_func = send_func;
+	request->callback = callback;
+	request->user_data = user_data;
+	request->timeout = timeout;
+
+	if (cancellable) {
+		request->cancellable = g_object_ref (cancellable);
+		request->cancelled_id =
+			g_cancellable_connect (cancellable,
+			                       G_CALLBACK (tmm_request_cancelled_cb),
+			                       request, NULL);
+	}
+
+	if (timeout > 0)
+		request->timeout_id = g_timeout_add_seconds (timeout, tmm_request_timeout_cb, request);
+	if (hedge_delay > 0)
+		request->hedge_id = g_timeout_add (hedge_delay, tmm_request_hedge_cb, request);
+
+	tmm_request_send_attempt (request);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TMM_REQUEST_H__
+#define __TMM_REQUEST_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Starts one attempt at the request, @attempt is 0 for the first
+ * and counts hedged duplicates after that.
+ */
+typedef void (* TmmRequestSendFunc) (GCancellable        *cancellable,
+                                     guint                attempt,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             callback_data,
+                                     gpointer             user_data);
+
+void tmm_request_send (GObject             *source_object,
+                       TmmRequestSendFunc   send_func,
+                       GCancellable        *cancellable,
+                       guint                timeout,
+                       guint                hedge_delay,
+                       GAsyncReadyCallback  callback,
+                       gpointer             user_data);
+
+G_END_DECLS
+
+#endif /* __TMM_REQUEST_H__ */
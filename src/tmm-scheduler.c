@@ -0,0 +1,457 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "tmm-scheduler.h"
+
+/* Enriched items are refreshed once their data might have gone stale.
+ * The refresh interval depends on how sure the match was, and on how
+ * old the release is: metadata for new releases keeps changing for a
+ * while, for old ones it rarely does.
+ *
+ * Refreshing an item is just removing our nie:dataSource from it, so
+ * the decorator queues it again. Refreshes are paced by a daily budget
+ * of backend requests, the most overdue items go first.
+ *
+ * The miner exits when idle, so everything lives in the cache: the
+ * schedule entries carry the refresh mark until the item is enriched
+ * again, and the budget is kept under STATE_KEY, so it accrues while
+ * the miner isn't running.
+ *
+ * Entries also keep the ID the item was matched to. A low confidence
+ * item refreshed into the same ID would only find it again, so it is
+ * scheduled as a confident one from then on.
+ */
+#define DAY (24 * 60 * 60)
+
+#define TICK_INTERVAL (60 * 60)
+#define REQUESTS_PER_REFRESH 2
+
+#define LOW_CONFIDENCE 0.5
+#define LOW_CONFIDENCE_INTERVAL (14 * DAY)
+#define RECENT_RELEASE_AGE (365 * DAY)
+#define RECENT_RELEASE_INTERVAL (7 * DAY)
+#define SETTLED_RELEASE_AGE (5 * 365 * DAY)
+#define SETTLED_RELEASE_INTERVAL (365 * DAY)
+#define DEFAULT_INTERVAL (90 * DAY)
+
+/* Entries outlive the longest interval, with room to spare */
+#define SCHEDULE_TTL (4 * SETTLED_RELEASE_INTERVAL)
+
+/* Not a URN, so it can't clash with the schedule entries */
+#define STATE_KEY "tmm:scheduler-state"
+
+typedef struct _DueItem DueItem;
+
+struct _TmmScheduler
+{
+	TmmCache *cache;
+	TrackerSparqlConnection *connection;
+	gchar *data_source;
+
+	guint requests_per_day;
+	gdouble budget;
+	gint64 last_tick;
+	guint tick_id;
+};
+
+struct _DueItem
+{
+	gchar *urn;
+	gchar *id;
+	gint64 due;
+	gdouble confidence;
+	gint64 release_date;
+};
+
+static gint64
+current_time (void)
+{
+	return g_get_real_time () / G_USEC_PER_SEC;
+}
+
+static gint64
+refresh_interval (gdouble confidence,
+                  gint64  release_date,
+                  gint64  now)
+{
+	gint64 interval, age;
+
+	if (release_date <= 0) {
+		interval = DEFAULT_INTERVAL;
+	} else {
+		age = now - release_date;
+
+		if (age < RECENT_RELEASE_AGE)
+			interval = RECENT_RELEASE_INTERVAL;
+		else if (age < SETTLED_RELEASE_AGE)
+			interval = DEFAULT_INTERVAL;
+		else
+			interval = SETTLED_RELEASE_INTERVAL;
+	}
+
+	/* Might have matched the wrong title, look again soon */
+	if (confidence < LOW_CONFIDENCE)
+		interval = MIN (interval, LOW_CONFIDENCE_INTERVAL);
+
+	return interval;
+}
+
+TmmScheduler *
+tmm_scheduler_new (TmmCache    *cache,
+                   const gchar *data_source)
+{
+	TmmScheduler *scheduler;
+
+	scheduler = g_new0 (TmmScheduler, 1);
+	scheduler->cache = cache;
+	scheduler->data_source = g_strdup (data_source);
+
+	return scheduler;
+}
+
+void
+tmm_scheduler_free (TmmScheduler *scheduler)
+{
+	if (scheduler->tick_id)
+		g_source_remove (scheduler->tick_id);
+
+	g_clear_object (&scheduler->connection);
+	g_free (scheduler->data_source);
+	g_free (scheduler);
+}
+
+/* @id may be NULL if unknown */
+static void
+schedule_entry_insert (TmmScheduler *scheduler,
+                       const gchar  *urn,
+                       gint64        enriched_time,
+                       gdouble       confidence,
+                       gint64        release_date,
+                       gboolean      refreshing,
+                       const gchar  *id)
+{
+	tmm_cache_insert (scheduler->cache, TMM_CACHE_SCHEDULE, urn,
+	                  g_variant_new ("(xdxbs)", enriched_time,
+	                                 confidence, release_date, refreshing,
+	                                 id ? id : ""),
+	                  SCHEDULE_TTL);
+}
+
+/* Entries written before the refresh mark was added are "(xdx)",
+ * and "(xdxb)" before the ID was. @id may be NULL, if wanted it
+ * is set to NULL for entries with no ID.
+ */
+static gboolean
+schedule_entry_parse (GVariant  *value,
+                      gint64    *enriched_time,
+                      gdouble   *confidence,
+                      gint64    *release_date,
+                      gboolean  *refreshing,
+                      gchar    **id)
+{
+	gchar *entry_id = NULL;
+
+	*refreshing = FALSE;
+
+	if (g_variant_is_of_type (value, G_VARIANT_TYPE ("(xdxbs)")))
+		g_variant_get (value, "(xdxbs)", enriched_time,
+		               confidence, release_date, refreshing, &entry_id);
+	else if (g_variant_is_of_type (value, G_VARIANT_TYPE ("(xdxb)")))
+		g_variant_get (value, "(xdxb)", enriched_time,
+		               confidence, release_date, refreshing);
+	else if (g_variant_is_of_type (value, G_VARIANT_TYPE ("(xdx)")))
+		g_variant_get (value, "(xdx)", enriched_time,
+		               confidence, release_date);
+	else
+		return FALSE;
+
+	if (entry_id && !*entry_id)
+		g_clear_pointer (&entry_id, g_free);
+
+	if (id)
+		*id = entry_id;
+	else
+		g_free (entry_id);
+
+	return TRUE;
+}
+
+static void
+scheduler_save_state (TmmScheduler *scheduler)
+{
+	tmm_cache_insert (scheduler->cache, TMM_CACHE_SCHEDULE, STATE_KEY,
+	                  g_variant_new ("(dx)", scheduler->budget,
+	                                 scheduler->last_tick),
+	                  SCHEDULE_TTL);
+}
+
+/* Returns FALSE if there is no state saved */
+static gboolean
+scheduler_load_state (TmmScheduler *scheduler)
+{
+	GVariant *state;
+	gboolean loaded = FALSE;
+
+	state = tmm_cache_lookup (scheduler->cache, TMM_CACHE_SCHEDULE, STATE_KEY);
+
+	if (!state)
+		return FALSE;
+
+	if (g_variant_is_of_type (state, G_VARIANT_TYPE ("(dx)"))) {
+		g_variant_get (state, "(dx)", &scheduler->budget,
+		               &scheduler->last_tick);
+		loaded = TRUE;
+	}
+
+	g_variant_unref (state);
+
+	return loaded;
+}
+
+/* @id is what @urn was matched to, or NULL if unknown */
+void
+tmm_scheduler_record (TmmScheduler *scheduler,
+                      const gchar  *urn,
+                      const gchar  *id,
+                      gdouble       confidence,
+                      gint64        release_date)
+{
+	gint64 old_enriched_time, old_release_date;
+	gboolean refreshing = FALSE;
+	gdouble old_confidence;
+	gchar *old_id = NULL;
+	GVariant *value;
+
+	g_return_if_fail (urn != NULL);
+
+	value = tmm_cache_lookup (scheduler->cache, TMM_CACHE_SCHEDULE, urn);
+
+	if (value) {
+		if (!schedule_entry_parse (value, &old_enriched_time, &old_confidence,
+		                           &old_release_date, &refreshing, &old_id))
+			refreshing = FALSE;
+
+		g_variant_unref (value);
+	}
+
+	/* Looking again found the same match, it's as good as it gets */
+	if (refreshing && confidence < LOW_CONFIDENCE &&
+	    id && g_strcmp0 (id, old_id) == 0) {
+		g_debug ("Refresh of '%s' matched '%s' again, not looking "
+		         "again any sooner than usual", urn, id);
+		confidence = LOW_CONFIDENCE;
+	}
+
+	schedule_entry_insert (scheduler, urn, current_time (),
+	                       confidence, release_date, FALSE, id);
+	g_free (old_id);
+}
+
+/* Returns TRUE if @urn was queued again by the scheduler, its
+ * lookup is then expected to skip the caches. The mark stays
+ * until tmm_scheduler_record() is called for @urn, so it
+ * survives the lookup being cancelled, or the miner exiting.
+ */
+gboolean
+tmm_scheduler_is_refreshing (TmmScheduler *scheduler,
+                             const gchar  *urn)
+{
+	gint64 enriched_time, release_date;
+	gboolean refreshing = FALSE;
+	gdouble confidence;
+	GVariant *value;
+
+	g_return_val_if_fail (urn != NULL, FALSE);
+
+	value = tmm_cache_lookup (scheduler->cache, TMM_CACHE_SCHEDULE, urn);
+
+	if (!value)
+		return FALSE;
+
+	if (!schedule_entry_parse (value, &enriched_time, &confidence,
+	                           &release_date, &refreshing, NULL))
+		refreshing = FALSE;
+
+	g_variant_unref (value);
+
+	return refreshing;
+}
+
+static void
+collect_due_item (const gchar *key,
+                  GVariant    *value,
+                  gpointer     user_data)
+{
+	GArray *due_items = user_data;
+	gint64 enriched_time, now;
+	gboolean refreshing;
+	DueItem item;
+
+	if (!schedule_entry_parse (value, &enriched_time, &item.confidence,
+	                           &item.release_date, &refreshing, &item.id))
+		return;
+
+	now = current_time ();
+	item.due = enriched_time + refresh_interval (item.confidence,
+	                                             item.release_date, now);
+	if (item.due > now) {
+		g_free (item.id);
+		return;
+	}
+
+	item.urn = g_strdup (key);
+	g_array_append_val (due_items, item);
+}
+
+static gint
+due_item_compare (gconstpointer a,
+                  gconstpointer b)
+{
+	const DueItem *item_a = a, *item_b = b;
+
+	return (item_a->due > item_b->due) - (item_a->due < item_b->due);
+}
+
+static void
+refresh_update_cb (GObject      *object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+	GError *error = NULL;
+
+	tracker_sparql_connection_update_finish (TRACKER_SPARQL_CONNECTION (object),
+	                                         result, &error);
+	if (error) {
+		g_warning ("Could not queue items for refresh: %s", error->message);
+		g_error_free (error);
+	}
+}
+
+static gboolean
+scheduler_tick (gpointer user_data)
+{
+	TmmScheduler *scheduler = user_data;
+	GArray *due_items;
+	GString *update;
+	guint i, n_refresh;
+	gint64 now;
+
+	now = current_time ();
+
+	/* At most a day worth of budget is saved up */
+	scheduler->budget += (gdouble) scheduler->requests_per_day *
+		(now - scheduler->last_tick) / DAY;
+	scheduler->budget = MIN (scheduler->budget, scheduler->requests_per_day);
+	scheduler->last_tick = now;
+
+	n_refresh = scheduler->budget / REQUESTS_PER_REFRESH;
+
+	if (n_refresh == 0) {
+		scheduler_save_state (scheduler);
+		return G_SOURCE_CONTINUE;
+	}
+
+	due_items = g_array_new (FALSE, FALSE, sizeof (DueItem));
+	tmm_cache_foreach (scheduler->cache, TMM_CACHE_SCHEDULE,
+	                   collect_due_item, due_items);
+	g_array_sort (due_items, due_item_compare);
+
+	n_refresh = MIN (n_refresh, due_items->len);
+	update = g_string_new (NULL);
+
+	for (i = 0; i < due_items->len; i++) {
+		DueItem *item = &g_array_index (due_items, DueItem, i);
+
+		if (i < n_refresh) {
+			g_string_append_printf (update,
+			                        "DELETE { <%s> nie:dataSource <%s> } ",
+			                        item->urn, scheduler->data_source);
+
+			/* Not due again until refreshed, or the interval passes */
+			schedule_entry_insert (scheduler, item->urn, now,
+			                       item->confidence, item->release_date,
+			                       TRUE, item->id);
+		}
+
+		g_free (item->urn);
+		g_free (item->id);
+	}
+
+	if (n_refresh > 0) {
+		g_debug ("Refreshing %u of %u stale items", n_refresh, due_items->len);
+		scheduler->budget -= n_refresh * REQUESTS_PER_REFRESH;
+		tracker_sparql_connection_update_async (scheduler->connection,
+		                                        update->str, G_PRIORITY_LOW,
+		                                        NULL, refresh_update_cb, NULL);
+	}
+
+	scheduler_save_state (scheduler);
+	g_string_free (update, TRUE);
+	g_array_free (due_items, TRUE);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+tmm_scheduler_update_tick (TmmScheduler *scheduler)
+{
+	gboolean enabled;
+
+	enabled = scheduler->connection && scheduler->requests_per_day > 0;
+
+	if (enabled && !scheduler->tick_id) {
+		/* Catches up with the time the miner wasn't running */
+		if (!scheduler_load_state (scheduler)) {
+			scheduler->budget = 0;
+			scheduler->last_tick = current_time ();
+		}
+
+		scheduler->tick_id = g_timeout_add_seconds (TICK_INTERVAL,
+		                                            scheduler_tick, scheduler);
+		scheduler_tick (scheduler);
+	} else if (!enabled && scheduler->tick_id) {
+		g_source_remove (scheduler->tick_id);
+		scheduler->tick_id = 0;
+
+		/* Nothing accrues while disabled */
+		scheduler->budget = 0;
+		scheduler->last_tick = current_time ();
+		scheduler_save_state (scheduler);
+	}
+}
+
+void
+tmm_scheduler_start (TmmScheduler            *scheduler,
+                     TrackerSparqlConnection *connection)
+{
+	g_return_if_fail (connection != NULL);
+
+	g_clear_object (&scheduler->connection);
+	scheduler->connection = g_object_ref (connection);
+	tmm_scheduler_update_tick (scheduler);
+}
+
+/* 0 disables refreshing */
+void
+tmm_scheduler_set_budget (TmmScheduler *scheduler,
+                          guint         requests_per_day)
+{
+	scheduler->requests_per_day = requests_per_day;
+	tmm_scheduler_update_tick (scheduler);
+}
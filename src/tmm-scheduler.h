@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TMM_SCHEDULER_H__
+#define __TMM_SCHEDULER_H__
+
+#include <libtracker-sparql/tracker-sparql.h>
+
+#include "tmm-cache.h"
+
+G_BEGIN_DECLS
+
+typedef struct _TmmScheduler TmmScheduler;
+
+TmmScheduler * tmm_scheduler_new           (TmmCache                *cache,
+                                            const gchar             *data_source);
+void           tmm_scheduler_free          (TmmScheduler            *scheduler);
+
+void           tmm_scheduler_start         (TmmScheduler            *scheduler,
+                                            TrackerSparqlConnection *connection);
+void           tmm_scheduler_set_budget    (TmmScheduler            *scheduler,
+                                            guint                    requests_per_day);
+
+void           tmm_scheduler_record        (TmmScheduler            *scheduler,
+                                            const gchar             *urn,
+                                            const gchar             *id,
+                                            gdouble                  confidence,
+                                            gint64                   release_date);
+gboolean       tmm_scheduler_is_refreshing (TmmScheduler            *scheduler,
+                                            const gchar             *urn);
+
+G_END_DECLS
+
+#endif /* __TMM_SCHEDULER_H__ */
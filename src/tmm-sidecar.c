@@ -0,0 +1,700 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "tmm-guess.h"
+#include "tmm-sidecar.h"
+
+/* Everything here is read with a single bounded read per file: .nfo
+ * files are small, and container tags are only looked for in the
+ * header, tags stored after the media data are not found.
+ */
+#define NFO_MAX_SIZE (64 * 1024)
+#define HEADER_SIZE (256 * 1024)
+
+#define MKV_ID_EBML 0x1A45DFA3
+#define MKV_ID_SEGMENT 0x18538067
+#define MKV_ID_INFO 0x1549A966
+#define MKV_ID_TITLE 0x7BA9
+#define MKV_ID_CLUSTER 0x1F43B675
+
+#define MP4_ATOM(a,b,c,d) (((guint32) (a) << 24) | ((b) << 16) | ((c) << 8) | (d))
+
+typedef struct _NfoParser NfoParser;
+
+struct _NfoParser
+{
+	TmmSidecar *sidecar;
+	TmmMetadata *metadata;
+	GString *text;
+	gchar *uniqueid_type;
+	gboolean in_actor;
+	gboolean is_episode;
+	gboolean has_root;
+};
+
+/* Reads up to @max_size bytes, files larger than that are read
+ * partially if @allow_partial, or skipped.
+ */
+static gchar *
+read_bounded (const gchar *path,
+              gsize        max_size,
+              gboolean     allow_partial,
+              gsize       *length)
+{
+	gssize n_read;
+	gsize total = 0;
+	gchar *buffer;
+	gint fd;
+
+	fd = g_open (path, O_RDONLY | O_CLOEXEC, 0);
+
+	if (fd < 0)
+		return NULL;
+
+	/* One more byte, to tell if the file is larger */
+	buffer = g_malloc (max_size + 1);
+
+	while (total <= max_size) {
+		n_read = read (fd, buffer + total, max_size + 1 - total);
+
+		if (n_read < 0 && errno == EINTR)
+			continue;
+		if (n_read <= 0)
+			break;
+
+		total += n_read;
+	}
+
+	close (fd);
+
+	if (total > max_size) {
+		if (!allow_partial) {
+			g_free (buffer);
+			return NULL;
+		}
+
+		total = max_size;
+	}
+
+	buffer[total] = '\0';
+	*length = total;
+
+	return buffer;
+}
+
+/* Finds an IMDb title ID ("tt" and 7 or more digits) in @str */
+static gchar *
+find_imdb_id (const gchar *str)
+{
+	const gchar *p;
+	gsize n_digits;
+
+	for (p = str; (p = strstr (p, "tt")) != NULL; p += 2) {
+		if (p > str && g_ascii_isalnum (p[-1]))
+			continue;
+
+		for (n_digits = 0; g_ascii_isdigit (p[2 + n_digits]); n_digits++)
+			;
+
+		if (n_digits >= 7 && !g_ascii_isalnum (p[2 + n_digits]))
+			return g_strndup (p, 2 + n_digits);
+	}
+
+	return NULL;
+}
+
+static gint64
+date_to_time (gint year,
+              gint month,
+              gint day)
+{
+	GDateTime *date_time;
+	gint64 time;
+
+	date_time = g_date_time_new_utc (year, MAX (month, 1), MAX (day, 1), 0, 0, 0);
+
+	if (!date_time)
+		return -1;
+
+	time = g_date_time_to_unix (date_time);
+	g_date_time_unref (date_time);
+
+	return time;
+}
+
+static void
+nfo_start_element (GMarkupParseContext  *context,
+                   const gchar          *element_name,
+                   const gchar         **attribute_names,
+                   const gchar         **attribute_values,
+                   gpointer              user_data,
+                   GError              **error)
+{
+	NfoParser *parser = user_data;
+	guint i;
+
+	if (!parser->has_root) {
+		parser->has_root = TRUE;
+		parser->is_episode = g_strcmp0 (element_name, "episodedetails") == 0;
+	} else if (g_strcmp0 (element_name, "actor") == 0) {
+		parser->in_actor = TRUE;
+	} else if (g_strcmp0 (element_name, "uniqueid") == 0) {
+		for (i = 0; attribute_names[i]; i++) {
+			if (g_strcmp0 (attribute_names[i], "type") == 0)
+				parser->uniqueid_type = g_strdup (attribute_values[i]);
+		}
+	}
+
+	g_string_truncate (parser->text, 0);
+}
+
+static void
+nfo_end_element (GMarkupParseContext  *context,
+                 const gchar          *element_name,
+                 gpointer              user_data,
+                 GError              **error)
+{
+	NfoParser *parser = user_data;
+	TmmMetadata *metadata = parser->metadata;
+	TmmSidecar *sidecar = parser->sidecar;
+	gint year, month, day;
+	gchar *text;
+
+	text = g_strstrip (parser->text->str);
+
+	if (g_markup_parse_context_get_element_stack (context)->next == NULL) {
+		/* Root element */
+	} else if (parser->in_actor) {
+		if (g_strcmp0 (element_name, "name") == 0 && *text)
+			g_ptr_array_add (metadata->actors, g_strdup (text));
+		else if (g_strcmp0 (element_name, "actor") == 0)
+			parser->in_actor = FALSE;
+	} else if (*text == '\0') {
+		/* Nothing to take from empty elements */
+	} else if (g_strcmp0 (element_name, "title") == 0) {
+		g_free (metadata->title);
+		metadata->title = g_strdup (text);
+	} else if (g_strcmp0 (element_name, "showtitle") == 0) {
+		g_free (sidecar->title);
+		sidecar->title = g_strdup (text);
+	} else if (g_strcmp0 (element_name, "year") == 0) {
+		sidecar->year = atoi (text);
+	} else if (g_strcmp0 (element_name, "premiered") == 0 ||
+	           g_strcmp0 (element_name, "aired") == 0) {
+		if (sscanf (text, "%d-%d-%d", &year, &month, &day) == 3) {
+			metadata->release_date = date_to_time (year, month, day);
+			if (sidecar->year == 0)
+				sidecar->year = year;
+		}
+	} else if (g_strcmp0 (element_name, "season") == 0) {
+		sidecar->season = atoi (text);
+	} else if (g_strcmp0 (element_name, "episode") == 0) {
+		sidecar->episode = atoi (text);
+	} else if (g_strcmp0 (element_name, "plot") == 0 ||
+	           (g_strcmp0 (element_name, "outline") == 0 && !metadata->synopsis)) {
+		g_free (metadata->synopsis);
+		metadata->synopsis = g_strdup (text);
+	} else if (g_strcmp0 (element_name, "runtime") == 0) {
+		metadata->runtime = atoi (text);
+	} else if (g_strcmp0 (element_name, "mpaa") == 0) {
+		g_free (metadata->rating);
+		metadata->rating = g_strdup (text);
+	} else if (g_strcmp0 (element_name, "genre") == 0) {
+		if (!metadata->genre)
+			metadata->genre = g_strdup (text);
+	} else if (g_strcmp0 (element_name, "director") == 0) {
+		g_ptr_array_add (metadata->directors, g_strdup (text));
+	} else if (g_strcmp0 (element_name, "uniqueid") == 0 ||
+	           g_strcmp0 (element_name, "imdbid") == 0 ||
+	           g_strcmp0 (element_name, "id") == 0) {
+		if (!sidecar->imdb_id &&
+		    (!parser->uniqueid_type || g_strcmp0 (parser->uniqueid_type, "imdb") == 0))
+			sidecar->imdb_id = find_imdb_id (text);
+	}
+
+	g_clear_pointer (&parser->uniqueid_type, g_free);
+	g_string_truncate (parser->text, 0);
+}
+
+static void
+nfo_text (GMarkupParseContext  *context,
+          const gchar          *text,
+          gsize                 text_len,
+          gpointer              user_data,
+          GError              **error)
+{
+	NfoParser *parser = user_data;
+
+	g_string_append_len (parser->text, text, text_len);
+}
+
+static const GMarkupParser nfo_parser = {
+	nfo_start_element,
+	nfo_end_element,
+	nfo_text,
+	NULL,
+	NULL
+};
+
+/* Kodi style .nfo files, either XML or just an IMDb URL */
+static gboolean
+read_nfo (TmmSidecar  *sidecar,
+          const gchar *nfo_path)
+{
+	GMarkupParseContext *context;
+	NfoParser parser = { 0 };
+	gchar *contents;
+	gboolean parsed;
+	gsize length;
+
+	contents = read_bounded (nfo_path, NFO_MAX_SIZE, FALSE, &length);
+
+	if (!contents)
+		return FALSE;
+
+	parser.sidecar = sidecar;
+	parser.metadata = tmm_metadata_new ();
+	parser.text = g_string_new (NULL);
+
+	context = g_markup_parse_context_new (&nfo_parser, 0, &parser, NULL);
+	parsed = (g_markup_parse_context_parse (context, contents, length, NULL) &&
+	          g_markup_parse_context_end_parse (context, NULL));
+	g_markup_parse_context_free (context);
+
+	if (!sidecar->imdb_id)
+		sidecar->imdb_id = find_imdb_id (contents);
+
+	if (parsed && parser.metadata->title) {
+		parser.metadata->is_episode = parser.is_episode;
+		parser.metadata->season = sidecar->season;
+		parser.metadata->episode = sidecar->episode;
+
+		if (!parser.is_episode) {
+			g_free (sidecar->title);
+			sidecar->title = g_strdup (parser.metadata->title);
+			sidecar->season = sidecar->episode = 0;
+		}
+
+		if (parser.metadata->release_date < 0 && sidecar->year > 0)
+			parser.metadata->release_date = date_to_time (sidecar->year, 1, 1);
+
+		/* Enough to do without a lookup */
+		if (parser.metadata->synopsis &&
+		    (!parser.is_episode ||
+		     (sidecar->title && sidecar->season > 0 && sidecar->episode > 0))) {
+			sidecar->metadata = parser.metadata;
+			parser.metadata = NULL;
+		}
+	}
+
+	g_clear_pointer (&parser.metadata, tmm_metadata_free);
+	g_clear_pointer (&parser.uniqueid_type, g_free);
+	g_string_free (parser.text, TRUE);
+	g_free (contents);
+
+	return TRUE;
+}
+
+/* Titles in tags are often just the release name, so they are
+ * parsed as a filename would be.
+ */
+static void
+sidecar_set_tag_title (TmmSidecar  *sidecar,
+                       const gchar *tag_title)
+{
+	TmmGuess guess;
+	gchar *name;
+
+	/* Made to look like a file name, dots in the title are
+	 * not mistaken for an extension, nor slashes for directories.
+	 */
+	name = g_strconcat (tag_title, ".tag", NULL);
+	g_strdelimit (name, G_DIR_SEPARATOR_S, ' ');
+	tmm_guess_parse (name, &guess);
+	g_free (name);
+
+	if (!guess.title[0])
+		return;
+
+	sidecar->title = g_strdup (guess.title);
+
+	if (guess.year > 0)
+		sidecar->year = guess.year;
+	if (guess.season > 0 && guess.episode > 0) {
+		sidecar->season = guess.season;
+		sidecar->episode = guess.episode;
+	}
+}
+
+/* EBML variable size integers, the length marker is kept in IDs */
+static gboolean
+ebml_read_vint (const guchar **p,
+                const guchar  *end,
+                gboolean       keep_marker,
+                guint64       *value)
+{
+	guint length, i;
+	guchar first;
+
+	if (*p >= end || **p == 0)
+		return FALSE;
+
+	first = **p;
+
+	for (length = 1; !(first & (0x80 >> (length - 1))); length++)
+		;
+
+	if (length > 8 || *p + length > end)
+		return FALSE;
+
+	*value = keep_marker ? first : (first & (0xff >> length));
+
+	for (i = 1; i < length; i++)
+		*value = (*value << 8) | (*p)[i];
+
+	*p += length;
+
+	return TRUE;
+}
+
+/* Only the segment title is looked for, it is in the Info
+ * element that comes before any media data.
+ */
+static void
+read_mkv_tags (TmmSidecar   *sidecar,
+               const guchar *data,
+               gsize         length)
+{
+	const guchar *p = data, *end = data + length;
+	guint64 id, size;
+
+	if (!ebml_read_vint (&p, end, TRUE, &id) || id != MKV_ID_EBML ||
+	    !ebml_read_vint (&p, end, FALSE, &size) || size > (guint64) (end - p))
+		return;
+
+	p += size;
+
+	if (!ebml_read_vint (&p, end, TRUE, &id) || id != MKV_ID_SEGMENT ||
+	    !ebml_read_vint (&p, end, FALSE, &size))
+		return;
+
+	/* Segment children, the size might be unknown */
+	while (ebml_read_vint (&p, end, TRUE, &id) &&
+	       ebml_read_vint (&p, end, FALSE, &size)) {
+		if (id == MKV_ID_CLUSTER)
+			return;
+
+		if (id == MKV_ID_INFO) {
+			const guchar *info_end = p + MIN (size, (guint64) (end - p));
+
+			while (ebml_read_vint (&p, info_end, TRUE, &id) &&
+			       ebml_read_vint (&p, info_end, FALSE, &size) &&
+			       size <= (guint64) (info_end - p)) {
+				if (id == MKV_ID_TITLE) {
+					gchar *title = g_strndup ((const gchar *) p, size);
+
+					if (g_utf8_validate (title, -1, NULL))
+						sidecar_set_tag_title (sidecar, title);
+					g_free (title);
+					return;
+				}
+
+				p += size;
+			}
+
+			return;
+		}
+
+		if (size > (guint64) (end - p))
+			return;
+
+		p += size;
+	}
+}
+
+/* Atoms aren't aligned, values are read a byte at a time */
+static guint32
+mp4_read_uint32 (const guchar *p)
+{
+	return ((guint32) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* Finds the child atom of type @type in [@data, @end) */
+static const guchar *
+mp4_find_atom (const guchar  *data,
+               const guchar  *end,
+               guint32        type,
+               const guchar **atom_end)
+{
+	const guchar *p = data;
+
+	while (end - p >= 8) {
+		guint32 size, atom_type;
+
+		size = mp4_read_uint32 (p);
+		atom_type = mp4_read_uint32 (p + 4);
+
+		if (size < 8 || size > (gsize) (end - p))
+			return NULL;
+
+		if (atom_type == type) {
+			*atom_end = p + size;
+			return p + 8;
+		}
+
+		p += size;
+	}
+
+	return NULL;
+}
+
+/* Returns the payload of the "data" atom in an ilst item */
+static const guchar *
+mp4_item_data (const guchar *ilst,
+               const guchar *ilst_end,
+               guint32       type,
+               gsize        *length)
+{
+	const guchar *item, *item_end, *data, *data_end;
+
+	item = mp4_find_atom (ilst, ilst_end, type, &item_end);
+	if (!item)
+		return NULL;
+
+	data = mp4_find_atom (item, item_end, MP4_ATOM ('d','a','t','a'), &data_end);
+
+	/* Type and locale come first */
+	if (!data || data_end - data < 8)
+		return NULL;
+
+	*length = data_end - data - 8;
+
+	return data + 8;
+}
+
+static gchar *
+mp4_item_string (const guchar *ilst,
+                 const guchar *ilst_end,
+                 guint32       type)
+{
+	const guchar *data;
+	gchar *str;
+	gsize length;
+
+	data = mp4_item_data (ilst, ilst_end, type, &length);
+	if (!data)
+		return NULL;
+
+	str = g_strndup ((const gchar *) data, length);
+
+	if (!g_utf8_validate (str, -1, NULL))
+		g_clear_pointer (&str, g_free);
+
+	return str;
+}
+
+static gint
+mp4_item_int (const guchar *ilst,
+              const guchar *ilst_end,
+              guint32       type)
+{
+	const guchar *data;
+	guint32 value = 0;
+	gsize length, i;
+
+	data = mp4_item_data (ilst, ilst_end, type, &length);
+
+	if (!data || length == 0 || length > 4)
+		return 0;
+
+	/* Big endian, of any size up to 4 bytes */
+	for (i = 0; i < length; i++)
+		value = (value << 8) | data[i];
+
+	return (gint) value;
+}
+
+/* iTunes style tags in moov/udta/meta/ilst, only found
+ * if the moov atom is at the start of the file.
+ */
+static void
+read_mp4_tags (TmmSidecar   *sidecar,
+               const guchar *data,
+               gsize         length)
+{
+	const guchar *end = data + length, *p, *p_end;
+	gchar *title, *show, *day;
+
+	if (length < 8 ||
+	    mp4_read_uint32 (data + 4) != MP4_ATOM ('f','t','y','p'))
+		return;
+
+	if (!(p = mp4_find_atom (data, end, MP4_ATOM ('m','o','o','v'), &p_end)) ||
+	    !(p = mp4_find_atom (p, p_end, MP4_ATOM ('u','d','t','a'), &p_end)) ||
+	    !(p = mp4_find_atom (p, p_end, MP4_ATOM ('m','e','t','a'), &p_end)))
+		return;
+
+	/* meta is a full atom, version and flags come first */
+	if (p_end - p < 4 ||
+	    !(p = mp4_find_atom (p + 4, p_end, MP4_ATOM ('i','l','s','t'), &p_end)))
+		return;
+
+	title = mp4_item_string (p, p_end, MP4_ATOM (0xa9,'n','a','m'));
+	show = mp4_item_string (p, p_end, MP4_ATOM ('t','v','s','h'));
+	day = mp4_item_string (p, p_end, MP4_ATOM (0xa9,'d','a','y'));
+
+	if (show) {
+		sidecar->title = g_strdup (show);
+		sidecar->season = mp4_item_int (p, p_end, MP4_ATOM ('t','v','s','n'));
+		sidecar->episode = mp4_item_int (p, p_end, MP4_ATOM ('t','v','e','s'));
+	} else if (title) {
+		sidecar_set_tag_title (sidecar, title);
+	}
+
+	if (day && g_ascii_isdigit (day[0]))
+		sidecar->year = atoi (day);
+
+	g_free (title);
+	g_free (show);
+	g_free (day);
+}
+
+static void
+read_container_tags (TmmSidecar  *sidecar,
+                     const gchar *path)
+{
+	gchar *header;
+	gsize length;
+
+	header = read_bounded (path, HEADER_SIZE, TRUE, &length);
+
+	if (!header)
+		return;
+
+	read_mkv_tags (sidecar, (const guchar *) header, length);
+
+	if (!sidecar->title)
+		read_mp4_tags (sidecar, (const guchar *) header, length);
+
+	g_free (header);
+}
+
+/* "movie.nfo" describes the one film in its directory. Next to
+ * several videos, or to an episode, it would be taken for the
+ * wrong item.
+ */
+static gboolean
+movie_nfo_applies (const gchar *path,
+                   const gchar *dir_path)
+{
+	const gchar *name;
+	gchar *content_type;
+	guint n_videos = 0;
+	TmmGuess guess;
+	GDir *dir;
+
+	tmm_guess_parse (path, &guess);
+
+	if (guess.season > 0 || guess.episode > 0)
+		return FALSE;
+
+	dir = g_dir_open (dir_path, 0, NULL);
+
+	if (!dir)
+		return FALSE;
+
+	while (n_videos < 2 && (name = g_dir_read_name (dir)) != NULL) {
+		content_type = g_content_type_guess (name, NULL, 0, NULL);
+
+		if (g_str_has_prefix (content_type, "video/"))
+			n_videos++;
+
+		g_free (content_type);
+	}
+
+	g_dir_close (dir);
+
+	return n_videos == 1;
+}
+
+static gboolean
+sidecar_is_empty (TmmSidecar *sidecar)
+{
+	return !sidecar->imdb_id && !sidecar->title && !sidecar->metadata;
+}
+
+/* Returns NULL if nothing was found */
+TmmSidecar *
+tmm_sidecar_read (const gchar *path)
+{
+	TmmSidecar *sidecar;
+	gchar *dir, *basename, *extension, *nfo_path;
+
+	g_return_val_if_fail (path != NULL, NULL);
+
+	sidecar = g_new0 (TmmSidecar, 1);
+
+	/* "Title (Year).nfo" next to the video, or "movie.nfo"
+	 * for a film in a directory of its own.
+	 */
+	basename = g_path_get_basename (path);
+	extension = strrchr (basename, '.');
+	if (extension)
+		*extension = '\0';
+
+	dir = g_path_get_dirname (path);
+	nfo_path = g_strconcat (dir, G_DIR_SEPARATOR_S, basename, ".nfo", NULL);
+
+	if (!read_nfo (sidecar, nfo_path) && movie_nfo_applies (path, dir)) {
+		g_free (nfo_path);
+		nfo_path = g_build_filename (dir, "movie.nfo", NULL);
+		read_nfo (sidecar, nfo_path);
+	}
+
+	g_free (nfo_path);
+	g_free (basename);
+	g_free (dir);
+
+	if (!sidecar->metadata && !sidecar->title)
+		read_container_tags (sidecar, path);
+
+	if (sidecar_is_empty (sidecar)) {
+		tmm_sidecar_free (sidecar);
+		return NULL;
+	}
+
+	return sidecar;
+}
+
+void
+tmm_sidecar_free (TmmSidecar *sidecar)
+{
+	g_clear_pointer (&sidecar->metadata, tmm_metadata_free);
+	g_free (sidecar->imdb_id);
+	g_free (sidecar->title);
+	g_free (sidecar);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TMM_SIDECAR_H__
+#define __TMM_SIDECAR_H__
+
+#include <glib.h>
+
+#include "tmm-metadata.h"
+
+G_BEGIN_DECLS
+
+typedef struct _TmmSidecar TmmSidecar;
+
+/* What could be learned about a video without a lookup, from
+ * .nfo files next to it or from tags in the container.
+ */
+struct _TmmSidecar
+{
+	gchar *imdb_id;
+
+	/* Series title for episodes. Numbers are 0 if unknown */
+	gchar *title;
+	gint year;
+	gint season;
+	gint episode;
+
+	/* Only set if complete enough to skip the lookup */
+	TmmMetadata *metadata;
+};
+
+TmmSidecar * tmm_sidecar_read (const gchar *path);
+void         tmm_sidecar_free (TmmSidecar  *sidecar);
+
+G_END_DECLS
+
+#endif /* __TMM_SIDECAR_H__ */
@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "tmm-throttle.h"
+
+/* Paces requests to a remote backend:
+ *
+ * - A token bucket caps the request rate, allowing short bursts.
+ * - The number of requests in flight adapts AIMD-style: it grows
+ *   by one per round trip while requests succeed, and halves on
+ *   errors or when latency climbs well above its baseline.
+ * - After a run of failures the circuit breaker opens, and queued
+ *   requests are held back until a cooldown passes. A single probe
+ *   request then decides whether to resume or back off further.
+ *
+ * Latencies are given in microseconds.
+ */
+
+/* Requests that can be sent at once after an idle period */
+#define BUCKET_CAPACITY 5.0
+
+#define MIN_CONCURRENCY 1.0
+#define MAX_CONCURRENCY 32.0
+#define INITIAL_CONCURRENCY 2.0
+
+/* Latencies over this many times the baseline mean congestion */
+#define LATENCY_FACTOR 3
+
+#define BREAKER_THRESHOLD 5
+#define BREAKER_COOLDOWN_MIN (30 * G_USEC_PER_SEC)
+#define BREAKER_COOLDOWN_MAX (10 * 60 * G_USEC_PER_SEC)
+
+typedef struct _Request Request;
+
+typedef enum {
+	BREAKER_CLOSED,
+	BREAKER_OPEN,
+	BREAKER_HALF_OPEN
+} BreakerState;
+
+struct _Request
+{
+	TmmThrottleFunc func;
+	gpointer user_data;
+};
+
+struct _TmmThrottle
+{
+	GQueue queue;
+	guint timeout_id;
+
+	/* Token bucket, rate is in requests per second */
+	gdouble rate;
+	gdouble tokens;
+	gint64 last_refill;
+
+	/* Adaptive concurrency */
+	gdouble limit;
+	guint n_in_flight;
+	gint64 base_latency;
+	gint64 avg_latency;
+	gint64 last_decrease;
+
+	/* Circuit breaker */
+	BreakerState breaker;
+	guint n_failures;
+	gint64 cooldown;
+	gint64 reopen_time;
+};
+
+static void tmm_throttle_dispatch (TmmThrottle *throttle);
+
+TmmThrottle *
+tmm_throttle_new (gdouble rate)
+{
+	TmmThrottle *throttle;
+
+	throttle = g_new0 (TmmThrottle, 1);
+	g_queue_init (&throttle->queue);
+	throttle->rate = rate;
+	throttle->tokens = BUCKET_CAPACITY;
+	throttle->last_refill = g_get_monotonic_time ();
+	throttle->limit = INITIAL_CONCURRENCY;
+	throttle->cooldown = BREAKER_COOLDOWN_MIN;
+
+	return throttle;
+}
+
+void
+tmm_throttle_free (TmmThrottle *throttle)
+{
+	if (throttle->timeout_id)
+		g_source_remove (throttle->timeout_id);
+
+	g_queue_foreach (&throttle->queue, (GFunc) g_free, NULL);
+	g_queue_clear (&throttle->queue);
+	g_free (throttle);
+}
+
+/* A @rate of 0 disables rate limiting */
+void
+tmm_throttle_set_rate (TmmThrottle *throttle,
+                       gdouble      rate)
+{
+	throttle->rate = MAX (rate, 0);
+	tmm_throttle_dispatch (throttle);
+}
+
+static gboolean
+dispatch_timeout_cb (gpointer user_data)
+{
+	TmmThrottle *throttle = user_data;
+
+	throttle->timeout_id = 0;
+	tmm_throttle_dispatch (throttle);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+tmm_throttle_schedule (TmmThrottle *throttle,
+                       gint64       delay)
+{
+	if (throttle->timeout_id)
+		return;
+
+	throttle->timeout_id = g_timeout_add (MAX (delay / 1000, 1),
+	                                      dispatch_timeout_cb, throttle);
+}
+
+/* Returns the time to wait for a token, 0 if one was taken */
+static gint64
+tmm_throttle_take_token (TmmThrottle *throttle,
+                         gint64       now)
+{
+	if (throttle->rate <= 0)
+		return 0;
+
+	throttle->tokens += (now - throttle->last_refill) * throttle->rate / G_USEC_PER_SEC;
+	throttle->tokens = MIN (throttle->tokens, BUCKET_CAPACITY);
+	throttle->last_refill = now;
+
+	if (throttle->tokens < 1)
+		return (gint64) ((1 - throttle->tokens) * G_USEC_PER_SEC / throttle->rate);
+
+	throttle->tokens -= 1;
+
+	return 0;
+}
+
+static void
+tmm_throttle_dispatch (TmmThrottle *throttle)
+{
+	Request *request;
+	gint64 now, wait;
+
+	while (!g_queue_is_empty (&throttle->queue)) {
+		now = g_get_monotonic_time ();
+
+		if (throttle->breaker == BREAKER_OPEN) {
+			if (now < throttle->reopen_time) {
+				tmm_throttle_schedule (throttle, throttle->reopen_time - now);
+				return;
+			}
+
+			throttle->breaker = BREAKER_HALF_OPEN;
+		}
+
+		/* A single probe at a time until the backend recovers */
+		if (throttle->breaker == BREAKER_HALF_OPEN && throttle->n_in_flight > 0)
+			return;
+
+		if (throttle->n_in_flight >= (guint) throttle->limit)
+			return;
+
+		wait = tmm_throttle_take_token (throttle, now);
+
+		if (wait > 0) {
+			tmm_throttle_schedule (throttle, wait);
+			return;
+		}
+
+		request = g_queue_pop_head (&throttle->queue);
+		throttle->n_in_flight++;
+		request->func (request->user_data);
+		g_free (request);
+	}
+}
+
+/* Sends every queued request right away, ignoring the rate, the
+ * concurrency limit and the circuit breaker. For shutting down,
+ * once their cancellable is cancelled.
+ */
+void
+tmm_throttle_flush (TmmThrottle *throttle)
+{
+	Request *request;
+
+	while ((request = g_queue_pop_head (&throttle->queue)) != NULL) {
+		throttle->n_in_flight++;
+		request->func (request->user_data);
+		g_free (request);
+	}
+}
+
+void
+tmm_throttle_submit (TmmThrottle     *throttle,
+                     TmmThrottleFunc  func,
+                     gpointer         user_data)
+{
+	Request *request;
+
+	request = g_new0 (Request, 1);
+	request->func = func;
+	request->user_data = user_data;
+	g_queue_push_tail (&throttle->queue, request);
+
+	tmm_throttle_dispatch (throttle);
+}
+
+static void
+tmm_throttle_decrease (TmmThrottle *throttle,
+                       gint64       now)
+{
+	/* Once per round trip, the requests in flight
+	 * were likely hit by the same congestion.
+	 */
+	if (now - throttle->last_decrease < throttle->avg_latency)
+		return;
+
+	throttle->limit = MAX (throttle->limit / 2, MIN_CONCURRENCY);
+	throttle->last_decrease = now;
+}
+
+static void
+tmm_throttle_update_latency (TmmThrottle *throttle,
+                             gint64       latency)
+{
+	if (throttle->avg_latency == 0) {
+		throttle->avg_latency = latency;
+		throttle->base_latency = latency;
+		return;
+	}
+
+	throttle->avg_latency += (latency - throttle->avg_latency) / 8;
+
+	/* Let the baseline drift up slowly, in case
+	 * the backend just got slower for good.
+	 */
+	if (latency < throttle->base_latency)
+		throttle->base_latency = latency;
+	else
+		throttle->base_latency += (latency - throttle->base_latency) / 64;
+}
+
+static void
+tmm_throttle_trip (TmmThrottle *throttle,
+                   gint64       now)
+{
+	if (throttle->breaker == BREAKER_HALF_OPEN)
+		throttle->cooldown = MIN (throttle->cooldown * 2, BREAKER_COOLDOWN_MAX);
+
+	throttle->breaker = BREAKER_OPEN;
+	throttle->reopen_time = now + throttle->cooldown;
+	throttle->limit = MIN_CONCURRENCY;
+
+	g_message ("Backend failing, holding %u queued request(s) for %" G_GINT64_FORMAT " seconds",
+	           g_queue_get_length (&throttle->queue),
+	           throttle->cooldown / G_USEC_PER_SEC);
+}
+
+void
+tmm_throttle_complete (TmmThrottle       *throttle,
+                       TmmThrottleResult  result,
+                       gint64             latency)
+{
+	gint64 now;
+
+	g_return_if_fail (throttle->n_in_flight > 0);
+
+	throttle->n_in_flight--;
+	now = g_get_monotonic_time ();
+
+	if (result == TMM_THROTTLE_FAILURE) {
+		throttle->n_failures++;
+		tmm_throttle_decrease (throttle, now);
+
+		if (throttle->breaker == BREAKER_HALF_OPEN ||
+		    (throttle->breaker == BREAKER_CLOSED &&
+		     throttle->n_failures >= BREAKER_THRESHOLD))
+			tmm_throttle_trip (throttle, now);
+	} else if (result == TMM_THROTTLE_SUCCESS) {
+		throttle->n_failures = 0;
+
+		if (throttle->breaker != BREAKER_CLOSED) {
+			g_message ("Backend recovered, resuming requests");
+			throttle->breaker = BREAKER_CLOSED;
+			throttle->cooldown = BREAKER_COOLDOWN_MIN;
+		}
+
+		tmm_throttle_update_latency (throttle, latency);
+
+		if (latency > LATENCY_FACTOR * throttle->base_latency)
+			tmm_throttle_decrease (throttle, now);
+		else
+			throttle->limit = MIN (throttle->limit + 1 / throttle->limit, MAX_CONCURRENCY);
+	}
+
+	tmm_throttle_dispatch (throttle);
+}
+
+guint
+tmm_throttle_get_n_queued (TmmThrottle *throttle)
+{
+	return g_queue_get_length (&throttle->queue);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __TMM_THROTTLE_H__
+#define __TMM_THROTTLE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TmmThrottle TmmThrottle;
+
+typedef void (* TmmThrottleFunc) (gpointer user_data);
+
+typedef enum {
+	TMM_THROTTLE_SUCCESS,
+	TMM_THROTTLE_FAILURE,
+	TMM_THROTTLE_CANCELLED
+} TmmThrottleResult;
+
+TmmThrottle * tmm_throttle_new          (gdouble             rate);
+void          tmm_throttle_free         (TmmThrottle        *throttle);
+
+void          tmm_throttle_set_rate     (TmmThrottle        *throttle,
+                                         gdouble             rate);
+
+void          tmm_throttle_submit       (TmmThrottle        *throttle,
+                                         TmmThrottleFunc     func,
+                                         gpointer            user_data);
+void          tmm_throttle_complete     (TmmThrottle        *throttle,
+                                         TmmThrottleResult   result,
+                                         gint64              latency);
+void          tmm_throttle_flush        (TmmThrottle        *throttle);
+
+guint         tmm_throttle_get_n_queued (TmmThrottle        *throttle);
+
+G_END_DECLS
+
+#endif /* __TMM_THROTTLE_H__ */
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2014 Carlos Garnacho  <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "tmm-watch.h"
+
+/* Stands in for the miner once it exited on --idle-timeout. The store
+ * signals don't activate anything, so this waits for videos to be
+ * added, then starts the miner again through D-Bus activation. It
+ * holds no caches and no backend, so it is cheap to keep around.
+ *
+ * The miner may still be exiting when this starts, so it is only
+ * activated once its bus name is gone. If the miner shows up again
+ * for some other reason, there is nothing left to do here.
+ */
+
+#define STORE_BUS_NAME "org.freedesktop.Tracker1"
+#define STORE_PATH "/org/freedesktop/Tracker1/Resources"
+#define STORE_INTERFACE "org.freedesktop.Tracker1.Resources"
+
+#define MINER_BUS_NAME "org.freedesktop.Tracker1.Miner.Media"
+#define MINER_PATH "/org/freedesktop/Tracker1/Miner/Media"
+
+#define VIDEO_CLASS "http://www.semanticdesktop.org/ontologies/2007/03/22/nfo#Video"
+
+typedef struct _Watch Watch;
+
+struct _Watch
+{
+	GDBusConnection *connection;
+	GMainLoop *main_loop;
+	GError *error;
+
+	gboolean miner_running;
+	gboolean miner_exited;
+	gboolean items_added;
+	gboolean activating;
+};
+
+static void
+watch_activate_cb (GObject      *object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+	Watch *watch = user_data;
+	GVariant *reply;
+
+	reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (object),
+	                                       result, &watch->error);
+
+	if (reply) {
+		g_message ("Videos were added, miner started again");
+		g_variant_unref (reply);
+	}
+
+	g_main_loop_quit (watch->main_loop);
+}
+
+static void
+watch_check (Watch *watch)
+{
+	if (!watch->items_added || watch->miner_running || watch->activating)
+		return;
+
+	/* Any method call starts it, the reply tells it's up */
+	watch->activating = TRUE;
+	g_dbus_connection_call (watch->connection, MINER_BUS_NAME, MINER_PATH,
+	                        "org.freedesktop.DBus.Peer", "Ping",
+	                        NULL, NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+	                        watch_activate_cb, watch);
+}
+
+static void
+graph_updated_cb (GDBusConnection *connection,
+                  const gchar     *sender_name,
+                  const gchar     *object_path,
+                  const gchar     *interface_name,
+                  const gchar     *signal_name,
+                  GVariant        *parameters,
+                  gpointer         user_data)
+{
+	Watch *watch = user_data;
+	GVariant *inserts;
+
+	if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa(iiii)a(iiii))")))
+		return;
+
+	/* The class is matched by the subscription */
+	g_variant_get (parameters, "(&s@a(iiii)@a(iiii))",
+	               NULL, NULL, &inserts);
+
+	if (g_variant_n_children (inserts) > 0) {
+		watch->items_added = TRUE;
+		watch_check (watch);
+	}
+
+	g_variant_unref (inserts);
+}
+
+static void
+miner_appeared_cb (GDBusConnection *connection,
+                   const gchar     *name,
+                   const gchar     *name_owner,
+                   gpointer         user_data)
+{
+	Watch *watch = user_data;
+
+	watch->miner_running = TRUE;
+
+	/* Started by someone else, it takes over */
+	if (watch->miner_exited && !watch->activating)
+		g_main_loop_quit (watch->main_loop);
+}
+
+static void
+miner_vanished_cb (GDBusConnection *connection,
+                   const gchar     *name,
+                   gpointer         user_data)
+{
+	Watch *watch = user_data;
+
+	watch->miner_running = FALSE;
+	watch->miner_exited = TRUE;
+	watch_check (watch);
+}
+
+/**
+ * tmm_watch_run:
+ * @error: return location for a #GError
+ *
+ * Waits for videos to be added to the store, then starts the
+ * miner. Returns once it is started, or another process did.
+ *
+ * Returns: %FALSE if the session bus isn't reachable, or the
+ * miner couldn't be started.
+ **/
+gboolean
+tmm_watch_run (GError **error)
+{
+	guint subscription_id, watch_id;
+	Watch watch = { 0 };
+
+	watch.connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, error);
+
+	if (!watch.connection)
+		return FALSE;
+
+	watch.main_loop = g_main_loop_new (NULL, FALSE);
+
+	/* Subscribed first, so nothing added meanwhile goes amiss */
+	subscription_id =
+		g_dbus_connection_signal_subscribe (watch.connection,
+		                                    STORE_BUS_NAME,
+		                                    STORE_INTERFACE,
+		                                    "GraphUpdated",
+		                                    STORE_PATH,
+		                                    VIDEO_CLASS,
+		                                    G_DBUS_SIGNAL_FLAGS_NONE,
+		                                    graph_updated_cb,
+		                                    &watch, NULL);
+	watch_id = g_bus_watch_name_on_connection (watch.connection, MINER_BUS_NAME,
+	                                           G_BUS_NAME_WATCHER_FLAGS_NONE,
+	                                           miner_appeared_cb,
+	                                           miner_vanished_cb,
+	                                           &watch, NULL);
+
+	g_main_loop_run (watch.main_loop);
+
+	g_bus_unwatch_name (watch_id);
+	g_dbus_connection_signal_unsubscribe (watch.connection, subscription_id);
+	g_main_loop_unref (watch.main_loop);
+	g_object_unref (watch.connection);
+
+	if (watch.error) {
+		g_propagate_error (error, watch.error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
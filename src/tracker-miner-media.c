@@ -17,14 +17,126 @@
  * Boston, MA  02110-1301, USA.
  */
 
-#include "tracker-miner-media.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
-#include <gdata/gdata.h>
+#include "tracker-miner-media.h"
+#include "tmm-metadata.h"
+#include "tmm-cache.h"
+#include "tmm-guess.h"
+#include "tmm-hash.h"
+#include "tmm-histogram.h"
+#include "tmm-request.h"
+#include "tmm-scheduler.h"
+#include "tmm-sidecar.h"
+#include "tmm-throttle.h"
 
-#define TMM_DATA_SOURCE "tmm:urn:83443497-b4cf-4341-8ac8-74058828f6db"
 #define TMM_GRAPH "tmm:graph:33091b97-fc29-431e-8747-a62b3f3ec56f"
 
+#define DEFAULT_MAX_ACTIVE_ITEMS 8
+#define DEFAULT_REQUEST_RATE 10.0
+#define DEFAULT_REFRESH_BUDGET 200
+#define DEFAULT_REQUEST_TIMEOUT 30
+
+#define STATISTICS_PATH "/org/freedesktop/Tracker1/Miner/Media"
+#define STATISTICS_INTERFACE "org.freedesktop.Tracker1.Miner.Media.Statistics"
+
+/* Lifetime of lookup cache entries, in seconds */
+#define CACHE_ID_TTL (90 * 24 * 60 * 60)
+#define CACHE_TOPIC_TTL (30 * 24 * 60 * 60)
+#define CACHE_SAVE_INTERVAL (5 * 60)
+
+/* Saved early past this many new entries, or a quarter of those
+ * in the file if more, bounding the overlay while many items go
+ * through between saves without rewriting a large file too often.
+ */
+#define CACHE_MAX_PENDING 50000
+
+/* Artist URNs remembered as being in the store, past this
+ * many the others are just inserted again when referenced.
+ */
+#define MAX_KNOWN_ARTISTS 50000
+
+/* Progress of unfinished items, for items that never come back */
+#define CACHE_JOURNAL_TTL (7 * 24 * 60 * 60)
+
+/* Backoff before looking up again titles that found nothing, in seconds */
+#define MISS_BACKOFF_MIN (24 * 60 * 60)
+#define MISS_BACKOFF_MAX (90 * 24 * 60 * 60)
+
+/* Topic lookups are gathered for up to this many milliseconds,
+ * or this many IDs, and sent in a single request.
+ */
+#define TOPIC_BATCH_DELAY 50
+#define TOPIC_BATCH_SIZE 25
+
+/* Latencies needed for a stage before requests to it are hedged */
+#define HEDGE_MIN_SAMPLES 20
+
+/* Updates handed to TrackerDecorator and not seen written to
+ * the store after this many seconds are given up on.
+ */
+#define CONFIRM_TIMEOUT 60
+
+#define STORE_BUS_NAME "org.freedesktop.Tracker1"
+#define STORE_PATH "/org/freedesktop/Tracker1/Resources"
+#define STORE_INTERFACE "org.freedesktop.Tracker1.Resources"
+
+#define VIDEO_CLASS "http://www.semanticdesktop.org/ontologies/2007/03/22/nfo#Video"
+
+/* Seconds given to the items still being looked up when stopping */
+#define SHUTDOWN_TIMEOUT 5
+
+/* Pipeline stages, timed separately */
+typedef enum {
+	STAGE_INSPECT,
+	STAGE_GUESS,
+	STAGE_STORE,
+	STAGE_THROTTLE,
+	STAGE_SEARCH,
+	STAGE_SEASON,
+	STAGE_TOPIC,
+	STAGE_EXTRACT,
+	N_STAGES
+} Stage;
+
+typedef enum {
+	FAILURE_NOT_FOUND,
+	FAILURE_BACKED_OFF,
+	FAILURE_BACKEND,
+	FAILURE_TIMED_OUT,
+	FAILURE_CANCELLED,
+	N_FAILURES
+} Failure;
+
+static const gchar *stage_names[] = {
+	"inspect", "guess", "store", "throttle", "search", "season", "topic", "extract"
+};
+
+static const gchar *failure_names[] = {
+	"not-found", "backed-off", "backend-error", "timed-out", "cancelled"
+};
+
+static const gchar *cache_tier_names[] = {
+	"ids", "topics", "misses", "hashes", "written", "schedule", "journal"
+};
+
+static const gchar statistics_xml[] =
+	"<node>"
+	"  <interface name='" STATISTICS_INTERFACE "'>"
+	"    <method name='GetStatistics'>"
+	"      <arg type='a{sv}' name='statistics' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
 typedef struct _FileInfo FileInfo;
+typedef struct _ExtractJob ExtractJob;
+typedef struct _PendingCommit PendingCommit;
+typedef struct _Inspection Inspection;
+typedef struct _TopicBatch TopicBatch;
 typedef struct _TmmDecoratorPrivate TmmDecoratorPrivate;
 
 struct _FileInfo
@@ -35,17 +147,203 @@ struct _FileInfo
 	GTask *task;
 
 	gchar *urn;
-	gchar *freebase_id;
+	gchar *id;
+	gchar *lookup_key;
+
+	/* Content hash, if it could be computed */
+	gchar *hash;
+
+	/* .nfo file or container tags, if any */
+	TmmSidecar *sidecar;
 
 	gchar *title;
+	gint year;
 	gint season;
 	gint episode;
+
+	/* The above was guessed by the caller already */
+	gboolean guessed;
+
+	/* Queued again by the scheduler, skips the caches */
+	gboolean refresh;
+
+	/* From tmm_decorator_process_file_async(), the update is
+	 * written by the caller rather than by the decorator.
+	 */
+	gboolean external;
+
+	/* Cancelled by pausing, waiting to be resumed */
+	gboolean parked;
+
+	/* When the item was started, and the current
+	 * backend request was queued, then sent.
+	 */
+	gint64 start_time;
+	gint64 request_time;
+};
+
+/* Filled in off the main thread */
+struct _Inspection
+{
+	gchar *path;
+	gchar *hash;
+	TmmSidecar *sidecar;
+};
+
+struct _ExtractJob
+{
+	FileInfo *info;
+	GVariant *metadata;
+
+	/* Artist URNs inserted by this item */
+	GPtrArray *new_artists;
+
+	/* What was last written for this item, as stored in
+	 * TMM_CACHE_WRITTEN, and whether it is all the same.
+	 */
+	GVariant *previous;
+	gboolean unchanged;
+
+	/* For the refresh scheduler */
+	gdouble confidence;
+	gint64 release_date;
+
+	/* Time from queueing to the SPARQL being ready */
+	gint64 queue_time;
+	gint64 done_time;
+};
+
+/* Bookkeeping for an extracted item, only done once
+ * its update is known to be in the store.
+ */
+struct _PendingCommit
+{
+	gchar *urn;
+	GVariant *metadata;
+	gchar *lookup_key;
+	gchar *hash;
+	gchar *id;
+	GPtrArray *new_artists;
+
+	/* For the refresh scheduler, unless the .nfo file said it all */
+	gboolean schedule;
+	gdouble confidence;
+	gint64 release_date;
+
+	/* When it was handed to TrackerDecorator */
+	gint64 commit_time;
+};
+
+struct _TopicBatch
+{
+	TmmDecorator *decorator;
+	gboolean is_episode;
+
+	/* FileInfos leading the lookup of each ID */
+	GPtrArray *infos;
+	gint64 request_time;
 };
 
 struct _TmmDecoratorPrivate
 {
-	GDataFreebaseService *freebase_service;
+	TmmBackend *backend;
+
+	/* Cancelled while the miner is paused or stopping. Items from
+	 * tmm_decorator_process_file_async() go on while paused, as
+	 * when importing, and only stop with the miner.
+	 */
 	GCancellable *cancellable;
+	GCancellable *external_cancellable;
+
+	TmmThrottle *throttle;
+	gdouble request_rate;
+	guint request_timeout;
+
+	TmmCache *cache;
+	guint save_cache_id;
+
+	TmmScheduler *scheduler;
+	guint refresh_budget;
+
+	/* Lookups in flight, as key -> GPtrArray of waiting FileInfos */
+	GHashTable *pending_searches;
+	GHashTable *pending_seasons;
+	GHashTable *pending_topics;
+
+	/* Topic lookups not sent yet, for films and for episodes */
+	TopicBatch *topic_batches[2];
+	guint topic_batch_id;
+
+	/* nmm:Artist URNs known to be in the store, read from
+	 * the extraction threads, so accessed with the lock held.
+	 */
+	GHashTable *known_artists;
+	GMutex known_artists_lock;
+
+	/* Metadata to SPARQL conversion, off the main thread */
+	GThreadPool *extract_pool;
+
+	/* Extracted jobs waiting for extract_job_done_cb() */
+	GQueue extract_done;
+	GMutex extract_done_lock;
+
+	/* Lookup window: items being processed, plus
+	 * tracker_decorator_next() calls still in flight.
+	 */
+	guint max_active_items;
+	guint n_active_items;
+	guint n_requested_items;
+
+	/* Stopping, items are failed rather than looked up */
+	gboolean shutting_down;
+
+	/* FileInfos cancelled by pausing, still in the window,
+	 * picked up again from their last stage once resumed.
+	 */
+	GQueue parked;
+
+	/* Every FileInfo not freed yet, for memory accounting */
+	GHashTable *live_items;
+
+	/* URN -> PendingCommit, for updates written by the caller
+	 * of tmm_decorator_process_file_async().
+	 */
+	GHashTable *uncommitted;
+
+	/* URN -> PendingCommit, for updates handed to TrackerDecorator,
+	 * until the store signals them written. The IDs of resources
+	 * that got a nie:dataSource wait in @confirm_ids for their URNs
+	 * to be queried. The property's own ID is 0 until known.
+	 */
+	GHashTable *unconfirmed;
+	GArray *confirm_ids;
+	gboolean confirming;
+	gint data_source_property_id;
+	guint graph_updated_id;
+
+	/* Throughput and latency, since the first item */
+	TmmHistogram *latencies;
+	TmmHistogram *stage_latencies[N_STAGES];
+	guint64 n_failures[N_FAILURES];
+	guint64 n_unchanged;
+	guint64 n_requests;
+	guint64 n_hedged_requests;
+	gint64 stats_start_time;
+
+	GDBusConnection *dbus_connection;
+	guint statistics_id;
+	guint statistics_interval;
+	guint log_statistics_id;
+};
+
+enum {
+	PROP_0,
+	PROP_BACKEND,
+	PROP_MAX_ACTIVE_ITEMS,
+	PROP_REQUEST_RATE,
+	PROP_STATISTICS_INTERVAL,
+	PROP_REFRESH_BUDGET,
+	PROP_REQUEST_TIMEOUT
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (TmmDecorator, tmm_decorator, TRACKER_TYPE_DECORATOR_FS)
@@ -57,33 +355,126 @@ file_info_new (GFile        *file,
                GTask        *task,
                const gchar  *urn)
 {
+	TmmDecoratorPrivate *priv;
 	FileInfo *info;
 
 	info = g_new0 (FileInfo, 1);
 	info->file = g_object_ref (file);
 	info->decorator = decorator;
 	info->sparql = g_task_get_task_data (task);
-	info->task = task;
+	info->task = g_object_ref (task);
 	info->urn = g_strdup (urn);
+	info->start_time = g_get_monotonic_time ();
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	g_hash_table_add (priv->live_items, info);
 
 	return info;
 }
 
+/* Only called from file_info_finish(), once the task was returned */
 static void
 file_info_free (FileInfo *info)
 {
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	g_hash_table_remove (priv->live_items, info);
+
 	g_object_unref (info->file);
-	g_free (info->freebase_id);
+	g_object_unref (info->task);
+	g_free (info->urn);
+	g_free (info->id);
+	g_free (info->lookup_key);
+	g_free (info->hash);
 	g_free (info->title);
+	g_clear_pointer (&info->sidecar, tmm_sidecar_free);
 	g_free (info);
 }
 
+static gsize
+string_get_size (const gchar *str)
+{
+	return str ? strlen (str) + 1 : 0;
+}
+
+/* Approximate heap usage, the GFile and task are shared
+ * with the decorator so they aren't counted.
+ */
+static gsize
+file_info_get_size (FileInfo *info)
+{
+	gsize size = sizeof (FileInfo);
+
+	size += string_get_size (info->urn);
+	size += string_get_size (info->id);
+	size += string_get_size (info->lookup_key);
+	size += string_get_size (info->hash);
+	size += string_get_size (info->title);
+
+	if (info->sidecar) {
+		size += sizeof (TmmSidecar);
+		size += string_get_size (info->sidecar->imdb_id);
+		size += string_get_size (info->sidecar->title);
+
+		if (info->sidecar->metadata)
+			size += tmm_metadata_get_size (info->sidecar->metadata);
+	}
+
+	return size;
+}
+
 static gboolean
 file_info_is_episode (FileInfo *info)
 {
 	return info->season > 0 && info->episode > 0;
 }
 
+/* Lookup keys are the normalized title, plus the year for films,
+ * so remakes sharing a title aren't taken for one another, or season
+ * and episode for series. Keys for a whole season have no episode
+ * number, films with no year guessed go by the title alone.
+ */
+static gchar *
+lookup_key_new (const gchar *title,
+                gint         year,
+                gint         season,
+                gint         episode)
+{
+	gchar *normalized, *key;
+
+	normalized = g_utf8_casefold (title, -1);
+	g_strstrip (normalized);
+
+	if (season <= 0) {
+		if (year <= 0)
+			return normalized;
+
+		key = g_strdup_printf ("%s (%d)", normalized, year);
+		g_free (normalized);
+
+		return key;
+	}
+
+	if (episode <= 0)
+		key = g_strdup_printf ("%s|%d", normalized, season);
+	else
+		key = g_strdup_printf ("%s|%d|%d", normalized, season, episode);
+
+	g_free (normalized);
+
+	return key;
+}
+
+static gchar *
+file_info_get_lookup_key (FileInfo *info)
+{
+	if (!file_info_is_episode (info))
+		return lookup_key_new (info->title, info->year, 0, 0);
+
+	return lookup_key_new (info->title, 0, info->season, info->episode);
+}
+
 static void
 sparql_builder_object_time (TrackerSparqlBuilder *sparql,
                             gint64                time)
@@ -96,218 +487,436 @@ sparql_builder_object_time (TrackerSparqlBuilder *sparql,
 	tracker_sparql_builder_object_string (sparql, buffer);
 }
 
-GPtrArray *
-file_info_extract_artists (GDataFreebaseTopicObject *object,
-                           TrackerSparqlBuilder     *sparql,
-                           const gchar              *freebase_property)
+/* Returns the artist URNs, artists not known to be in the store
+ * yet are also added to @new_artists as URN -> name, to be inserted.
+ */
+static GPtrArray *
+file_info_extract_artists (FileInfo   *info,
+                           GPtrArray  *artist_names,
+                           GHashTable *new_artists)
 {
+	TmmDecoratorPrivate *priv;
 	GPtrArray *artists;
-	gint64 i;
+	guint i;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
 
 	artists = g_ptr_array_new_with_free_func ((GDestroyNotify) g_free);
+	g_mutex_lock (&priv->known_artists_lock);
 
-	for (i = 0; i < gdata_freebase_topic_object_get_property_count (object, freebase_property); i++) {
-		GDataFreebaseTopicValue *value;
+	for (i = 0; i < artist_names->len; i++) {
 		const gchar *artist_name;
 		gchar *urn;
 
-		value = gdata_freebase_topic_object_get_property_value (object, freebase_property, i);
-		artist_name = gdata_freebase_topic_value_get_text (value);
+		artist_name = g_ptr_array_index (artist_names, i);
 		urn = tracker_sparql_escape_uri_printf ("urn:artist:%s", artist_name);
 
-		tracker_sparql_builder_insert_open (sparql, NULL);
-		tracker_sparql_builder_subject_iri (sparql, urn);
-		tracker_sparql_builder_predicate (sparql, "a");
-		tracker_sparql_builder_object (sparql, "nmm:Artist");
-		tracker_sparql_builder_predicate (sparql, "nmm:artistName");
-		tracker_sparql_builder_object_unvalidated (sparql, artist_name);
-		tracker_sparql_builder_insert_close (sparql);
+		if (!g_hash_table_contains (priv->known_artists, urn))
+			g_hash_table_insert (new_artists, g_strdup (urn), (gpointer) artist_name);
 
 		g_ptr_array_add (artists, urn);
 	}
 
+	g_mutex_unlock (&priv->known_artists_lock);
+
 	return artists;
 }
 
-GPtrArray *
-file_info_extract_actors (GDataFreebaseTopicObject *object,
-                          TrackerSparqlBuilder     *sparql)
+/* All artists of an item go in a single INSERT, their
+ * URNs are added to @inserted.
+ */
+static void
+file_info_insert_artists (FileInfo   *info,
+                          GHashTable *new_artists,
+                          GPtrArray  *inserted)
 {
-	GPtrArray *artists;
-	gint64 i;
+	const gchar *urn, *artist_name;
+	GHashTableIter iter;
 
-	artists = g_ptr_array_new_with_free_func ((GDestroyNotify) g_free);
+	if (g_hash_table_size (new_artists) == 0)
+		return;
 
-	for (i = 0; i < gdata_freebase_topic_object_get_property_count (object, "/film/film/starring"); i++) {
-		GDataFreebaseTopicValue *value, *child_value;
-		const GDataFreebaseTopicObject *child_object;
-		const gchar *artist_name;
-		gchar *urn;
+	tracker_sparql_builder_insert_open (info->sparql, NULL);
+	g_hash_table_iter_init (&iter, new_artists);
 
-		value = gdata_freebase_topic_object_get_property_value (object, "/film/film/starring", i);
-		child_object = gdata_freebase_topic_value_get_object (value);
-		child_value = gdata_freebase_topic_object_get_property_value (child_object, "/film/performance/actor", 0);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &urn, (gpointer *) &artist_name)) {
+		g_ptr_array_add (inserted, g_strdup (urn));
 
-		artist_name = gdata_freebase_topic_value_get_text (child_value);
-		urn = tracker_sparql_escape_uri_printf ("urn:artist:%s", artist_name);
+		tracker_sparql_builder_subject_iri (info->sparql, urn);
+		tracker_sparql_builder_predicate (info->sparql, "a");
+		tracker_sparql_builder_object (info->sparql, "nmm:Artist");
+		tracker_sparql_builder_predicate (info->sparql, "nmm:artistName");
+		tracker_sparql_builder_object_unvalidated (info->sparql, artist_name);
+	}
 
-		tracker_sparql_builder_insert_open (sparql, NULL);
-		tracker_sparql_builder_subject_iri (sparql, urn);
-		tracker_sparql_builder_predicate (sparql, "a");
-		tracker_sparql_builder_object (sparql, "nmm:Artist");
-		tracker_sparql_builder_predicate (sparql, "nmm:artistName");
-		tracker_sparql_builder_object_unvalidated (sparql, artist_name);
-		tracker_sparql_builder_insert_close (sparql);
+	tracker_sparql_builder_insert_close (info->sparql);
+}
 
-		g_ptr_array_add (artists, urn);
+/* Journals what is known about @info so far, a lookup cancelled
+ * by pausing or stopping the miner starts again from there.
+ */
+static void
+file_info_save_progress (FileInfo *info)
+{
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	tmm_cache_insert (priv->cache, TMM_CACHE_JOURNAL, info->urn,
+	                  g_variant_new ("(ssiiisb)",
+	                                 info->hash ? info->hash : "",
+	                                 info->title,
+	                                 info->year, info->season, info->episode,
+	                                 info->id ? info->id : "",
+	                                 info->refresh),
+	                  CACHE_JOURNAL_TTL);
+}
+
+/* Returns TRUE if @info was journaled by an unfinished lookup */
+static gboolean
+file_info_restore_progress (FileInfo *info)
+{
+	TmmDecoratorPrivate *priv;
+	gchar *hash, *id;
+	GVariant *cached;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	cached = tmm_cache_lookup (priv->cache, TMM_CACHE_JOURNAL, info->urn);
+
+	if (!cached)
+		return FALSE;
+
+	if (!g_variant_is_of_type (cached, G_VARIANT_TYPE ("(ssiiisb)"))) {
+		g_variant_unref (cached);
+		return FALSE;
 	}
 
-	return artists;
+	/* Replaces a guess passed to tmm_decorator_process_file_async() */
+	g_free (info->title);
+	g_variant_get (cached, "(ssiiisb)",
+	               &hash, &info->title,
+	               &info->year, &info->season, &info->episode,
+	               &id, &info->refresh);
+	g_variant_unref (cached);
+
+	if (*hash)
+		info->hash = hash;
+	else
+		g_free (hash);
+
+	if (*id)
+		info->id = id;
+	else
+		g_free (id);
+
+	info->lookup_key = file_info_get_lookup_key (info);
+
+	return TRUE;
 }
 
 static void
 file_info_fail (FileInfo *info,
                 GError   *error)
 {
+	TmmDecoratorPrivate *priv;
+	Failure failure;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+
+	/* The item goes on once resumed, see file_info_finish() */
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+	    !info->external && !priv->shutting_down &&
+	    tracker_miner_is_paused (TRACKER_MINER (info->decorator))) {
+		info->parked = TRUE;
+		g_error_free (error);
+		return;
+	}
+
+	if (g_error_matches (error, TMM_DECORATOR_ERROR, TMM_DECORATOR_ERROR_NOT_FOUND))
+		failure = FAILURE_NOT_FOUND;
+	else if (g_error_matches (error, TMM_DECORATOR_ERROR, TMM_DECORATOR_ERROR_BACKED_OFF))
+		failure = FAILURE_BACKED_OFF;
+	else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT))
+		failure = FAILURE_TIMED_OUT;
+	else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		failure = FAILURE_CANCELLED;
+	else
+		failure = FAILURE_BACKEND;
+
+	priv->n_failures[failure]++;
+
+	/* Cancelled by stopping, the next run picks up from there */
+	if (failure != FAILURE_CANCELLED)
+		tmm_cache_remove (priv->cache, TMM_CACHE_JOURNAL, info->urn);
+
 	g_task_return_error (info->task, error);
 }
 
+static void tmm_decorator_fill_window (TmmDecorator *decorator);
+
+static GCancellable *
+file_info_get_cancellable (FileInfo *info)
+{
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+
+	return info->external ? priv->external_cancellable : priv->cancellable;
+}
+
 static void
-file_info_extract (FileInfo                 *info,
-                   GDataFreebaseTopicResult *result)
+file_info_finish (FileInfo *info)
 {
-	GDataFreebaseTopicValue *value, *child_value;
-	GPtrArray *directors, *producers, *actors;
-	const GDataFreebaseTopicObject *object;
-	GDataFreebaseTopicObject *root;
-	const gchar *title = NULL;
-	gint64 i, creation_time = -1;
+	TmmDecoratorPrivate *priv;
 
-	root = gdata_freebase_topic_result_dup_object (result);
-	directors = producers = actors = NULL;
+	priv = tmm_decorator_get_instance_private (info->decorator);
 
-	if (file_info_is_episode (info)) {
-		directors = file_info_extract_artists (root, info->sparql, "/tv/tv_series_episode/director");
-		producers = file_info_extract_artists (root, info->sparql, "tv/tv_series_episode/producers");
-	} else {
-		directors = file_info_extract_artists (root, info->sparql, "/film/film/directed_by");
-		producers = file_info_extract_artists (root, info->sparql, "/film/film/produced_by");
-		actors = file_info_extract_actors (root, info->sparql);
+	if (info->parked) {
+		g_queue_push_tail (&priv->parked, info);
+		return;
 	}
 
-	/* Extract title */
-	value = gdata_freebase_topic_object_get_property_value (root, "/type/object/name", 0);
+	g_assert (priv->n_active_items > 0);
+	priv->n_active_items--;
 
-	if (value)
-		title = gdata_freebase_topic_value_get_string (value);
+	if (priv->stats_start_time == 0)
+		priv->stats_start_time = info->start_time;
+	tmm_histogram_add (priv->latencies,
+	                   g_get_monotonic_time () - info->start_time);
 
-	/* Extract release date */
-	if (file_info_is_episode (info)) {
-		value = gdata_freebase_topic_object_get_property_value (root, "/tv/tv_series_episode/air_date", 0);
-	} else {
-		value = gdata_freebase_topic_object_get_property_value (root, "/film/film/initial_release_date", 0);
+	tmm_decorator_fill_window (info->decorator);
+	file_info_free (info);
+}
+
+/* On finalization, fails the item without asking for more */
+static void
+file_info_abort (FileInfo *info)
+{
+	g_task_return_new_error (info->task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+	                         "Miner is shutting down");
+	file_info_free (info);
+}
+
+static gboolean
+artists_equal (GPtrArray *artists,
+               GPtrArray *other)
+{
+	guint i;
+
+	if (artists->len != other->len)
+		return FALSE;
+
+	for (i = 0; i < artists->len; i++) {
+		if (strcmp (g_ptr_array_index (artists, i),
+		            g_ptr_array_index (other, i)) != 0)
+			return FALSE;
 	}
 
-	if (value) {
-		creation_time = gdata_freebase_topic_value_get_int (value);
+	return TRUE;
+}
+
+static void
+file_info_delete_property (FileInfo    *info,
+                           const gchar *graph,
+                           const gchar *predicate)
+{
+	tracker_sparql_builder_delete_open (info->sparql, graph);
+	tracker_sparql_builder_subject_iri (info->sparql, info->urn);
+	tracker_sparql_builder_predicate (info->sparql, predicate);
+	tracker_sparql_builder_object_variable (info->sparql, "unknown");
+	tracker_sparql_builder_delete_close (info->sparql);
+}
+
+/* Runs in the extraction threads, returns the URNs of
+ * the artists inserted.
+ *
+ * With @previous, the metadata last written along with
+ * @previous_key and @previous_hash, only the properties
+ * that changed since are deleted and inserted. Otherwise
+ * everything is.
+ */
+static GPtrArray *
+file_info_extract (FileInfo    *info,
+                   TmmMetadata *metadata,
+                   TmmMetadata *previous,
+                   const gchar *previous_key,
+                   const gchar *previous_hash)
+{
+	GPtrArray *directors, *producers, *actors, *inserted;
+	gboolean title_changed, date_changed, synopsis_changed;
+	gboolean episode_changed, rating_changed, runtime_changed, genre_changed;
+	gboolean directors_changed, producers_changed, actors_changed;
+	gboolean key_changed, hash_changed;
+	GHashTable *new_artists;
+	guint i;
+
+	title_changed = !previous || g_strcmp0 (previous->title, metadata->title) != 0;
+	date_changed = !previous || previous->release_date != metadata->release_date;
+	synopsis_changed = !previous || g_strcmp0 (previous->synopsis, metadata->synopsis) != 0;
+	episode_changed = (!previous ||
+	                   previous->is_episode != metadata->is_episode ||
+	                   previous->season != metadata->season ||
+	                   previous->episode != metadata->episode);
+	rating_changed = !previous || g_strcmp0 (previous->rating, metadata->rating) != 0;
+	runtime_changed = !previous || previous->runtime != metadata->runtime;
+	genre_changed = !previous || g_strcmp0 (previous->genre, metadata->genre) != 0;
+	directors_changed = !previous || !artists_equal (previous->directors, metadata->directors);
+	producers_changed = !previous || !artists_equal (previous->producers, metadata->producers);
+	actors_changed = !previous || !artists_equal (previous->actors, metadata->actors);
+	key_changed = !previous || g_strcmp0 (previous_key, info->lookup_key) != 0;
+	hash_changed = !previous || g_strcmp0 (previous_hash, info->hash) != 0;
+
+	new_artists = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                     (GDestroyNotify) g_free, NULL);
+	inserted = g_ptr_array_new_with_free_func ((GDestroyNotify) g_free);
+
+	directors = directors_changed ?
+		file_info_extract_artists (info, metadata->directors, new_artists) :
+		g_ptr_array_new ();
+	producers = producers_changed ?
+		file_info_extract_artists (info, metadata->producers, new_artists) :
+		g_ptr_array_new ();
+	actors = actors_changed ?
+		file_info_extract_artists (info, metadata->actors, new_artists) :
+		g_ptr_array_new ();
+
+	file_info_insert_artists (info, new_artists, inserted);
+	g_hash_table_unref (new_artists);
+
+	/* Delete previous data, to be replaced by new info. Titles and
+	 * dates might come from the file name, in any graph.
+	 */
+	if (previous ? title_changed : metadata->title != NULL)
+		file_info_delete_property (info, NULL, "nie:title");
+
+	if (previous ? date_changed : metadata->release_date > 0)
+		file_info_delete_property (info, NULL, "nie:contentCreated");
+
+	if (key_changed)
+		file_info_delete_property (info, TMM_GRAPH, "nie:identifier");
+
+	if (previous) {
+		if (synopsis_changed && previous->synopsis)
+			file_info_delete_property (info, TMM_GRAPH, "nmm:synopsis");
+
+		if (episode_changed && previous->is_episode) {
+			file_info_delete_property (info, TMM_GRAPH, "nmm:isSeries");
+			file_info_delete_property (info, TMM_GRAPH, "nmm:season");
+			file_info_delete_property (info, TMM_GRAPH, "nmm:episodeNumber");
+		}
+
+		if (rating_changed && previous->rating)
+			file_info_delete_property (info, TMM_GRAPH, "nmm:MPAARating");
+
+		if (runtime_changed && previous->runtime >= 0)
+			file_info_delete_property (info, TMM_GRAPH, "nmm:runTime");
+
+		if (genre_changed && previous->genre)
+			file_info_delete_property (info, TMM_GRAPH, "nmm:genre");
+
+		if (directors_changed && previous->directors->len > 0)
+			file_info_delete_property (info, TMM_GRAPH, "nmm:director");
+
+		if (producers_changed && previous->producers->len > 0)
+			file_info_delete_property (info, TMM_GRAPH, "nmm:producedBy");
+
+		if (actors_changed && previous->actors->len > 0)
+			file_info_delete_property (info, TMM_GRAPH, "nmm:leadActor");
 	}
 
-	/* Delete previous data, to be replaced by new info */
-	if (title) {
-		tracker_sparql_builder_delete_open (info->sparql, NULL);
-		tracker_sparql_builder_subject_iri (info->sparql, info->urn);
-		tracker_sparql_builder_predicate (info->sparql, "nie:title");
-		tracker_sparql_builder_object_variable (info->sparql, "unknown");
+	if (hash_changed && (previous ? previous_hash : info->hash)) {
+		tracker_sparql_builder_delete_open (info->sparql, TMM_GRAPH);
+		tracker_sparql_builder_subject_variable (info->sparql, "hash");
+		tracker_sparql_builder_predicate (info->sparql, "a");
+		tracker_sparql_builder_object (info->sparql, "rdfs:Resource");
 		tracker_sparql_builder_delete_close (info->sparql);
-	}
 
-	if (creation_time > 0) {
-		tracker_sparql_builder_delete_open (info->sparql, NULL);
+		tracker_sparql_builder_where_open (info->sparql);
 		tracker_sparql_builder_subject_iri (info->sparql, info->urn);
-		tracker_sparql_builder_predicate (info->sparql, "nie:contentCreated");
-		tracker_sparql_builder_object_variable (info->sparql, "unknown");
-		tracker_sparql_builder_delete_close (info->sparql);
+		tracker_sparql_builder_predicate (info->sparql, "nfo:hasHash");
+		tracker_sparql_builder_object_variable (info->sparql, "hash");
+		tracker_sparql_builder_subject_variable (info->sparql, "hash");
+		tracker_sparql_builder_predicate (info->sparql, "nfo:hashAlgorithm");
+		tracker_sparql_builder_object_string (info->sparql, TMM_HASH_ALGORITHM);
+		tracker_sparql_builder_where_close (info->sparql);
 	}
 
 	tracker_sparql_builder_insert_open (info->sparql, NULL);
 	tracker_sparql_builder_graph_open (info->sparql, TMM_GRAPH);
 	tracker_sparql_builder_subject_iri (info->sparql, info->urn);
 
-	/* Data source */
-	tracker_sparql_builder_predicate (info->sparql, "a");
-	tracker_sparql_builder_object (info->sparql, "nmm:Video");
+	if (!previous) {
+		tracker_sparql_builder_predicate (info->sparql, "a");
+		tracker_sparql_builder_object (info->sparql, "nmm:Video");
+	}
 
+	/* Data source, marks the item as processed even if
+	 * nothing else changed.
+	 */
 	tracker_sparql_builder_predicate (info->sparql, "nie:dataSource");
 	tracker_sparql_builder_object_iri (info->sparql,
 	                                   tracker_decorator_get_data_source (TRACKER_DECORATOR (info->decorator)));
 
-	if (title) {
+	/* Lets other copies of the same title find this one */
+	if (key_changed) {
+		tracker_sparql_builder_predicate (info->sparql, "nie:identifier");
+		tracker_sparql_builder_object_string (info->sparql, info->lookup_key);
+	}
+
+	if (title_changed && metadata->title) {
 		tracker_sparql_builder_predicate (info->sparql, "nie:title");
-		tracker_sparql_builder_object_string (info->sparql, title);
+		tracker_sparql_builder_object_string (info->sparql, metadata->title);
 	}
 
-	if (creation_time > 0) {
+	if (date_changed && metadata->release_date > 0) {
 		tracker_sparql_builder_predicate (info->sparql, "nie:contentCreated");
-		sparql_builder_object_time (info->sparql, creation_time);
+		sparql_builder_object_time (info->sparql, metadata->release_date);
 	}
 
 	/* Text/synopsis */
-	value = gdata_freebase_topic_object_get_property_value (root, "/common/topic/description", 0);
-	tracker_sparql_builder_predicate (info->sparql, "nmm:synopsis");
-	tracker_sparql_builder_object_string (info->sparql,
-	                                      gdata_freebase_topic_value_get_string (value));
+	if (synopsis_changed && metadata->synopsis) {
+		tracker_sparql_builder_predicate (info->sparql, "nmm:synopsis");
+		tracker_sparql_builder_object_string (info->sparql, metadata->synopsis);
+	}
 
-	if (file_info_is_episode (info)) {
-		tracker_sparql_builder_predicate (info->sparql, "nmm:isSeries");
-		tracker_sparql_builder_object_boolean (info->sparql, TRUE);
-
-		value = gdata_freebase_topic_object_get_property_value (root, "/tv/tv_series_episode/season_number", 0);
-		tracker_sparql_builder_predicate (info->sparql, "nmm:season");
-		tracker_sparql_builder_object_int64 (info->sparql,
-		                                     (gint64) gdata_freebase_topic_value_get_double (value));
-
-		value = gdata_freebase_topic_object_get_property_value (root, "/tv/tv_series_episode/episode_number", 0);
-		tracker_sparql_builder_predicate (info->sparql, "nmm:episodeNumber");
-		tracker_sparql_builder_object_int64 (info->sparql,
-		                                     (gint64) gdata_freebase_topic_value_get_double (value));
+	if (metadata->is_episode) {
+		if (episode_changed) {
+			tracker_sparql_builder_predicate (info->sparql, "nmm:isSeries");
+			tracker_sparql_builder_object_boolean (info->sparql, TRUE);
+
+			tracker_sparql_builder_predicate (info->sparql, "nmm:season");
+			tracker_sparql_builder_object_int64 (info->sparql, metadata->season);
+
+			tracker_sparql_builder_predicate (info->sparql, "nmm:episodeNumber");
+			tracker_sparql_builder_object_int64 (info->sparql, metadata->episode);
+		}
 	} else {
 		/* MPAA rating */
-		value = gdata_freebase_topic_object_get_property_value (root, "/film/film/rating", 0);
-
-		if (value) {
+		if (rating_changed && metadata->rating) {
 			tracker_sparql_builder_predicate (info->sparql, "nmm:MPAARating");
-			tracker_sparql_builder_object_string (info->sparql,
-			                                      gdata_freebase_topic_value_get_text (value));
+			tracker_sparql_builder_object_string (info->sparql, metadata->rating);
 		}
 
 		/* Runtime */
-		value = gdata_freebase_topic_object_get_property_value (root, "/film/film/runtime", 0);
-		object = gdata_freebase_topic_value_get_object (value);
-		child_value = gdata_freebase_topic_object_get_property_value (object, "/film/film_cut/runtime", 0);
-		tracker_sparql_builder_predicate (info->sparql, "nmm:runTime");
-		tracker_sparql_builder_object_int64 (info->sparql,
-		                                     (gint64) gdata_freebase_topic_value_get_double (child_value));
-
-		/* Genre(s) */
-		for (i = 0; i < gdata_freebase_topic_object_get_property_count (root, "/film/film/genre"); i++) {
-			value = gdata_freebase_topic_object_get_property_value (root, "/film/film/genre", i);
-			tracker_sparql_builder_predicate (info->sparql, "nmm:genre");
-			tracker_sparql_builder_object_string (info->sparql,
-			                                      gdata_freebase_topic_value_get_text (value));
+		if (runtime_changed && metadata->runtime >= 0) {
+			tracker_sparql_builder_predicate (info->sparql, "nmm:runTime");
+			tracker_sparql_builder_object_int64 (info->sparql, metadata->runtime);
+		}
 
-			/* FIXME: nmm:genre cardinality is 1 */
-			break;
+		/* Genre */
+		if (genre_changed && metadata->genre) {
+			tracker_sparql_builder_predicate (info->sparql, "nmm:genre");
+			tracker_sparql_builder_object_string (info->sparql, metadata->genre);
 		}
 	}
 
 	/* Director(s) */
-	for (i = 0; directors && i < directors->len; i++) {
+	for (i = 0; i < directors->len; i++) {
 		tracker_sparql_builder_predicate (info->sparql, "nmm:director");
 		tracker_sparql_builder_object_iri (info->sparql, g_ptr_array_index (directors, i));
 	}
 
 	/* Producers(s) */
-	for (i = 0; producers && i < producers->len; i++) {
+	for (i = 0; i < producers->len; i++) {
 		tracker_sparql_builder_predicate (info->sparql, "nmm:producedBy");
 		tracker_sparql_builder_object_iri (info->sparql, g_ptr_array_index (producers, i));
 		/* FIXME: nmm:producedBy cardinality is 1 */
@@ -315,395 +924,2677 @@ file_info_extract (FileInfo                 *info,
 	}
 
 	/* Actors */
-	for (i = 0; actors && i < actors->len; i++) {
+	for (i = 0; i < actors->len; i++) {
 		tracker_sparql_builder_predicate (info->sparql, "nmm:leadActor");
 		tracker_sparql_builder_object_iri (info->sparql, g_ptr_array_index (actors, i));
 	}
 
-	gdata_freebase_topic_object_unref (root);
+	/* Lets the file be found again after a move or rename */
+	if (hash_changed && info->hash) {
+		tracker_sparql_builder_predicate (info->sparql, "nfo:hasHash");
+		tracker_sparql_builder_object (info->sparql, "_:hash");
+
+		tracker_sparql_builder_subject (info->sparql, "_:hash");
+		tracker_sparql_builder_predicate (info->sparql, "a");
+		tracker_sparql_builder_object (info->sparql, "nfo:FileHash");
+		tracker_sparql_builder_predicate (info->sparql, "nfo:hashValue");
+		tracker_sparql_builder_object_string (info->sparql, info->hash);
+		tracker_sparql_builder_predicate (info->sparql, "nfo:hashAlgorithm");
+		tracker_sparql_builder_object_string (info->sparql, TMM_HASH_ALGORITHM);
+	}
 
 	tracker_sparql_builder_graph_close (info->sparql);
-        tracker_sparql_builder_insert_close (info->sparql);
+	tracker_sparql_builder_insert_close (info->sparql);
 
-	g_clear_pointer (&directors, (GDestroyNotify) g_ptr_array_unref);
-	g_clear_pointer (&producers, (GDestroyNotify) g_ptr_array_unref);
-	g_clear_pointer (&actors, (GDestroyNotify) g_ptr_array_unref);
-}
+	g_ptr_array_unref (directors);
+	g_ptr_array_unref (producers);
+	g_ptr_array_unref (actors);
 
-static void decorator_get_next_item_cb (GObject      *object,
-                                        GAsyncResult *result,
-                                        gpointer      user_data);
+	return inserted;
+}
 
 static void
-file_info_topic_cb (GObject      *object,
-                    GAsyncResult *result,
-                    gpointer      user_data)
+extract_job_free (ExtractJob *job)
 {
-	GDataFreebaseTopicResult *topic_result;
-	FileInfo *info = user_data;
-	GError *error = NULL;
-
-	topic_result =
-		GDATA_FREEBASE_TOPIC_RESULT (gdata_service_query_single_entry_finish (GDATA_SERVICE (object),
-		                                                                      result, &error));
-	if (error) {
-		gchar *uri;
-
-		uri = g_file_get_uri (info->file);
-		g_warning ("Could not lookup topic for '%s' (Freebase ID: %s)",
-		           uri, info->freebase_id);
-		g_free (uri);
-
-		file_info_fail (info, error);
-	} else {
-		g_debug ("Extracting info for '%s'", info->urn);
-		file_info_extract (info, topic_result);
-		g_object_unref (topic_result);
+	if (job->new_artists)
+		g_ptr_array_unref (job->new_artists);
+	g_variant_unref (job->metadata);
+	g_clear_pointer (&job->previous, g_variant_unref);
+	g_free (job);
+}
 
-		g_task_return_boolean (info->task, TRUE);
-	}
+static void
+pending_commit_free (PendingCommit *commit)
+{
+	g_free (commit->urn);
+	g_variant_unref (commit->metadata);
+	g_free (commit->lookup_key);
+	g_free (commit->hash);
+	g_free (commit->id);
+	g_ptr_array_unref (commit->new_artists);
+	g_free (commit);
+}
 
-	tracker_decorator_next (TRACKER_DECORATOR (info->decorator),
-	                        NULL, decorator_get_next_item_cb, NULL);
+/* Takes over the job's results */
+static PendingCommit *
+pending_commit_new (ExtractJob *job)
+{
+	PendingCommit *commit;
+	FileInfo *info = job->info;
+
+	commit = g_new0 (PendingCommit, 1);
+	commit->urn = g_strdup (info->urn);
+	commit->hash = g_strdup (info->hash);
+	commit->id = g_strdup (info->id);
+	commit->metadata = g_variant_ref (job->metadata);
+	commit->lookup_key = g_strdup (info->lookup_key);
+	commit->new_artists = job->new_artists;
+	job->new_artists = NULL;
+
+	commit->schedule = !info->sidecar || !info->sidecar->metadata;
+	commit->confidence = job->confidence;
+	commit->release_date = job->release_date;
+
+	return commit;
 }
 
 static void
-file_info_get_topic (FileInfo *info)
+tmm_decorator_apply_commit (TmmDecorator  *decorator,
+                            PendingCommit *commit)
 {
-	GDataFreebaseTopicQuery *topic_query;
 	TmmDecoratorPrivate *priv;
+	guint i;
 
-	g_assert (info->freebase_id);
-	priv = tmm_decorator_get_instance_private (info->decorator);
-
-	g_debug ("Item '%s' being queried as '%s'",
-	         info->title, info->freebase_id);
-
-	topic_query = gdata_freebase_topic_query_new (info->freebase_id);
-	gdata_freebase_service_get_topic_async (priv->freebase_service,
-	                                        topic_query,
-	                                        priv->cancellable,
-	                                        file_info_topic_cb,
-	                                        info);
-	g_object_unref (topic_query);
-}
+	priv = tmm_decorator_get_instance_private (decorator);
 
-static gchar *
-variant_extract_id (GVariant *variant)
-{
-	GVariantIter iter;
-	gchar *id = NULL;
-	GVariant *value;
-	gchar *key;
+	/* Only marked as known once the INSERT is in the store, so
+	 * items extracted in the meantime insert them again rather
+	 * than referencing artists that might never make it there.
+	 */
+	g_mutex_lock (&priv->known_artists_lock);
 
-	g_variant_iter_init (&iter, variant);
+	for (i = 0; i < commit->new_artists->len &&
+	     g_hash_table_size (priv->known_artists) < MAX_KNOWN_ARTISTS; i++) {
+		g_hash_table_add (priv->known_artists,
+		                  g_strdup (g_ptr_array_index (commit->new_artists, i)));
+	}
 
-	if (g_variant_iter_n_children (&iter) == 0)
-		return NULL;
+	g_mutex_unlock (&priv->known_artists_lock);
 
-	while (g_variant_iter_loop (&iter, "{sv}", &key, &value)) {
-		if (strcmp (key, "id") != 0)
-			continue;
+	tmm_cache_insert (priv->cache, TMM_CACHE_WRITTEN, commit->urn,
+	                  g_variant_new ("(vss)", commit->metadata, commit->lookup_key,
+	                                 commit->hash ? commit->hash : ""),
+	                  CACHE_TOPIC_TTL);
 
-		id = g_variant_dup_string (value, NULL);
+	if (commit->schedule) {
+		tmm_scheduler_record (priv->scheduler, commit->urn, commit->id,
+		                      commit->confidence, commit->release_date);
+	}
 
-		/* Free key/value, as we break the loop */
-		g_variant_unref (value);
-		g_free (key);
-		break;
+	if (commit->hash && commit->id) {
+		tmm_cache_insert (priv->cache, TMM_CACHE_HASHES, commit->hash,
+		                  g_variant_new_string (commit->id), CACHE_ID_TTL);
 	}
 
-	return id;
+	tmm_cache_remove (priv->cache, TMM_CACHE_JOURNAL, commit->urn);
+
+	if (tmm_cache_get_n_pending (priv->cache) >
+	    MAX (CACHE_MAX_PENDING, tmm_cache_get_n_saved (priv->cache) / 4))
+		tmm_cache_save_in_background (priv->cache);
 }
 
+/* Failed writes are only logged by TrackerDecorator, their
+ * items come back to the queue and get looked up again.
+ */
 static void
-mql_query_cb (GObject      *object,
-              GAsyncResult *result,
-              gpointer      user_data)
+tmm_decorator_expire_commits (TmmDecorator *decorator)
 {
-	GDataFreebaseResult *mql_result;
-	FileInfo *info = user_data;
-	GError *error = NULL;
-	GVariant *variant;
+	TmmDecoratorPrivate *priv;
+	PendingCommit *commit;
+	GHashTableIter iter;
+	gint64 now;
 
-	mql_result =
-		GDATA_FREEBASE_RESULT (gdata_service_query_single_entry_finish (GDATA_SERVICE (object),
-		                                                                result, &error));
+	priv = tmm_decorator_get_instance_private (decorator);
+	now = g_get_monotonic_time ();
+	g_hash_table_iter_init (&iter, priv->unconfirmed);
 
-	if (error) {
-		g_warning ("Could not perform MQL query to Freebase: %s", error->message);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &commit)) {
+		if (now - commit->commit_time < CONFIRM_TIMEOUT * G_USEC_PER_SEC)
+			continue;
 
-		file_info_fail (info, error);
-		tracker_decorator_next (TRACKER_DECORATOR (info->decorator),
-		                        NULL, decorator_get_next_item_cb, NULL);
-		return;
+		g_debug ("Update for '%s' not seen written to the store, "
+		         "it will be looked up again", commit->urn);
+		g_hash_table_iter_remove (&iter);
 	}
+}
 
-	variant = gdata_freebase_result_dup_variant (mql_result);
-	g_object_unref (mql_result);
-
-	info->freebase_id = variant_extract_id (variant);
-	g_variant_unref (variant);
+static void tmm_decorator_confirm_commits (TmmDecorator *decorator);
 
-	if (info->freebase_id) {
-		file_info_get_topic (info);
+static void
+confirm_query_finish (TmmDecorator *decorator)
+{
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	priv->confirming = FALSE;
+
+	tmm_decorator_expire_commits (decorator);
+	tmm_decorator_confirm_commits (decorator);
+	g_object_unref (decorator);
+}
+
+static void
+confirm_query_next_cb (GObject      *object,
+                       GAsyncResult *result,
+                       gpointer      user_data)
+{
+	TrackerSparqlCursor *cursor = TRACKER_SPARQL_CURSOR (object);
+	TmmDecorator *decorator = user_data;
+	TmmDecoratorPrivate *priv;
+	PendingCommit *commit;
+	GError *error = NULL;
+	const gchar *urn;
+
+	if (!tracker_sparql_cursor_next_finish (cursor, result, &error)) {
+		if (error) {
+			g_warning ("Could not check for written updates: %s",
+			           error->message);
+			g_error_free (error);
+		}
+
+		g_object_unref (cursor);
+		confirm_query_finish (decorator);
+		return;
+	}
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	urn = tracker_sparql_cursor_get_string (cursor, 0, NULL);
+	commit = g_hash_table_lookup (priv->unconfirmed, urn);
+
+	if (commit) {
+		g_hash_table_steal (priv->unconfirmed, urn);
+		tmm_decorator_apply_commit (decorator, commit);
+		pending_commit_free (commit);
+	}
+
+	tracker_sparql_cursor_next_async (cursor, NULL,
+	                                  confirm_query_next_cb, decorator);
+}
+
+static void
+confirm_query_cb (GObject      *object,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+	TrackerSparqlCursor *cursor;
+	TmmDecorator *decorator = user_data;
+	GError *error = NULL;
+
+	cursor = tracker_sparql_connection_query_finish (TRACKER_SPARQL_CONNECTION (object),
+	                                                 result, &error);
+	if (!cursor) {
+		g_warning ("Could not check for written updates: %s",
+		           error->message);
+		g_error_free (error);
+		confirm_query_finish (decorator);
+		return;
+	}
+
+	tracker_sparql_cursor_next_async (cursor, NULL,
+	                                  confirm_query_next_cb, decorator);
+}
+
+/* Turns the resource IDs the store signalled into URNs,
+ * the commits for those are applied.
+ */
+static void
+tmm_decorator_confirm_commits (TmmDecorator *decorator)
+{
+	TrackerSparqlConnection *conn;
+	TmmDecoratorPrivate *priv;
+	GString *ids;
+	gchar *sparql;
+	guint i;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+
+	if (priv->confirming || priv->confirm_ids->len == 0)
+		return;
+
+	if (g_hash_table_size (priv->unconfirmed) == 0) {
+		g_array_set_size (priv->confirm_ids, 0);
+		return;
+	}
+
+	ids = g_string_new (NULL);
+
+	for (i = 0; i < priv->confirm_ids->len; i++) {
+		g_string_append_printf (ids, "%s%d", i > 0 ? ", " : "",
+		                        g_array_index (priv->confirm_ids, gint, i));
+	}
+
+	g_array_set_size (priv->confirm_ids, 0);
+
+	sparql = g_strdup_printf ("SELECT ?urn { ?urn nie:dataSource <%s> "
+	                          "FILTER (tracker:id (?urn) IN (%s)) }",
+	                          tracker_decorator_get_data_source (TRACKER_DECORATOR (decorator)),
+	                          ids->str);
+
+	priv->confirming = TRUE;
+	conn = tracker_miner_get_connection (TRACKER_MINER (decorator));
+	tracker_sparql_connection_query_async (conn, sparql, NULL,
+	                                       confirm_query_cb,
+	                                       g_object_ref (decorator));
+	g_string_free (ids, TRUE);
+	g_free (sparql);
+}
+
+static void
+graph_updated_cb (GDBusConnection *connection,
+                  const gchar     *sender_name,
+                  const gchar     *object_path,
+                  const gchar     *interface_name,
+                  const gchar     *signal_name,
+                  GVariant        *parameters,
+                  gpointer         user_data)
+{
+	TmmDecorator *decorator = user_data;
+	TmmDecoratorPrivate *priv;
+	gint subject, predicate;
+	GVariant *inserts;
+	GVariantIter iter;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+
+	if (g_hash_table_size (priv->unconfirmed) == 0 ||
+	    !g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa(iiii)a(iiii))")))
+		return;
+
+	/* The class is matched by the subscription */
+	g_variant_get (parameters, "(&s@a(iiii)@a(iiii))",
+	               NULL, NULL, &inserts);
+	g_variant_iter_init (&iter, inserts);
+
+	while (g_variant_iter_next (&iter, "(iiii)", NULL, &subject, &predicate, NULL)) {
+		if (priv->data_source_property_id == 0 ||
+		    predicate == priv->data_source_property_id)
+			g_array_append_val (priv->confirm_ids, subject);
+	}
+
+	g_variant_unref (inserts);
+	tmm_decorator_confirm_commits (decorator);
+}
+
+static void
+data_source_property_next_cb (GObject      *object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+	TrackerSparqlCursor *cursor = TRACKER_SPARQL_CURSOR (object);
+	TmmDecorator *decorator = user_data;
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+
+	if (tracker_sparql_cursor_next_finish (cursor, result, NULL))
+		priv->data_source_property_id = tracker_sparql_cursor_get_integer (cursor, 0);
+
+	g_object_unref (cursor);
+	g_object_unref (decorator);
+}
+
+static void
+data_source_property_cb (GObject      *object,
+                         GAsyncResult *result,
+                         gpointer      user_data)
+{
+	TrackerSparqlCursor *cursor;
+
+	cursor = tracker_sparql_connection_query_finish (TRACKER_SPARQL_CONNECTION (object),
+	                                                 result, NULL);
+	if (!cursor) {
+		g_object_unref (user_data);
+		return;
+	}
+
+	tracker_sparql_cursor_next_async (cursor, NULL,
+	                                  data_source_property_next_cb, user_data);
+}
+
+/* TrackerDecorator writes the updates in batches, and doesn't tell
+ * whether those made it to the store. The store signals what was
+ * written though, items are only queued while they lack our
+ * nie:dataSource, so it being inserted is the proof. Until its
+ * property ID is known, any insert is checked.
+ */
+static void
+tmm_decorator_watch_updates (TmmDecorator *decorator)
+{
+	TrackerSparqlConnection *conn;
+	TmmDecoratorPrivate *priv;
+	GError *error = NULL;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+
+	if (priv->graph_updated_id)
+		return;
+
+	if (!priv->dbus_connection)
+		priv->dbus_connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+
+	if (!priv->dbus_connection) {
+		g_warning ("Could not watch for written updates: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	priv->graph_updated_id =
+		g_dbus_connection_signal_subscribe (priv->dbus_connection,
+		                                    STORE_BUS_NAME,
+		                                    STORE_INTERFACE,
+		                                    "GraphUpdated",
+		                                    STORE_PATH,
+		                                    VIDEO_CLASS,
+		                                    G_DBUS_SIGNAL_FLAGS_NONE,
+		                                    graph_updated_cb,
+		                                    decorator, NULL);
+
+	conn = tracker_miner_get_connection (TRACKER_MINER (decorator));
+	tracker_sparql_connection_query_async (conn,
+	                                       "SELECT tracker:id (?p) { ?p a rdf:Property "
+	                                       "FILTER (?p = nie:dataSource) }",
+	                                       NULL, data_source_property_cb,
+	                                       g_object_ref (decorator));
+}
+
+static gboolean
+extract_job_done_cb (gpointer user_data)
+{
+	ExtractJob *job = user_data;
+	TmmDecoratorPrivate *priv;
+	PendingCommit *commit;
+
+	priv = tmm_decorator_get_instance_private (job->info->decorator);
+
+	g_mutex_lock (&priv->extract_done_lock);
+	g_queue_remove (&priv->extract_done, job);
+	g_mutex_unlock (&priv->extract_done_lock);
+
+	tmm_histogram_add (priv->stage_latencies[STAGE_EXTRACT],
+	                   job->done_time - job->queue_time);
+
+	if (job->unchanged)
+		priv->n_unchanged++;
+
+	commit = pending_commit_new (job);
+
+	if (job->info->external) {
+		/* Waits for tmm_decorator_file_committed() */
+		g_hash_table_replace (priv->uncommitted, commit->urn, commit);
+	} else if (priv->graph_updated_id) {
+		/* Waits for tmm_decorator_confirm_commits() */
+		commit->commit_time = g_get_monotonic_time ();
+		g_hash_table_replace (priv->unconfirmed, commit->urn, commit);
+	} else {
+		tmm_decorator_apply_commit (job->info->decorator, commit);
+		pending_commit_free (commit);
+	}
+
+	g_task_return_boolean (job->info->task, TRUE);
+	file_info_finish (job->info);
+	extract_job_free (job);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+extract_job_run (gpointer data,
+                 gpointer user_data)
+{
+	TmmDecoratorPrivate *priv;
+	ExtractJob *job = data;
+	TmmMetadata *metadata, *previous = NULL;
+	const gchar *previous_key = NULL, *previous_hash = NULL;
+	GVariant *variant;
+
+	g_debug ("Extracting info for '%s'", job->info->urn);
+
+	if (job->previous) {
+		g_variant_get (job->previous, "(v&s&s)",
+		               &variant, &previous_key, &previous_hash);
+		previous = tmm_metadata_new_from_variant (variant);
+		g_variant_unref (variant);
+
+		if (previous_hash[0] == '\0')
+			previous_hash = NULL;
+	}
+
+	/* Nothing else touches the item's builder until
+	 * the task is returned from the main thread.
+	 */
+	metadata = tmm_metadata_new_from_variant (job->metadata);
+	job->new_artists = file_info_extract (job->info, metadata, previous,
+	                                      previous_key, previous_hash);
+	tmm_metadata_free (metadata);
+
+	if (previous)
+		tmm_metadata_free (previous);
+
+	job->done_time = g_get_monotonic_time ();
+
+	/* Tracked so finalization can drop the idles still pending */
+	priv = tmm_decorator_get_instance_private (job->info->decorator);
+	g_mutex_lock (&priv->extract_done_lock);
+	g_queue_push_tail (&priv->extract_done, job);
+	g_idle_add_full (G_PRIORITY_DEFAULT, extract_job_done_cb, job, NULL);
+	g_mutex_unlock (&priv->extract_done_lock);
+}
+
+/* Whether @job writes the same as the last time */
+static gboolean
+extract_job_is_unchanged (ExtractJob *job)
+{
+	const gchar *previous_key, *previous_hash;
+	GVariant *previous_metadata;
+	gboolean unchanged;
+
+	g_variant_get (job->previous, "(v&s&s)",
+	               &previous_metadata, &previous_key, &previous_hash);
+	unchanged = (g_variant_equal (previous_metadata, job->metadata) &&
+	             g_strcmp0 (previous_key, job->info->lookup_key) == 0 &&
+	             g_strcmp0 (previous_hash, job->info->hash ? job->info->hash : "") == 0);
+	g_variant_unref (previous_metadata);
+
+	return unchanged;
+}
+
+/* Falls back to writing everything */
+static void
+extract_job_forget_previous (ExtractJob *job)
+{
+	g_debug ("Item '%s' is not in the store as last written", job->info->urn);
+	g_clear_pointer (&job->previous, g_variant_unref);
+	job->unchanged = FALSE;
+}
+
+/* How likely the metadata is to be about the right title */
+static gdouble
+file_info_get_confidence (FileInfo *info,
+                          GVariant *metadata)
+{
+	gboolean is_episode;
+	gint64 release_date;
+	GDateTime *date;
+	gint year;
+
+	g_variant_get_child (metadata, 2, "x", &release_date);
+	g_variant_get_child (metadata, 3, "b", &is_episode);
+
+	/* Matched on series, season and episode number */
+	if (is_episode)
+		return 0.9;
+
+	if (info->year <= 0 || release_date <= 0) {
+		/* A bare title might have picked a remake, or worse */
+		return 0.5;
+	}
+
+	date = g_date_time_new_from_unix_utc (release_date);
+	year = g_date_time_get_year (date);
+	g_date_time_unref (date);
+
+	return ABS (year - info->year) <= 1 ? 0.9 : 0.2;
+}
+
+static void
+unchanged_check_next_cb (GObject      *object,
+                         GAsyncResult *result,
+                         gpointer      user_data)
+{
+	TrackerSparqlCursor *cursor = TRACKER_SPARQL_CURSOR (object);
+	ExtractJob *job = user_data;
+	FileInfo *info = job->info;
+	TmmDecoratorPrivate *priv;
+	const gchar *previous_key;
+	GError *error = NULL;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+
+	g_variant_get_child (job->previous, 1, "&s", &previous_key);
+
+	if (!tracker_sparql_cursor_next_finish (cursor, result, &error) ||
+	    g_strcmp0 (tracker_sparql_cursor_get_string (cursor, 0, NULL),
+	               previous_key) != 0)
+		extract_job_forget_previous (job);
+
+	g_object_unref (cursor);
+
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		extract_job_free (job);
+		file_info_fail (info, error);
+		file_info_finish (info);
+		return;
+	} else if (error) {
+		g_debug ("Could not check '%s' in the store: %s",
+		         info->urn, error->message);
+		g_error_free (error);
+	}
+
+	g_thread_pool_push (priv->extract_pool, job, NULL);
+}
+
+static void
+unchanged_check_cb (GObject      *object,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+	TrackerSparqlCursor *cursor;
+	ExtractJob *job = user_data;
+	FileInfo *info = job->info;
+	TmmDecoratorPrivate *priv;
+	GError *error = NULL;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	cursor = tracker_sparql_connection_query_finish (TRACKER_SPARQL_CONNECTION (object),
+	                                                 result, &error);
+
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		extract_job_free (job);
+		file_info_fail (info, error);
+		file_info_finish (info);
+		return;
+	}
+
+	if (!cursor) {
+		g_debug ("Could not check '%s' in the store: %s",
+		         info->urn, error->message);
+		g_error_free (error);
+		extract_job_forget_previous (job);
+		g_thread_pool_push (priv->extract_pool, job, NULL);
+		return;
+	}
+
+	tracker_sparql_cursor_next_async (cursor, file_info_get_cancellable (info),
+	                                  unchanged_check_next_cb, job);
+}
+
+/* The cache only tells what was last written, the store might
+ * have lost it since (e.g. reset, or the item deleted and added
+ * back). The identifier is checked to still be there before only
+ * the changes are written.
+ */
+static void
+file_info_check_previous (FileInfo   *info,
+                           ExtractJob *job)
+{
+	TrackerSparqlConnection *conn;
+	gchar *query;
+
+	conn = tracker_miner_get_connection (TRACKER_MINER (info->decorator));
+	query = g_strdup_printf ("SELECT ?id { GRAPH <%s> { <%s> nie:identifier ?id } }",
+	                         TMM_GRAPH, info->urn);
+
+	tracker_sparql_connection_query_async (conn, query,
+	                                       file_info_get_cancellable (info),
+	                                       unchanged_check_cb, job);
+	g_free (query);
+}
+
+/* @metadata is a TmmMetadata variant */
+static void
+file_info_complete (FileInfo *info,
+                    GVariant *metadata)
+{
+	TmmDecoratorPrivate *priv;
+	ExtractJob *job;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+
+	job = g_new0 (ExtractJob, 1);
+	job->info = info;
+	job->metadata = g_variant_ref (metadata);
+	job->queue_time = g_get_monotonic_time ();
+	job->confidence = file_info_get_confidence (info, job->metadata);
+	g_variant_get_child (job->metadata, 2, "x", &job->release_date);
+
+	/* Re-enriched, only what changed gets rewritten */
+	job->previous = tmm_cache_lookup (priv->cache, TMM_CACHE_WRITTEN, info->urn);
+
+	if (job->previous &&
+	    !g_variant_is_of_type (job->previous, G_VARIANT_TYPE ("(vss)")))
+		g_clear_pointer (&job->previous, g_variant_unref);
+
+	if (job->previous) {
+		job->unchanged = extract_job_is_unchanged (job);
+
+		if (tracker_miner_get_connection (TRACKER_MINER (info->decorator))) {
+			file_info_check_previous (info, job);
+			return;
+		}
+	}
+
+	g_thread_pool_push (priv->extract_pool, job, NULL);
+}
+
+/* Returns TRUE if @key found no results recently enough
+ * that it shouldn't be looked up again yet.
+ */
+static gboolean
+file_info_lookup_is_backed_off (FileInfo    *info,
+                                const gchar *key)
+{
+	TmmDecoratorPrivate *priv;
+	GVariant *cached;
+	gint64 retry_time = 0;
+	guint failures;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	cached = tmm_cache_lookup (priv->cache, TMM_CACHE_MISSES, key);
+
+	if (!cached)
+		return FALSE;
+
+	if (g_variant_is_of_type (cached, G_VARIANT_TYPE ("(ux)")))
+		g_variant_get (cached, "(ux)", &failures, &retry_time);
+
+	g_variant_unref (cached);
+
+	if (retry_time <= g_get_real_time () / G_USEC_PER_SEC)
+		return FALSE;
+
+	file_info_fail (info,
+	                g_error_new (TMM_DECORATOR_ERROR,
+	                             TMM_DECORATOR_ERROR_BACKED_OFF,
+	                             "Lookup for '%s' found nothing %u time(s), "
+	                             "not retrying yet", key, failures));
+	file_info_finish (info);
+
+	return TRUE;
+}
+
+/* Records that @key found no results, each failure
+ * doubles the time until it's looked up again.
+ */
+static void
+tmm_decorator_lookup_missed (TmmDecorator *decorator,
+                             const gchar  *key)
+{
+	TmmDecoratorPrivate *priv;
+	gint64 backoff, retry_time;
+	GVariant *cached;
+	guint failures = 0;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	cached = tmm_cache_lookup (priv->cache, TMM_CACHE_MISSES, key);
+
+	if (cached) {
+		if (g_variant_is_of_type (cached, G_VARIANT_TYPE ("(ux)")))
+			g_variant_get (cached, "(ux)", &failures, NULL);
+		g_variant_unref (cached);
+	}
+
+	failures++;
+	backoff = (gint64) MISS_BACKOFF_MIN << MIN (failures - 1, 16);
+	backoff = MIN (backoff, MISS_BACKOFF_MAX);
+	retry_time = g_get_real_time () / G_USEC_PER_SEC + backoff;
+
+	g_debug ("Lookup for '%s' found nothing, retrying in %" G_GINT64_FORMAT " seconds",
+	         key, backoff);
+
+	/* Keep the failure count around for longer than the backoff */
+	tmm_cache_insert (priv->cache, TMM_CACHE_MISSES, key,
+	                  g_variant_new ("(ux)", failures, retry_time),
+	                  2 * MISS_BACKOFF_MAX);
+}
+
+/* Returns TRUE if a lookup for @key is already in flight, @info
+ * will then get the result of that one. Otherwise the caller is
+ * expected to start the lookup.
+ */
+static gboolean
+pending_lookups_add (GHashTable  *pending,
+                     const gchar *key,
+                     FileInfo    *info)
+{
+	GPtrArray *waiters;
+
+	waiters = g_hash_table_lookup (pending, key);
+
+	if (waiters) {
+		g_ptr_array_add (waiters, info);
+		return TRUE;
+	}
+
+	waiters = g_ptr_array_new ();
+	g_ptr_array_add (waiters, info);
+	g_hash_table_insert (pending, g_strdup (key), waiters);
+
+	return FALSE;
+}
+
+static GPtrArray *
+pending_lookups_steal (GHashTable  *pending,
+                       const gchar *key)
+{
+	GPtrArray *waiters;
+
+	waiters = g_ptr_array_ref (g_hash_table_lookup (pending, key));
+	g_hash_table_remove (pending, key);
+
+	return waiters;
+}
+
+/* Backend requests are paced by the throttle, @send_func
+ * is called once the request for @info may be sent.
+ */
+static void
+file_info_request (FileInfo        *info,
+                   TmmThrottleFunc  send_func)
+{
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	priv->n_requests++;
+	info->request_time = g_get_monotonic_time ();
+	tmm_throttle_submit (priv->throttle, send_func, info);
+}
+
+/* Called by the send functions, once out of the throttle */
+static void
+file_info_request_sent (FileInfo *info)
+{
+	TmmDecoratorPrivate *priv;
+	gint64 now;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	now = g_get_monotonic_time ();
+
+	tmm_histogram_add (priv->stage_latencies[STAGE_THROTTLE],
+	                   now - info->request_time);
+	info->request_time = now;
+}
+
+/* A miss is an answer from the backend, only transport errors
+ * and timeouts tell it's overloaded.
+ */
+static TmmThrottleResult
+throttle_result (const GError *error)
+{
+	if (!error || g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+		return TMM_THROTTLE_SUCCESS;
+	else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		return TMM_THROTTLE_CANCELLED;
+	else
+		return TMM_THROTTLE_FAILURE;
+}
+
+/* Backend requests have a deadline, and are hedged once past
+ * the 95th percentile latency of @stage. Hedges skip the throttle,
+ * so they are only sent while it has nothing queued.
+ */
+static void
+tmm_decorator_send_request (TmmDecorator        *decorator,
+                            Stage                stage,
+                            TmmRequestSendFunc   send_func,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+	TmmDecoratorPrivate *priv;
+	TmmHistogram *histogram;
+	guint hedge_delay = 0;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	histogram = priv->stage_latencies[stage];
+
+	if (tmm_histogram_get_count (histogram) >= HEDGE_MIN_SAMPLES &&
+	    tmm_throttle_get_n_queued (priv->throttle) == 0) {
+		hedge_delay = tmm_histogram_get_percentile (histogram, 0.95) / 1000;
+		hedge_delay = MAX (hedge_delay, 1);
+	}
+
+	tmm_request_send (G_OBJECT (priv->backend), send_func,
+	                  cancellable, priv->request_timeout,
+	                  hedge_delay, callback, user_data);
+}
+
+/* Called by the send functions, for each attempt at a request */
+static void
+tmm_decorator_attempt_sent (TmmDecorator *decorator,
+                            guint         attempt)
+{
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+
+	if (attempt > 0) {
+		priv->n_requests++;
+		priv->n_hedged_requests++;
+	}
+}
+
+static void
+file_info_request_done (FileInfo     *info,
+                        Stage         stage,
+                        const GError *error)
+{
+	TmmDecoratorPrivate *priv;
+	gint64 latency;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	latency = g_get_monotonic_time () - info->request_time;
+	tmm_histogram_add (priv->stage_latencies[stage], latency);
+	tmm_throttle_complete (priv->throttle, throttle_result (error), latency);
+}
+
+/* Hands a topic to every item waiting on it, takes
+ * ownership of @error.
+ */
+static void
+file_info_resolve_topic (FileInfo    *info,
+                         TmmMetadata *metadata,
+                         GError      *error)
+{
+	TmmDecoratorPrivate *priv;
+	GPtrArray *waiters;
+	GVariant *variant;
+	guint i;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	waiters = pending_lookups_steal (priv->pending_topics, info->id);
+
+	if (error) {
+		gchar *uri;
+
+		uri = g_file_get_uri (info->file);
+		g_warning ("Could not lookup topic for '%s' (ID: %s): %s",
+		           uri, info->id, error->message);
+		g_free (uri);
+
+		for (i = 0; i < waiters->len; i++) {
+			FileInfo *waiter = g_ptr_array_index (waiters, i);
+
+			file_info_fail (waiter, g_error_copy (error));
+			file_info_finish (waiter);
+		}
+
+		g_error_free (error);
+		g_ptr_array_unref (waiters);
+		return;
+	}
+
+	variant = g_variant_ref_sink (tmm_metadata_to_variant (metadata));
+
+	tmm_cache_insert (priv->cache, TMM_CACHE_TOPICS, info->id,
+	                  variant, CACHE_TOPIC_TTL);
+
+	for (i = 0; i < waiters->len; i++)
+		file_info_complete (g_ptr_array_index (waiters, i), variant);
+
+	g_variant_unref (variant);
+	g_ptr_array_unref (waiters);
+}
+
+static void
+file_info_topic_cb (GObject      *object,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+	FileInfo *info = user_data;
+	TmmMetadata *metadata;
+	GError *error = NULL;
+
+	metadata = tmm_backend_get_topic_finish (TMM_BACKEND (object), result, &error);
+	file_info_request_done (info, STAGE_TOPIC, error);
+	file_info_resolve_topic (info, metadata, error);
+
+	if (metadata)
+		tmm_metadata_free (metadata);
+}
+
+static void
+topic_send (GCancellable        *cancellable,
+            guint                attempt,
+            GAsyncReadyCallback  callback,
+            gpointer             callback_data,
+            gpointer             user_data)
+{
+	FileInfo *info = user_data;
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	tmm_decorator_attempt_sent (info->decorator, attempt);
+
+	tmm_backend_get_topic (priv->backend, info->id,
+	                       file_info_is_episode (info),
+	                       cancellable, callback, callback_data);
+}
+
+static void
+file_info_send_topic_request (FileInfo *info)
+{
+	file_info_request_sent (info);
+	tmm_decorator_send_request (info->decorator, STAGE_TOPIC, topic_send,
+	                            file_info_get_cancellable (info),
+	                            file_info_topic_cb, info);
+}
+
+static void
+topic_batch_free (TopicBatch *batch)
+{
+	g_ptr_array_unref (batch->infos);
+	g_free (batch);
+}
+
+static void
+topic_batch_cb (GObject      *object,
+                GAsyncResult *result,
+                gpointer      user_data)
+{
+	TopicBatch *batch = user_data;
+	TmmDecoratorPrivate *priv;
+	GHashTable *topics_by_id;
+	TmmMetadata *metadata;
+	GError *error = NULL;
+	GPtrArray *topics;
+	gint64 latency;
+	guint i;
+
+	topics = tmm_backend_get_topics_finish (TMM_BACKEND (object), result, &error);
+	priv = tmm_decorator_get_instance_private (batch->decorator);
+
+	latency = g_get_monotonic_time () - batch->request_time;
+	tmm_histogram_add (priv->stage_latencies[STAGE_TOPIC], latency);
+	tmm_throttle_complete (priv->throttle, throttle_result (error), latency);
+
+	if (error) {
+		for (i = 0; i < batch->infos->len; i++)
+			file_info_resolve_topic (g_ptr_array_index (batch->infos, i),
+			                         NULL, g_error_copy (error));
+		g_error_free (error);
+		topic_batch_free (batch);
+		return;
+	}
+
+	topics_by_id = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (i = 0; i < topics->len; i++) {
+		metadata = g_ptr_array_index (topics, i);
+		g_hash_table_insert (topics_by_id, metadata->id, metadata);
+	}
+
+	for (i = 0; i < batch->infos->len; i++) {
+		FileInfo *info = g_ptr_array_index (batch->infos, i);
+
+		metadata = g_hash_table_lookup (topics_by_id, info->id);
+
+		if (metadata) {
+			file_info_resolve_topic (info, metadata, NULL);
+		} else {
+			/* Missing from the reply, the single lookup
+			 * tells whether it exists at all.
+			 */
+			file_info_request (info, (TmmThrottleFunc) file_info_send_topic_request);
+		}
+	}
+
+	g_hash_table_unref (topics_by_id);
+	g_ptr_array_unref (topics);
+	topic_batch_free (batch);
+}
+
+static void
+topic_batch_attempt_send (GCancellable        *cancellable,
+                          guint                attempt,
+                          GAsyncReadyCallback  callback,
+                          gpointer             callback_data,
+                          gpointer             user_data)
+{
+	TopicBatch *batch = user_data;
+	TmmDecoratorPrivate *priv;
+	GPtrArray *ids;
+	guint i;
+
+	priv = tmm_decorator_get_instance_private (batch->decorator);
+	tmm_decorator_attempt_sent (batch->decorator, attempt);
+
+	ids = g_ptr_array_new ();
+
+	for (i = 0; i < batch->infos->len; i++) {
+		FileInfo *info = g_ptr_array_index (batch->infos, i);
+
+		g_ptr_array_add (ids, info->id);
+	}
+
+	g_ptr_array_add (ids, NULL);
+
+	tmm_backend_get_topics (priv->backend,
+	                        (const gchar * const *) ids->pdata,
+	                        batch->is_episode,
+	                        cancellable, callback, callback_data);
+	g_ptr_array_unref (ids);
+}
+
+/* Batches mixing both kinds of items go on while paused */
+static GCancellable *
+topic_batch_get_cancellable (TopicBatch *batch)
+{
+	TmmDecoratorPrivate *priv;
+	guint i;
+
+	priv = tmm_decorator_get_instance_private (batch->decorator);
+
+	for (i = 0; i < batch->infos->len; i++) {
+		FileInfo *info = g_ptr_array_index (batch->infos, i);
+
+		if (info->external)
+			return priv->external_cancellable;
+	}
+
+	return priv->cancellable;
+}
+
+static void
+topic_batch_send (TopicBatch *batch)
+{
+	TmmDecoratorPrivate *priv;
+	gint64 now;
+
+	priv = tmm_decorator_get_instance_private (batch->decorator);
+	now = g_get_monotonic_time ();
+
+	tmm_histogram_add (priv->stage_latencies[STAGE_THROTTLE],
+	                   now - batch->request_time);
+	batch->request_time = now;
+
+	tmm_decorator_send_request (batch->decorator, STAGE_TOPIC,
+	                            topic_batch_attempt_send,
+	                            topic_batch_get_cancellable (batch),
+	                            topic_batch_cb, batch);
+}
+
+/* Single IDs go through the plain topic lookup */
+static void
+tmm_decorator_submit_topic_batch (TmmDecorator *decorator,
+                                  gboolean      is_episode)
+{
+	TmmDecoratorPrivate *priv;
+	TopicBatch *batch;
+	FileInfo *info;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	batch = priv->topic_batches[is_episode];
+	priv->topic_batches[is_episode] = NULL;
+
+	if (!batch)
+		return;
+
+	if (batch->infos->len == 1) {
+		info = g_ptr_array_index (batch->infos, 0);
+		file_info_request (info, (TmmThrottleFunc) file_info_send_topic_request);
+		topic_batch_free (batch);
+		return;
+	}
+
+	g_debug ("Querying %u topics at once", batch->infos->len);
+
+	priv->n_requests++;
+	batch->request_time = g_get_monotonic_time ();
+	tmm_throttle_submit (priv->throttle, (TmmThrottleFunc) topic_batch_send, batch);
+}
+
+static gboolean
+submit_topic_batches_cb (gpointer user_data)
+{
+	TmmDecorator *decorator = user_data;
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	priv->topic_batch_id = 0;
+
+	tmm_decorator_submit_topic_batch (decorator, FALSE);
+	tmm_decorator_submit_topic_batch (decorator, TRUE);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+file_info_batch_topic (FileInfo *info)
+{
+	TmmDecoratorPrivate *priv;
+	gboolean is_episode;
+	TopicBatch *batch;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	is_episode = file_info_is_episode (info);
+	batch = priv->topic_batches[is_episode];
+
+	if (!batch) {
+		batch = g_new0 (TopicBatch, 1);
+		batch->decorator = info->decorator;
+		batch->is_episode = is_episode;
+		batch->infos = g_ptr_array_new ();
+		priv->topic_batches[is_episode] = batch;
+	}
+
+	g_ptr_array_add (batch->infos, info);
+
+	if (batch->infos->len >= TOPIC_BATCH_SIZE) {
+		tmm_decorator_submit_topic_batch (info->decorator, is_episode);
+	} else if (!priv->topic_batch_id) {
+		priv->topic_batch_id = g_timeout_add (TOPIC_BATCH_DELAY,
+		                                      submit_topic_batches_cb,
+		                                      info->decorator);
+	}
+}
+
+static void
+file_info_get_topic (FileInfo *info)
+{
+	TmmDecoratorPrivate *priv;
+	GVariant *cached;
+
+	g_assert (info->id);
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	file_info_save_progress (info);
+
+	if (!info->refresh)
+		cached = tmm_cache_lookup (priv->cache, TMM_CACHE_TOPICS, info->id);
+	else
+		cached = NULL;
+
+	if (cached && tmm_metadata_variant_is_valid (cached)) {
+		g_debug ("Item '%s' found in cache as '%s'",
+		         info->title, info->id);
+		file_info_complete (info, cached);
+		g_variant_unref (cached);
+		return;
+	}
+
+	g_clear_pointer (&cached, g_variant_unref);
+
+	if (pending_lookups_add (priv->pending_topics, info->id, info)) {
+		g_debug ("Item '%s' waiting on topic '%s' already being queried",
+		         info->title, info->id);
+		return;
+	}
+
+	g_debug ("Item '%s' being queried as '%s'",
+	         info->title, info->id);
+
+	file_info_batch_topic (info);
+}
+
+/* Hands the result of a search to every item waiting on it,
+ * takes ownership of @error.
+ */
+static void
+file_info_resolve_id (FileInfo    *info,
+                      const gchar *id,
+                      GError      *error)
+{
+	TmmDecoratorPrivate *priv;
+	GPtrArray *waiters;
+	guint i;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	waiters = pending_lookups_steal (priv->pending_searches, info->lookup_key);
+
+	if (id) {
+		tmm_cache_insert (priv->cache, TMM_CACHE_IDS, info->lookup_key,
+		                  g_variant_new_string (id), CACHE_ID_TTL);
+	}
+
+	for (i = 0; i < waiters->len; i++) {
+		FileInfo *waiter = g_ptr_array_index (waiters, i);
+
+		if (id) {
+			waiter->id = g_strdup (id);
+			file_info_get_topic (waiter);
+		} else {
+			file_info_fail (waiter, g_error_copy (error));
+			file_info_finish (waiter);
+		}
+	}
+
+	g_ptr_array_unref (waiters);
+	g_clear_error (&error);
+}
+
+static void
+search_film_cb (GObject      *object,
+                GAsyncResult *result,
+                gpointer      user_data)
+{
+	FileInfo *info = user_data;
+	GError *error = NULL;
+	gchar *id;
+
+	id = tmm_backend_search_film_finish (TMM_BACKEND (object), result, &error);
+	file_info_request_done (info, STAGE_SEARCH, error);
+
+	if (error) {
+		g_warning ("Could not search for film: %s", error->message);
+		file_info_resolve_id (info, NULL, error);
+		return;
+	}
+
+	if (id) {
+		file_info_resolve_id (info, id, NULL);
+	} else {
+		gchar *uri;
+
+		uri = g_file_get_uri (info->file);
+		g_debug ("Found no search results for '%s'", uri);
+		g_free (uri);
+
+		tmm_decorator_lookup_missed (info->decorator, info->lookup_key);
+
+		error = g_error_new (TMM_DECORATOR_ERROR,
+		                     TMM_DECORATOR_ERROR_NOT_FOUND,
+		                     "No result items");
+		file_info_resolve_id (info, NULL, error);
+	}
+
+	g_free (id);
+}
+
+/* Caches every episode in a season, both as a topic
+ * and as the ID for its lookup key.
+ */
+static void
+file_info_cache_season (FileInfo  *info,
+                        GPtrArray *episodes)
+{
+	TmmDecoratorPrivate *priv;
+	TmmMetadata *metadata;
+	gchar *key;
+	guint i;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+
+	for (i = 0; i < episodes->len; i++) {
+		metadata = g_ptr_array_index (episodes, i);
+
+		key = lookup_key_new (info->title, 0, metadata->season, metadata->episode);
+		tmm_cache_insert (priv->cache, TMM_CACHE_IDS, key,
+		                  g_variant_new_string (metadata->id), CACHE_ID_TTL);
+		tmm_cache_insert (priv->cache, TMM_CACHE_TOPICS, metadata->id,
+		                  tmm_metadata_to_variant (metadata), CACHE_TOPIC_TTL);
+		g_free (key);
+	}
+}
+
+static void
+season_query_cb (GObject      *object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+	FileInfo *info = user_data;
+	TmmDecorator *decorator = info->decorator;
+	gboolean season_found = FALSE;
+	TmmDecoratorPrivate *priv;
+	GError *error = NULL;
+	GPtrArray *waiters, *episodes;
+	gchar *season_key;
+	guint i;
+
+	episodes = tmm_backend_get_season_finish (TMM_BACKEND (object), result, &error);
+	file_info_request_done (info, STAGE_SEASON, error);
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	season_key = lookup_key_new (info->title, 0, info->season, 0);
+	waiters = pending_lookups_steal (priv->pending_seasons, season_key);
+
+	if (error) {
+		g_warning ("Could not look up season: %s", error->message);
+	} else {
+		file_info_cache_season (info, episodes);
+		season_found = episodes->len > 0;
+		g_ptr_array_unref (episodes);
+
+		if (!season_found)
+			tmm_decorator_lookup_missed (decorator, season_key);
+	}
+
+	g_free (season_key);
+
+	/* Every sibling episode is in the cache now, if known at all.
+	 * Waiters are freed as they finish, @info being one of them.
+	 */
+	for (i = 0; i < waiters->len; i++) {
+		FileInfo *waiter = g_ptr_array_index (waiters, i);
+		GVariant *cached = NULL;
+
+		if (!error)
+			cached = tmm_cache_lookup (priv->cache, TMM_CACHE_IDS, waiter->lookup_key);
+
+		if (cached) {
+			waiter->id = g_variant_dup_string (cached, NULL);
+			g_variant_unref (cached);
+
+			file_info_get_topic (waiter);
+		} else if (error) {
+			file_info_fail (waiter, g_error_copy (error));
+			file_info_finish (waiter);
+		} else {
+			/* The season exists, but not this episode */
+			if (season_found)
+				tmm_decorator_lookup_missed (decorator, waiter->lookup_key);
+
+			file_info_fail (waiter,
+			                g_error_new (TMM_DECORATOR_ERROR,
+			                             TMM_DECORATOR_ERROR_NOT_FOUND,
+			                             "Episode not found in season"));
+			file_info_finish (waiter);
+		}
+	}
+
+	g_ptr_array_unref (waiters);
+	g_clear_error (&error);
+}
+
+static void
+season_send (GCancellable        *cancellable,
+             guint                attempt,
+             GAsyncReadyCallback  callback,
+             gpointer             callback_data,
+             gpointer             user_data)
+{
+	FileInfo *info = user_data;
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	tmm_decorator_attempt_sent (info->decorator, attempt);
+
+	tmm_backend_get_season (priv->backend, info->title, info->season,
+	                        cancellable, callback, callback_data);
+}
+
+static void
+file_info_send_season_request (FileInfo *info)
+{
+	file_info_request_sent (info);
+	tmm_decorator_send_request (info->decorator, STAGE_SEASON, season_send,
+	                            file_info_get_cancellable (info),
+	                            season_query_cb, info);
+}
+
+/* Fetches all episodes in the season at once */
+static void
+file_info_search_season (FileInfo *info)
+{
+	TmmDecoratorPrivate *priv;
+	gchar *season_key;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	season_key = lookup_key_new (info->title, 0, info->season, 0);
+
+	if (file_info_lookup_is_backed_off (info, season_key)) {
+		g_free (season_key);
+		return;
+	}
+
+	if (pending_lookups_add (priv->pending_seasons, season_key, info)) {
+		g_debug ("Waiting on season '%s' already being queried", season_key);
+		g_free (season_key);
+		return;
+	}
+
+	g_free (season_key);
+
+	file_info_request (info, (TmmThrottleFunc) file_info_send_season_request);
+}
+
+static void
+file_info_guess (FileInfo     *info,
+                 const gchar **title,
+                 gint         *season,
+                 gint         *episode)
+{
+	TmmGuess guess;
+	gchar *path;
+
+	if (!info->guessed) {
+		path = g_file_get_path (info->file);
+
+		if (!path)
+			path = g_file_get_basename (info->file);
+
+		tmm_guess_parse (path, &guess);
+		g_free (path);
+
+		info->title = g_strdup (guess.title);
+		info->year = guess.year;
+		info->season = guess.season;
+		info->episode = guess.episode;
+		info->guessed = TRUE;
+	}
+
+	if (title)
+		*title = info->title;
+
+	if (season)
+		*season = info->season;
+	if (episode)
+		*episode = info->episode;
+}
+
+/* What the sidecar tells overrides what the file name suggests */
+static void
+file_info_apply_sidecar (FileInfo *info)
+{
+	TmmSidecar *sidecar = info->sidecar;
+
+	if (!sidecar)
+		return;
+
+	/* Tags often hold the episode title only, that is
+	 * no better than a series guessed from the file name.
+	 */
+	if (sidecar->title &&
+	    (!file_info_is_episode (info) ||
+	     (sidecar->season > 0 && sidecar->episode > 0))) {
+		g_free (info->title);
+		info->title = g_strdup (sidecar->title);
+		info->season = sidecar->season;
+		info->episode = sidecar->episode;
+	}
+
+	if (sidecar->year > 0)
+		info->year = sidecar->year;
+}
+
+/* Returns TRUE if the sidecar made a lookup unnecessary */
+static gboolean
+file_info_search_sidecar (FileInfo *info)
+{
+	TmmDecoratorPrivate *priv;
+	GVariant *variant;
+
+	if (!info->sidecar)
+		return FALSE;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+
+	if (info->sidecar->metadata) {
+		g_debug ("Item '%s' described by its .nfo file", info->urn);
+
+		variant = g_variant_ref_sink (tmm_metadata_to_variant (info->sidecar->metadata));
+		file_info_complete (info, variant);
+		g_variant_unref (variant);
+		return TRUE;
+	}
+
+	if (info->sidecar->imdb_id)
+		info->id = tmm_backend_id_from_imdb (priv->backend, info->sidecar->imdb_id);
+
+	if (!info->id)
+		return FALSE;
+
+	g_debug ("Item '%s' identified by IMDb ID '%s' as '%s'",
+	         info->urn, info->sidecar->imdb_id, info->id);
+	file_info_get_topic (info);
+
+	return TRUE;
+}
+
+/* Parses the "%FT%TZ" dates written by sparql_builder_object_time() */
+static gint64
+parse_store_date (const gchar *str)
+{
+	gint year, month, day, hour, minute, second;
+	GDateTime *date_time;
+	gint64 time;
+
+	if (!str ||
+	    sscanf (str, "%d-%d-%dT%d:%d:%d",
+	            &year, &month, &day, &hour, &minute, &second) != 6)
+		return -1;
+
+	date_time = g_date_time_new_utc (year, month, day, hour, minute, second);
+
+	if (!date_time)
+		return -1;
+
+	time = g_date_time_to_unix (date_time);
+	g_date_time_unref (date_time);
+
+	return time;
+}
+
+static void
+add_artist_names (GPtrArray   *names,
+                  const gchar *str)
+{
+	gchar **split;
+	guint i;
+
+	if (!str)
+		return;
+
+	split = g_strsplit (str, "\t", -1);
+
+	for (i = 0; split[i]; i++) {
+		if (*split[i])
+			g_ptr_array_add (names, g_strdup (split[i]));
+	}
+
+	g_strfreev (split);
+}
+
+static const gchar *
+cursor_get_string (TrackerSparqlCursor *cursor,
+                   gint                 column)
+{
+	if (!tracker_sparql_cursor_is_bound (cursor, column))
+		return NULL;
+
+	return tracker_sparql_cursor_get_string (cursor, column, NULL);
+}
+
+static TmmMetadata *
+metadata_new_from_cursor (TrackerSparqlCursor *cursor)
+{
+	TmmMetadata *metadata;
+
+	metadata = tmm_metadata_new ();
+	metadata->title = g_strdup (cursor_get_string (cursor, 0));
+	metadata->release_date = parse_store_date (cursor_get_string (cursor, 1));
+	metadata->synopsis = g_strdup (cursor_get_string (cursor, 2));
+	metadata->is_episode = tracker_sparql_cursor_get_boolean (cursor, 3);
+	metadata->season = tracker_sparql_cursor_get_integer (cursor, 4);
+	metadata->episode = tracker_sparql_cursor_get_integer (cursor, 5);
+	metadata->rating = g_strdup (cursor_get_string (cursor, 6));
+	metadata->genre = g_strdup (cursor_get_string (cursor, 7));
+
+	if (tracker_sparql_cursor_is_bound (cursor, 8))
+		metadata->runtime = tracker_sparql_cursor_get_integer (cursor, 8);
+
+	add_artist_names (metadata->directors, cursor_get_string (cursor, 9));
+	add_artist_names (metadata->producers, cursor_get_string (cursor, 10));
+	add_artist_names (metadata->actors, cursor_get_string (cursor, 11));
+
+	return metadata;
+}
+
+static void file_info_search_backend (FileInfo *info);
+static void file_info_lookup (FileInfo *info);
+
+static void
+store_lookup_next_cb (GObject      *object,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+	TrackerSparqlCursor *cursor = TRACKER_SPARQL_CURSOR (object);
+	FileInfo *info = user_data;
+	TmmDecoratorPrivate *priv;
+	TmmMetadata *metadata;
+	GError *error = NULL;
+	GVariant *variant;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	tmm_histogram_add (priv->stage_latencies[STAGE_STORE],
+	                   g_get_monotonic_time () - info->request_time);
+
+	if (!tracker_sparql_cursor_next_finish (cursor, result, &error)) {
+		g_object_unref (cursor);
+
+		/* Pausing or shutting down, the backend is not asked */
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			file_info_fail (info, error);
+			file_info_finish (info);
+			return;
+		}
+
+		if (error) {
+			g_debug ("Could not look up '%s' in the store: %s",
+			         info->lookup_key, error->message);
+			g_error_free (error);
+		}
+
+		file_info_search_backend (info);
+		return;
+	}
+
+	g_debug ("Item '%s' copied from '%s' in the store",
+	         info->urn, tracker_sparql_cursor_get_string (cursor, 12, NULL));
+
+	metadata = metadata_new_from_cursor (cursor);
+	g_object_unref (cursor);
+
+	variant = g_variant_ref_sink (tmm_metadata_to_variant (metadata));
+	tmm_metadata_free (metadata);
+
+	file_info_complete (info, variant);
+	g_variant_unref (variant);
+}
+
+static void
+store_lookup_cb (GObject      *object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+	TrackerSparqlCursor *cursor;
+	FileInfo *info = user_data;
+	GError *error = NULL;
+
+	cursor = tracker_sparql_connection_query_finish (TRACKER_SPARQL_CONNECTION (object),
+	                                                 result, &error);
+
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		file_info_fail (info, error);
+		file_info_finish (info);
+		return;
+	}
+
+	if (!cursor) {
+		g_debug ("Could not look up '%s' in the store: %s",
+		         info->lookup_key, error->message);
+		g_error_free (error);
+		file_info_search_backend (info);
+		return;
+	}
+
+	tracker_sparql_cursor_next_async (cursor, file_info_get_cancellable (info),
+	                                  store_lookup_next_cb, info);
+}
+
+/* Other copies of the same film or episode might have been
+ * looked up already, their metadata is copied if so.
+ */
+static void
+file_info_search_store (FileInfo *info)
+{
+	TrackerSparqlConnection *conn;
+	gchar *key, *query, *match;
+
+	conn = tracker_miner_get_connection (TRACKER_MINER (info->decorator));
+	key = tracker_sparql_escape_string (info->lookup_key);
+
+	if (info->hash) {
+		match = g_strdup_printf ("{ ?urn nie:identifier \"%s\" } UNION "
+		                         "{ ?urn nfo:hasHash ?hash ."
+		                         "  ?hash nfo:hashValue \"%s\" ;"
+		                         "        nfo:hashAlgorithm \"%s\" }",
+		                         key, info->hash, TMM_HASH_ALGORITHM);
+	} else {
+		match = g_strdup_printf ("?urn nie:identifier \"%s\"", key);
+	}
+
+	query = g_strdup_printf ("SELECT nie:title(?urn) nie:contentCreated(?urn) "
+	                         "  nmm:synopsis(?urn) nmm:isSeries(?urn) "
+	                         "  nmm:season(?urn) nmm:episodeNumber(?urn) "
+	                         "  nmm:MPAARating(?urn) nmm:genre(?urn) nmm:runTime(?urn) "
+	                         "  (SELECT GROUP_CONCAT (nmm:artistName(?d), \"\\t\") { ?urn nmm:director ?d }) "
+	                         "  (SELECT GROUP_CONCAT (nmm:artistName(?p), \"\\t\") { ?urn nmm:producedBy ?p }) "
+	                         "  (SELECT GROUP_CONCAT (nmm:artistName(?a), \"\\t\") { ?urn nmm:leadActor ?a }) "
+	                         "  ?urn "
+	                         "{"
+	                         "  GRAPH <%s> {"
+	                         "    ?urn a nmm:Video ."
+	                         "    %s"
+	                         "  }"
+	                         "  FILTER (?urn != <%s>)"
+	                         "} LIMIT 1",
+	                         TMM_GRAPH, match, info->urn);
+
+	info->request_time = g_get_monotonic_time ();
+	tracker_sparql_connection_query_async (conn, query,
+	                                       file_info_get_cancellable (info),
+	                                       store_lookup_cb, info);
+	g_free (query);
+	g_free (match);
+	g_free (key);
+}
+
+static void
+search_send (GCancellable        *cancellable,
+             guint                attempt,
+             GAsyncReadyCallback  callback,
+             gpointer             callback_data,
+             gpointer             user_data)
+{
+	FileInfo *info = user_data;
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	tmm_decorator_attempt_sent (info->decorator, attempt);
+
+	tmm_backend_search_film (priv->backend, info->title, info->year,
+	                         cancellable, callback, callback_data);
+}
+
+static void
+file_info_send_search_request (FileInfo *info)
+{
+	file_info_request_sent (info);
+	tmm_decorator_send_request (info->decorator, STAGE_SEARCH, search_send,
+	                            file_info_get_cancellable (info),
+	                            search_film_cb, info);
+}
+
+/* Returns TRUE if the ID for @info is known already */
+static gboolean
+file_info_search_cache (FileInfo *info)
+{
+	TmmDecoratorPrivate *priv;
+	GVariant *cached;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+
+	/* Same content as a file looked up before, maybe renamed */
+	if (info->hash) {
+		cached = tmm_cache_lookup (priv->cache, TMM_CACHE_HASHES, info->hash);
+
+		if (cached && g_variant_is_of_type (cached, G_VARIANT_TYPE_STRING)) {
+			info->id = g_variant_dup_string (cached, NULL);
+			g_variant_unref (cached);
+
+			g_debug ("Item '%s' matched by content as '%s'",
+			         info->urn, info->id);
+			return TRUE;
+		}
+
+		g_clear_pointer (&cached, g_variant_unref);
+	}
+
+	cached = tmm_cache_lookup (priv->cache, TMM_CACHE_IDS, info->lookup_key);
+
+	if (cached && g_variant_is_of_type (cached, G_VARIANT_TYPE_STRING)) {
+		info->id = g_variant_dup_string (cached, NULL);
+		g_variant_unref (cached);
+		return TRUE;
+	}
+
+	g_clear_pointer (&cached, g_variant_unref);
+
+	return FALSE;
+}
+
+static void
+file_info_search (FileInfo *info)
+{
+	TmmDecoratorPrivate *priv;
+	gint season, episode;
+	const gchar *title;
+	gint64 start;
+
+	g_assert (!info->id);
+	priv = tmm_decorator_get_instance_private (info->decorator);
+
+	g_debug ("Searching for information about '%s'", info->urn);
+
+	start = g_get_monotonic_time ();
+	file_info_guess (info, NULL, NULL, NULL);
+	file_info_apply_sidecar (info);
+	title = info->title;
+	season = info->season;
+	episode = info->episode;
+	tmm_histogram_add (priv->stage_latencies[STAGE_GUESS],
+	                   g_get_monotonic_time () - start);
+	info->lookup_key = file_info_get_lookup_key (info);
+	info->refresh = tmm_scheduler_is_refreshing (priv->scheduler, info->urn);
+
+	if (file_info_search_sidecar (info))
+		return;
+
+	if (file_info_is_episode (info)) {
+		g_debug ("Guessed as series: '%s', season: %d, episode: %d",
+		         title, season, episode);
+	} else {
+		g_debug ("Guessed as film: '%s'", title);
+	}
+
+	file_info_save_progress (info);
+	file_info_lookup (info);
+}
+
+/* Finds the ID for the guessed title */
+static void
+file_info_lookup (FileInfo *info)
+{
+	if (!info->refresh && file_info_search_cache (info)) {
+		file_info_get_topic (info);
+		return;
+	}
+
+	if (file_info_lookup_is_backed_off (info, info->lookup_key))
+		return;
+
+	/* Refreshes are meant to get the latest data. Without a store
+	 * connection (the decorator wasn't initialized, as in the
+	 * benchmarks) there's nowhere else to look either.
+	 */
+	if (info->refresh ||
+	    !tracker_miner_get_connection (TRACKER_MINER (info->decorator)))
+		file_info_search_backend (info);
+	else
+		file_info_search_store (info);
+}
+
+static void
+file_info_search_backend (FileInfo *info)
+{
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+
+	if (file_info_is_episode (info)) {
+		file_info_search_season (info);
+	} else {
+		if (pending_lookups_add (priv->pending_searches, info->lookup_key, info)) {
+			g_debug ("Waiting on search for '%s' already in flight",
+			         info->lookup_key);
+			return;
+		}
+
+		file_info_request (info, (TmmThrottleFunc) file_info_send_search_request);
+	}
+}
+
+static void
+inspection_free (Inspection *inspection)
+{
+	g_free (inspection->path);
+	g_free (inspection->hash);
+	g_clear_pointer (&inspection->sidecar, tmm_sidecar_free);
+	g_free (inspection);
+}
+
+static void
+file_info_inspect_thread (GTask        *task,
+                          gpointer      source_object,
+                          gpointer      task_data,
+                          GCancellable *cancellable)
+{
+	Inspection *inspection = task_data;
+	GError *error = NULL;
+	guint64 hash;
+
+	if (g_task_return_error_if_cancelled (task))
+		return;
+
+	if (tmm_hash_compute (inspection->path, &hash, &error)) {
+		inspection->hash = tmm_hash_to_string (hash);
 	} else {
-		error = g_error_new (tmm_decorator_error_quark (), 0, "MQL search returned no items");
+		g_debug ("Not hashing '%s': %s", inspection->path, error->message);
+		g_clear_error (&error);
+	}
+
+	if (g_task_return_error_if_cancelled (task))
+		return;
+
+	inspection->sidecar = tmm_sidecar_read (inspection->path);
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+file_info_inspect_cb (GObject      *object,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+	FileInfo *info = user_data;
+	TmmDecoratorPrivate *priv;
+	Inspection *inspection;
+	GError *error = NULL;
+
+	priv = tmm_decorator_get_instance_private (info->decorator);
+	inspection = g_task_get_task_data (G_TASK (result));
+	tmm_histogram_add (priv->stage_latencies[STAGE_INSPECT],
+	                   g_get_monotonic_time () - info->start_time);
+
+	/* Cancelled by pausing or shutting down */
+	if (!g_task_propagate_boolean (G_TASK (result), &error)) {
 		file_info_fail (info, error);
-		tracker_decorator_next (TRACKER_DECORATOR (info->decorator),
-		                        NULL, decorator_get_next_item_cb, NULL);
+		file_info_finish (info);
+		return;
+	}
+
+	info->hash = inspection->hash;
+	inspection->hash = NULL;
+	info->sidecar = inspection->sidecar;
+	inspection->sidecar = NULL;
+
+	file_info_search (info);
+}
+
+/* Hashes the file contents and reads its sidecar off
+ * the main thread, then searches. Items journaled by a
+ * previous attempt skip what that one finished.
+ */
+static void
+file_info_identify (FileInfo *info)
+{
+	Inspection *inspection;
+	gchar *path;
+	GTask *task;
+
+	/* Picks up after the last finished stage */
+	if (file_info_restore_progress (info)) {
+		g_debug ("Resuming lookup for '%s' as '%s'", info->urn, info->title);
+
+		if (info->id)
+			file_info_get_topic (info);
+		else
+			file_info_lookup (info);
+
+		return;
+	}
+
+	path = g_file_get_path (info->file);
+
+	if (!path) {
+		file_info_search (info);
+		return;
+	}
+
+	inspection = g_new0 (Inspection, 1);
+	inspection->path = path;
+
+	task = g_task_new (NULL, file_info_get_cancellable (info),
+	                   file_info_inspect_cb, info);
+	g_task_set_task_data (task, inspection, (GDestroyNotify) inspection_free);
+	g_task_run_in_thread (task, file_info_inspect_thread);
+	g_object_unref (task);
+}
+
+/* Picks up a parked item after the last stage it finished */
+static void
+file_info_resume (FileInfo *info)
+{
+	info->parked = FALSE;
+
+	if (info->id)
+		file_info_get_topic (info);
+	else if (info->lookup_key)
+		file_info_lookup (info);
+	else
+		file_info_identify (info);
+}
+
+static void
+decorator_get_next_item_cb (GObject      *object,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+	TrackerDecorator *decorator = TRACKER_DECORATOR (object);
+	TrackerDecoratorInfo *info;
+	TmmDecoratorPrivate *priv;
+	FileInfo *file_info;
+	GError *error = NULL;
+	GFile *file;
+	GTask *task;
+
+	priv = tmm_decorator_get_instance_private (TMM_DECORATOR (object));
+	priv->n_requested_items--;
+
+	info = tracker_decorator_next_finish (decorator, result, &error);
+
+	if (!info) {
+		/* The queue ran out before this request got an item */
+		if (error && tracker_decorator_get_n_items (decorator) > 0)
+			g_warning ("Next item could not be retrieved: %s\n",
+			           error->message);
+		g_clear_error (&error);
+		return;
+	}
+
+	task = tracker_decorator_info_get_task (info);
+
+	if (priv->shutting_down) {
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+		                         "Miner is shutting down");
+		tracker_decorator_info_unref (info);
+		return;
+	}
+
+	priv->n_active_items++;
+	file = g_file_new_for_uri (tracker_decorator_info_get_url (info));
+
+	/* The FileInfo keeps the task, and copies of the rest */
+	file_info = file_info_new (file, TMM_DECORATOR (object), task,
+	                           tracker_decorator_info_get_urn (info));
+	tracker_decorator_info_unref (info);
+	g_object_unref (file);
+
+	/* Handed out just as the miner was paused */
+	if (tracker_miner_is_paused (TRACKER_MINER (decorator))) {
+		file_info->parked = TRUE;
+		file_info_finish (file_info);
+		return;
+	}
+
+	file_info_identify (file_info);
+
+	/* Keep the window full while this one is being looked up */
+	tmm_decorator_fill_window (TMM_DECORATOR (object));
+}
+
+static void
+tmm_decorator_fill_window (TmmDecorator *decorator)
+{
+	TmmDecoratorPrivate *priv;
+	guint n_items;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+
+	if (priv->shutting_down ||
+	    tracker_miner_is_paused (TRACKER_MINER (decorator)))
+		return;
+
+	n_items = tracker_decorator_get_n_items (TRACKER_DECORATOR (decorator));
+
+	/* Items only leave the window once their lookup is finished,
+	 * so this also bounds the SPARQL updates pending on the decorator.
+	 */
+	while (priv->n_active_items + priv->n_requested_items < priv->max_active_items &&
+	       priv->n_requested_items < n_items) {
+		priv->n_requested_items++;
+		tracker_decorator_next (TRACKER_DECORATOR (decorator), NULL,
+		                        decorator_get_next_item_cb,
+		                        NULL);
+	}
+}
+
+static void
+tmm_decorator_items_available (TrackerDecorator *decorator)
+{
+	tmm_decorator_fill_window (TMM_DECORATOR (decorator));
+}
+
+static void
+tmm_decorator_log_cache_stats (TmmDecorator *decorator)
+{
+	TmmDecoratorPrivate *priv;
+	guint id_hits, id_misses, topic_hits, topic_misses;
+	TmmDecoratorStats stats;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+
+	tmm_cache_get_stats (priv->cache, TMM_CACHE_IDS, &id_hits, &id_misses);
+	tmm_cache_get_stats (priv->cache, TMM_CACHE_TOPICS, &topic_hits, &topic_misses);
+	g_debug ("Lookup cache stats: IDs %u hits/%u misses, topics %u hits/%u misses",
+	         id_hits, id_misses, topic_hits, topic_misses);
+
+	tmm_decorator_get_stats (decorator, &stats);
+	g_debug ("Lookup stats: %" G_GUINT64_FORMAT " items, %.1f items/s, "
+	         "%.2f requests/item, latency p50 %" G_GUINT64_FORMAT "ms "
+	         "p95 %" G_GUINT64_FORMAT "ms p99 %" G_GUINT64_FORMAT "ms",
+	         stats.n_items, stats.items_per_second, stats.requests_per_item,
+	         stats.latency_p50 / 1000, stats.latency_p95 / 1000,
+	         stats.latency_p99 / 1000);
+}
+
+/* Writes the lookup caches to disk. This happens periodically
+ * and on finalization, callers about to exit can do it sooner.
+ */
+void
+tmm_decorator_save_cache (TmmDecorator *decorator)
+{
+	TmmDecoratorPrivate *priv;
+	GError *error = NULL;
+
+	g_return_if_fail (TMM_IS_DECORATOR (decorator));
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	tmm_decorator_log_cache_stats (decorator);
+
+	if (!tmm_cache_save (priv->cache, &error)) {
+		g_warning ("Could not save lookup cache: %s", error->message);
+		g_error_free (error);
+	}
+}
+
+static gboolean
+save_cache_cb (gpointer user_data)
+{
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (user_data);
+	tmm_decorator_log_cache_stats (user_data);
+	tmm_cache_save_in_background (priv->cache);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+log_statistics_cb (gpointer user_data)
+{
+	TmmDecorator *decorator = user_data;
+	TmmDecoratorPrivate *priv;
+	TmmDecoratorStats stats;
+	GString *str;
+	guint64 n_failed = 0;
+	guint i;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	tmm_decorator_get_stats (decorator, &stats);
+
+	for (i = 0; i < N_FAILURES; i++)
+		n_failed += priv->n_failures[i];
+
+	str = g_string_new (NULL);
+	g_string_append_printf (str,
+	                        "%" G_GUINT64_FORMAT " items (%" G_GUINT64_FORMAT " failed), "
+	                        "%.1f items/s, %u active, %u throttled, "
+	                        "%u alive holding %" G_GUINT64_FORMAT " bytes, "
+	                        "RSS %" G_GUINT64_FORMAT " KiB, p95",
+	                        stats.n_items, n_failed, stats.items_per_second,
+	                        priv->n_active_items,
+	                        tmm_throttle_get_n_queued (priv->throttle),
+	                        stats.n_live_items, stats.live_bytes, stats.rss);
+
+	for (i = 0; i < N_STAGES; i++) {
+		g_string_append_printf (str, " %s %.1fms", stage_names[i],
+		                        tmm_histogram_get_percentile (priv->stage_latencies[i], 0.95) / 1000.0);
 	}
+
+	g_message ("Statistics: %s", str->str);
+	g_string_free (str, TRUE);
+
+	return G_SOURCE_CONTINUE;
 }
 
 static void
-search_query_cb (GObject      *object,
-		 GAsyncResult *result,
-		 gpointer      user_data)
+tmm_decorator_set_statistics_interval (TmmDecorator *decorator,
+                                       guint         interval)
 {
-	const GDataFreebaseSearchResultItem *item = NULL;
-	GDataFreebaseSearchResult *search_result;
-	FileInfo *info = user_data;
-	GError *error = NULL;
-
-	search_result =
-		GDATA_FREEBASE_SEARCH_RESULT (gdata_service_query_single_entry_finish (GDATA_SERVICE (object),
-		                                                                       result, &error));
+	TmmDecoratorPrivate *priv;
 
-	if (error) {
-		g_warning ("Could not search in Freebase: %s", error->message);
-		g_error_free (error);
+	priv = tmm_decorator_get_instance_private (decorator);
+	priv->statistics_interval = interval;
 
-		file_info_fail (info, error);
-		tracker_decorator_next (TRACKER_DECORATOR (info->decorator),
-		                        NULL, decorator_get_next_item_cb, NULL);
-		return;
+	if (priv->log_statistics_id) {
+		g_source_remove (priv->log_statistics_id);
+		priv->log_statistics_id = 0;
 	}
 
-	if (gdata_freebase_search_result_get_num_items (search_result) > 0)
-		item = gdata_freebase_search_result_get_item (search_result, 0);
+	if (interval > 0) {
+		priv->log_statistics_id = g_timeout_add_seconds (interval,
+		                                                 log_statistics_cb,
+		                                                 decorator);
+	}
+}
 
-#define MIN_SCORE 50
-	if (item && gdata_freebase_search_result_item_get_score (item) > MIN_SCORE) {
-		info->freebase_id = g_strdup (gdata_freebase_search_result_item_get_id (item));
-		file_info_get_topic (info);
+static void
+statistics_method_call (GDBusConnection       *connection,
+                        const gchar           *sender,
+                        const gchar           *object_path,
+                        const gchar           *interface_name,
+                        const gchar           *method_name,
+                        GVariant              *parameters,
+                        GDBusMethodInvocation *invocation,
+                        gpointer               user_data)
+{
+	if (g_strcmp0 (method_name, "GetStatistics") == 0) {
+		g_dbus_method_invocation_return_value (invocation,
+		                                       g_variant_new ("(@a{sv})",
+		                                                      tmm_decorator_get_statistics (user_data)));
 	} else {
-		GError *error;
-		gchar *uri;
+		g_dbus_method_invocation_return_error (invocation,
+		                                       G_DBUS_ERROR,
+		                                       G_DBUS_ERROR_UNKNOWN_METHOD,
+		                                       "Unknown method '%s'", method_name);
+	}
+}
 
-		uri = g_file_get_uri (info->file);
-		g_debug ("Found no search results for '%s'", uri);
-		g_free (uri);
+static const GDBusInterfaceVTable statistics_vtable = {
+	statistics_method_call,
+	NULL,
+	NULL
+};
 
-		error = g_error_new (tmm_decorator_error_quark (), 0, "No result items");
+/* Exported next to the miner interfaces, on the same object,
+ * once started. Decorators only driven through
+ * tmm_decorator_process_file_async() don't export anything.
+ */
+static void
+tmm_decorator_export_statistics (TmmDecorator *decorator)
+{
+	TmmDecoratorPrivate *priv;
+	GDBusNodeInfo *node_info;
+	GError *error = NULL;
 
-		file_info_fail (info, error);
-		tracker_decorator_next (TRACKER_DECORATOR (info->decorator),
-		                        NULL, decorator_get_next_item_cb, NULL);
+	priv = tmm_decorator_get_instance_private (decorator);
+
+	if (priv->statistics_id)
+		return;
+
+	if (!priv->dbus_connection)
+		priv->dbus_connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+
+	if (!priv->dbus_connection) {
+		g_warning ("Could not export statistics: %s", error->message);
+		g_error_free (error);
+		return;
 	}
-#undef MIN_SCORE
 
-	g_object_unref (search_result);
+	node_info = g_dbus_node_info_new_for_xml (statistics_xml, NULL);
+	priv->statistics_id =
+		g_dbus_connection_register_object (priv->dbus_connection,
+		                                   STATISTICS_PATH,
+		                                   node_info->interfaces[0],
+		                                   &statistics_vtable,
+		                                   decorator, NULL, &error);
+	g_dbus_node_info_unref (node_info);
+
+	if (priv->statistics_id == 0) {
+		g_warning ("Could not export statistics: %s", error->message);
+		g_error_free (error);
+	}
 }
 
 static gboolean
-str_is_digit (const gchar *str)
+shutdown_timeout_cb (gpointer user_data)
 {
-	gint i;
+	gboolean *timed_out = user_data;
 
-	for (i = 0; str[i]; i++) {
-		if (!g_ascii_isdigit (str[i]))
-			return FALSE;
-	}
+	*timed_out = TRUE;
 
-	return TRUE;
+	return G_SOURCE_REMOVE;
 }
 
-static gboolean
-str_is_year (const gchar *str)
+/* Sends the topic batches and the requests queued on the throttle
+ * at once. Once cancelled, these fail without reaching the backend.
+ */
+static void
+tmm_decorator_flush_requests (TmmDecorator *decorator)
 {
-	return str_is_digit (str) && strlen (str) == 4 &&
-		/* Screw you, 22nd century! */
-		((str[0] == '1' && str[1] == '9') ||
-		 (str[0] == '2' && str[1] == '0'));
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (decorator);
+
+	if (priv->topic_batch_id) {
+		g_source_remove (priv->topic_batch_id);
+		priv->topic_batch_id = 0;
+	}
+
+	tmm_decorator_submit_topic_batch (decorator, FALSE);
+	tmm_decorator_submit_topic_batch (decorator, TRUE);
+	tmm_throttle_flush (priv->throttle);
 }
 
+/* Every item holds a reference on the decorator through its task,
+ * so items left waiting would keep it, and their memory, alive for
+ * good. This fails them all: lookups in flight are cancelled and
+ * finish through their callbacks, the ones still queued on the
+ * throttle or in a topic batch are flushed so they fail the same
+ * way, and items coming from the decorator queue are turned down.
+ * The main context is iterated until all are done.
+ */
 static void
-file_info_guess (FileInfo     *info,
-                 const gchar **title,
-                 gint         *season,
-                 gint         *episode)
+tmm_decorator_shutdown (TmmDecorator *decorator)
 {
-	gchar *filename, *ext;
-	gboolean add = TRUE;
-	GString *string;
-	gchar **tokens;
-	gint i, s, ep;
-
-	s = ep = 0;
-	filename = g_file_get_basename (info->file);
-	ext = strrchr (filename, '.');
-
-	if (ext)
-		ext[0] = '\0';
-
-	string = g_string_new ("");
-	tokens = g_strsplit_set (filename, ". ", -1);
-
-	for (i = 0; tokens[i]; i++) {
-		if (ep == 0 &&
-		    (sscanf (tokens[i], "S%dE%d", &s, &ep) == 2 ||
-		     sscanf (tokens[i], "s%de%d", &s, &ep) == 2 ||
-		     sscanf (tokens[i], "%dx%d", &s, &ep) == 2)) {
-			add = FALSE;
-		} else if (string->len > 0 &&
-		           (str_is_year (tokens[i]) ||
-		            *tokens[i] == '[' || *tokens[i] == '(')) {
-			add = FALSE;
-		}
+	TmmDecoratorPrivate *priv;
+	gboolean timed_out = FALSE;
+	guint timeout_id;
+	FileInfo *info;
 
-		if (add) {
-			if (string->len > 0)
-				g_string_append (string, " ");
+	priv = tmm_decorator_get_instance_private (decorator);
 
-			g_string_append (string, tokens[i]);
-		}
+	if (g_hash_table_size (priv->live_items) == 0 &&
+	    priv->n_requested_items == 0)
+		return;
+
+	priv->shutting_down = TRUE;
+	g_cancellable_cancel (priv->cancellable);
+	g_cancellable_cancel (priv->external_cancellable);
+
+	/* Parked items have no lookup in flight to fail them */
+	while ((info = g_queue_pop_head (&priv->parked)) != NULL) {
+		info->parked = FALSE;
+		file_info_fail (info,
+		                g_error_new (G_IO_ERROR, G_IO_ERROR_CANCELLED,
+		                             "Miner is shutting down"));
+		file_info_finish (info);
 	}
 
-	info->title = g_string_free (string, FALSE);
-	info->season = s;
-	info->episode = ep;
+	timeout_id = g_timeout_add_seconds (SHUTDOWN_TIMEOUT,
+	                                    shutdown_timeout_cb, &timed_out);
 
-	if (title)
-		*title = info->title;
+	while ((g_hash_table_size (priv->live_items) > 0 ||
+	        priv->n_requested_items > 0) && !timed_out) {
+		tmm_decorator_flush_requests (decorator);
+		g_main_context_iteration (NULL, TRUE);
+	}
 
-	if (season)
-		*season = info->season;
-	if (episode)
-		*episode = info->episode;
+	if (timed_out) {
+		g_warning ("%u items still being looked up after %d seconds",
+		           g_hash_table_size (priv->live_items), SHUTDOWN_TIMEOUT);
+	} else {
+		g_source_remove (timeout_id);
+	}
 
-	g_free (filename);
+	/* Ready for a later start, or for resuming */
+	if (!tracker_miner_is_paused (TRACKER_MINER (decorator)))
+		g_cancellable_reset (priv->cancellable);
+	g_cancellable_reset (priv->external_cancellable);
+	priv->shutting_down = FALSE;
 }
 
 static void
-file_info_search (FileInfo *info)
+tmm_decorator_stopped (TrackerMiner *miner)
+{
+	if (TRACKER_MINER_CLASS (tmm_decorator_parent_class)->stopped)
+		TRACKER_MINER_CLASS (tmm_decorator_parent_class)->stopped (miner);
+
+	tmm_decorator_shutdown (TMM_DECORATOR (miner));
+}
+
+static void
+tmm_decorator_finished (TrackerDecorator *decorator)
 {
 	TmmDecoratorPrivate *priv;
-	gint season, episode;
-	const gchar *title;
-	GFile *file;
 
-	g_assert (!info->freebase_id);
-	priv = tmm_decorator_get_instance_private (info->decorator);
+	priv = tmm_decorator_get_instance_private (TMM_DECORATOR (decorator));
 
-	g_debug ("Searching for information about '%s'", info->urn);
+	tmm_decorator_expire_commits (TMM_DECORATOR (decorator));
+	tmm_cache_save_in_background (priv->cache);
+}
 
-	file_info_guess (info, &title, &season, &episode);
+static void
+tmm_decorator_paused (TrackerMiner *miner)
+{
+	TmmDecoratorPrivate *priv;
 
-	if (file_info_is_episode (info)) {
-		GDataFreebaseQuery *mql_query;
-		gchar *str;
+	if (TRACKER_MINER_CLASS (tmm_decorator_parent_class)->paused)
+		TRACKER_MINER_CLASS (tmm_decorator_parent_class)->paused (miner);
 
-		g_debug ("Guessed as series: '%s', season: %d, episode: %d",
-		         title, season, episode);
+	/* Stays cancelled until resumed, so nothing
+	 * started meanwhile goes ahead either.
+	 */
+	priv = tmm_decorator_get_instance_private (TMM_DECORATOR (miner));
+	g_cancellable_cancel (priv->cancellable);
 
-		str = g_strdup_printf ("{ \"type\": \"/tv/tv_series_episode\","
-		                       "  \"season_number\": %d,"
-		                       "  \"episode_number\": %d,"
-		                       "  \"series\": \"%s\","
-		                       "  \"id\": null }",
-		                       season, episode, title);
-
-		mql_query = gdata_freebase_query_new (str);
-		gdata_freebase_service_query_async (priv->freebase_service,
-		                                    mql_query, priv->cancellable,
-		                                    mql_query_cb, info);
-		g_object_unref (mql_query);
-		g_free (str);
-	} else {
-		GDataFreebaseSearchQuery *search_query;
+	/* Requests waiting their turn would otherwise be sent
+	 * while paused, these fail right away instead.
+	 */
+	tmm_decorator_flush_requests (TMM_DECORATOR (miner));
+}
 
-		g_debug ("Guessed as film: '%s'", title);
+static void
+tmm_decorator_resumed (TrackerMiner *miner)
+{
+	TmmDecoratorPrivate *priv;
+	FileInfo *info;
 
-		search_query = gdata_freebase_search_query_new (title);
-		gdata_query_set_max_results (GDATA_QUERY (search_query), 1);
+	if (TRACKER_MINER_CLASS (tmm_decorator_parent_class)->resumed)
+		TRACKER_MINER_CLASS (tmm_decorator_parent_class)->resumed (miner);
 
-		gdata_freebase_search_query_open_filter (search_query, GDATA_FREEBASE_SEARCH_FILTER_ANY);
-		gdata_freebase_search_query_add_filter (search_query, "type", "/film/film");
-		gdata_freebase_search_query_close_filter (search_query);
+	priv = tmm_decorator_get_instance_private (TMM_DECORATOR (miner));
+	g_cancellable_reset (priv->cancellable);
 
-		gdata_freebase_service_search_async (priv->freebase_service,
-		                                     search_query,
-		                                     priv->cancellable,
-		                                     search_query_cb,
-		                                     info);
-		g_object_unref (search_query);
-	}
+	while ((info = g_queue_pop_head (&priv->parked)) != NULL)
+		file_info_resume (info);
+
+	tmm_decorator_fill_window (TMM_DECORATOR (miner));
 }
 
 static void
-decorator_get_next_item_cb (GObject      *object,
-                            GAsyncResult *result,
-                            gpointer      user_data)
+known_artists_next_cb (GObject      *object,
+                       GAsyncResult *result,
+                       gpointer      user_data)
 {
-	TrackerDecorator *decorator = TRACKER_DECORATOR (object);
-	TrackerDecoratorInfo *info;
-	FileInfo *file_info;
+	TrackerSparqlCursor *cursor = (TrackerSparqlCursor *) object;
+	TmmDecoratorPrivate *priv;
 	GError *error = NULL;
-	GFile *file;
-	GTask *task;
 
-	if (tracker_decorator_get_n_items (decorator) == 0)
+	if (!tracker_sparql_cursor_next_finish (cursor, result, &error)) {
+		if (error) {
+			g_warning ("Could not fetch known artists: %s", error->message);
+			g_error_free (error);
+		}
+
+		g_object_unref (cursor);
+		g_object_unref (user_data);
 		return;
+	}
 
-	info = tracker_decorator_next_finish (decorator, result, &error);
+	priv = tmm_decorator_get_instance_private (user_data);
+	g_mutex_lock (&priv->known_artists_lock);
+	g_hash_table_add (priv->known_artists,
+	                  g_strdup (tracker_sparql_cursor_get_string (cursor, 0, NULL)));
+	g_mutex_unlock (&priv->known_artists_lock);
 
-	if (!info) {
-		g_warning ("Next item could not be retrieved: %s\n",
-		           error->message);
+	tracker_sparql_cursor_next_async (cursor, NULL,
+	                                  known_artists_next_cb, user_data);
+}
+
+static void
+known_artists_query_cb (GObject      *object,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+	TrackerSparqlCursor *cursor;
+	GError *error = NULL;
+
+	cursor = tracker_sparql_connection_query_finish (TRACKER_SPARQL_CONNECTION (object),
+	                                                 result, &error);
+	if (error) {
+		g_warning ("Could not fetch known artists: %s", error->message);
 		g_error_free (error);
+		g_object_unref (user_data);
 		return;
 	}
 
-	task = tracker_decorator_info_get_task (info);
-	file = g_file_new_for_uri (tracker_decorator_info_get_url (info));
+	tracker_sparql_cursor_next_async (cursor, NULL,
+	                                  known_artists_next_cb, user_data);
+}
 
-	file_info = file_info_new (file, TMM_DECORATOR (object), task,
-	                           tracker_decorator_info_get_urn (info));
-	g_object_unref (file);
+static void
+tmm_decorator_started (TrackerMiner *miner)
+{
+	TrackerSparqlConnection *conn;
+	TmmDecoratorPrivate *priv;
+	gchar *query;
+
+	if (TRACKER_MINER_CLASS (tmm_decorator_parent_class)->started)
+		TRACKER_MINER_CLASS (tmm_decorator_parent_class)->started (miner);
+
+	/* Seed the known artists, until this finishes they'll just
+	 * be inserted again. Only ours are of use, those referenced
+	 * from our graph, not every artist the music miner found.
+	 */
+	conn = tracker_miner_get_connection (miner);
+	query = g_strdup_printf ("SELECT DISTINCT ?urn { "
+	                         "  GRAPH <%s> { "
+	                         "    { ?v nmm:director ?urn } UNION "
+	                         "    { ?v nmm:producedBy ?urn } UNION "
+	                         "    { ?v nmm:leadActor ?urn } "
+	                         "  } "
+	                         "  FILTER (STRSTARTS (STR (?urn), \"urn:artist:\")) "
+	                         "} LIMIT %d",
+	                         TMM_GRAPH, MAX_KNOWN_ARTISTS);
+	tracker_sparql_connection_query_async (conn, query,
+	                                       NULL, known_artists_query_cb,
+	                                       g_object_ref (miner));
+	g_free (query);
+
+	priv = tmm_decorator_get_instance_private (TMM_DECORATOR (miner));
+	tmm_scheduler_start (priv->scheduler, conn);
 
-	file_info_search (file_info);
+	tmm_decorator_export_statistics (TMM_DECORATOR (miner));
+	tmm_decorator_watch_updates (TMM_DECORATOR (miner));
 }
 
 static void
-tmm_decorator_items_available (TrackerDecorator *decorator)
+tmm_decorator_set_property (GObject      *object,
+                            guint         prop_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
 {
-	tracker_decorator_next (decorator, NULL,
-	                        decorator_get_next_item_cb,
-	                        NULL);
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (TMM_DECORATOR (object));
+
+	switch (prop_id) {
+	case PROP_BACKEND:
+		priv->backend = g_value_dup_object (value);
+		break;
+	case PROP_MAX_ACTIVE_ITEMS:
+		priv->max_active_items = g_value_get_uint (value);
+		break;
+	case PROP_REQUEST_RATE:
+		tmm_throttle_set_rate (priv->throttle, g_value_get_double (value));
+		priv->request_rate = g_value_get_double (value);
+		break;
+	case PROP_STATISTICS_INTERVAL:
+		tmm_decorator_set_statistics_interval (TMM_DECORATOR (object),
+		                                       g_value_get_uint (value));
+		break;
+	case PROP_REFRESH_BUDGET:
+		priv->refresh_budget = g_value_get_uint (value);
+		if (priv->scheduler)
+			tmm_scheduler_set_budget (priv->scheduler, priv->refresh_budget);
+		break;
+	case PROP_REQUEST_TIMEOUT:
+		priv->request_timeout = g_value_get_uint (value);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
 }
 
 static void
-tmm_decorator_finished (TrackerDecorator *decorator)
+tmm_decorator_get_property (GObject    *object,
+                            guint       prop_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
 {
+	TmmDecoratorPrivate *priv;
+
+	priv = tmm_decorator_get_instance_private (TMM_DECORATOR (object));
+
+	switch (prop_id) {
+	case PROP_BACKEND:
+		g_value_set_object (value, priv->backend);
+		break;
+	case PROP_MAX_ACTIVE_ITEMS:
+		g_value_set_uint (value, priv->max_active_items);
+		break;
+	case PROP_REQUEST_RATE:
+		g_value_set_double (value, priv->request_rate);
+		break;
+	case PROP_STATISTICS_INTERVAL:
+		g_value_set_uint (value, priv->statistics_interval);
+		break;
+	case PROP_REFRESH_BUDGET:
+		g_value_set_uint (value, priv->refresh_budget);
+		break;
+	case PROP_REQUEST_TIMEOUT:
+		g_value_set_uint (value, priv->request_timeout);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
 }
 
 static void
-tmm_decorator_paused (TrackerMiner *miner)
+tmm_decorator_constructed (GObject *object)
 {
 	TmmDecoratorPrivate *priv;
+	gchar *cache_path, *filename;
 
-	priv = tmm_decorator_get_instance_private (TMM_DECORATOR (miner));
-	g_cancellable_cancel (priv->cancellable);
-	g_cancellable_reset (priv->cancellable);
+	G_OBJECT_CLASS (tmm_decorator_parent_class)->constructed (object);
+
+	priv = tmm_decorator_get_instance_private (TMM_DECORATOR (object));
+
+	/* IDs are only meaningful to the backend that gave them */
+	filename = g_strdup_printf ("%s.cache", tmm_backend_get_name (priv->backend));
+	cache_path = g_build_filename (g_get_user_cache_dir (),
+	                               "tracker-miner-media",
+	                               filename, NULL);
+	priv->cache = tmm_cache_new (cache_path);
+	priv->scheduler = tmm_scheduler_new (priv->cache, TMM_DATA_SOURCE);
+	tmm_scheduler_set_budget (priv->scheduler, priv->refresh_budget);
+	priv->save_cache_id = g_timeout_add_seconds (CACHE_SAVE_INTERVAL,
+	                                             save_cache_cb, object);
+	g_free (cache_path);
+	g_free (filename);
+}
+
+static void
+tmm_decorator_dispose (GObject *object)
+{
+	tmm_decorator_shutdown (TMM_DECORATOR (object));
+
+	G_OBJECT_CLASS (tmm_decorator_parent_class)->dispose (object);
 }
 
 static void
 tmm_decorator_finalize (GObject *object)
 {
 	TmmDecoratorPrivate *priv;
+	ExtractJob *job;
+	guint i;
 
 	priv = tmm_decorator_get_instance_private (TMM_DECORATOR (object));
-	g_object_unref (priv->freebase_service);
+	g_cancellable_cancel (priv->cancellable);
+	g_cancellable_cancel (priv->external_cancellable);
+
+	/* Waits for running and queued extractions, then drops
+	 * the ones whose results weren't handled yet.
+	 */
+	g_thread_pool_free (priv->extract_pool, FALSE, TRUE);
+
+	while ((job = g_queue_pop_head (&priv->extract_done)) != NULL) {
+		g_idle_remove_by_data (job);
+		file_info_abort (job->info);
+		extract_job_free (job);
+	}
+
+	g_mutex_clear (&priv->extract_done_lock);
+	g_object_unref (priv->cancellable);
+	g_object_unref (priv->external_cancellable);
+
+	g_object_unref (priv->backend);
+	tmm_throttle_free (priv->throttle);
+	tmm_histogram_free (priv->latencies);
+
+	for (i = 0; i < N_STAGES; i++)
+		tmm_histogram_free (priv->stage_latencies[i]);
+
+	if (priv->statistics_id)
+		g_dbus_connection_unregister_object (priv->dbus_connection,
+		                                     priv->statistics_id);
+	if (priv->graph_updated_id)
+		g_dbus_connection_signal_unsubscribe (priv->dbus_connection,
+		                                      priv->graph_updated_id);
+	g_clear_object (&priv->dbus_connection);
+
+	if (priv->log_statistics_id)
+		g_source_remove (priv->log_statistics_id);
+
+	g_source_remove (priv->save_cache_id);
+	tmm_decorator_save_cache (TMM_DECORATOR (object));
+	tmm_scheduler_free (priv->scheduler);
+	tmm_cache_free (priv->cache);
+
+	g_hash_table_unref (priv->pending_searches);
+	g_hash_table_unref (priv->pending_seasons);
+	g_hash_table_unref (priv->pending_topics);
+
+	/* Failed by tmm_decorator_shutdown(), if they could be */
+	if (g_hash_table_size (priv->live_items) > 0)
+		g_warning ("%u items still being looked up",
+		           g_hash_table_size (priv->live_items));
+	g_hash_table_unref (priv->live_items);
+	g_hash_table_unref (priv->uncommitted);
+
+	g_hash_table_unref (priv->unconfirmed);
+	g_array_unref (priv->confirm_ids);
+
+	if (priv->topic_batch_id)
+		g_source_remove (priv->topic_batch_id);
+	for (i = 0; i < G_N_ELEMENTS (priv->topic_batches); i++)
+		g_clear_pointer (&priv->topic_batches[i], topic_batch_free);
+	g_hash_table_unref (priv->known_artists);
+	g_mutex_clear (&priv->known_artists_lock);
+
+	G_OBJECT_CLASS (tmm_decorator_parent_class)->finalize (object);
 }
 
 static void
@@ -713,26 +3604,354 @@ tmm_decorator_class_init (TmmDecoratorClass *klass)
 	TrackerMinerClass *miner_class = TRACKER_MINER_CLASS (klass);
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+	miner_class->started = tmm_decorator_started;
 	miner_class->paused = tmm_decorator_paused;
+	miner_class->resumed = tmm_decorator_resumed;
+	miner_class->stopped = tmm_decorator_stopped;
 
 	decorator_class->items_available = tmm_decorator_items_available;
 	decorator_class->finished = tmm_decorator_finished;
 
+	object_class->set_property = tmm_decorator_set_property;
+	object_class->get_property = tmm_decorator_get_property;
+	object_class->constructed = tmm_decorator_constructed;
+	object_class->dispose = tmm_decorator_dispose;
 	object_class->finalize = tmm_decorator_finalize;
+
+	g_object_class_install_property (object_class,
+	                                 PROP_BACKEND,
+	                                 g_param_spec_object ("backend",
+	                                                      "Backend",
+	                                                      "Backend providing the metadata",
+	                                                      TMM_TYPE_BACKEND,
+	                                                      G_PARAM_READWRITE |
+	                                                      G_PARAM_CONSTRUCT_ONLY |
+	                                                      G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (object_class,
+	                                 PROP_MAX_ACTIVE_ITEMS,
+	                                 g_param_spec_uint ("max-active-items",
+	                                                    "Max active items",
+	                                                    "Maximum number of items being looked up at once",
+	                                                    1, G_MAXUINT,
+	                                                    DEFAULT_MAX_ACTIVE_ITEMS,
+	                                                    G_PARAM_READWRITE |
+	                                                    G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (object_class,
+	                                 PROP_REQUEST_RATE,
+	                                 g_param_spec_double ("request-rate",
+	                                                      "Request rate",
+	                                                      "Maximum backend requests per second, 0 for no limit",
+	                                                      0, G_MAXDOUBLE,
+	                                                      DEFAULT_REQUEST_RATE,
+	                                                      G_PARAM_READWRITE |
+	                                                      G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (object_class,
+	                                 PROP_STATISTICS_INTERVAL,
+	                                 g_param_spec_uint ("statistics-interval",
+	                                                    "Statistics interval",
+	                                                    "Seconds between statistics log lines, 0 to disable",
+	                                                    0, G_MAXUINT, 0,
+	                                                    G_PARAM_READWRITE |
+	                                                    G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (object_class,
+	                                 PROP_REFRESH_BUDGET,
+	                                 g_param_spec_uint ("refresh-budget",
+	                                                    "Refresh budget",
+	                                                    "Backend requests per day spent refreshing stale items, 0 to disable",
+	                                                    0, G_MAXUINT,
+	                                                    DEFAULT_REFRESH_BUDGET,
+	                                                    G_PARAM_READWRITE |
+	                                                    G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (object_class,
+	                                 PROP_REQUEST_TIMEOUT,
+	                                 g_param_spec_uint ("request-timeout",
+	                                                    "Request timeout",
+	                                                    "Seconds before giving up on a backend request, 0 for no limit",
+	                                                    0, G_MAXUINT,
+	                                                    DEFAULT_REQUEST_TIMEOUT,
+	                                                    G_PARAM_READWRITE |
+	                                                    G_PARAM_STATIC_STRINGS));
 }
 
 static void
 tmm_decorator_init (TmmDecorator *decorator)
 {
 	TmmDecoratorPrivate *priv;
+	guint i;
 
 	priv = tmm_decorator_get_instance_private (decorator);
-	priv->freebase_service = gdata_freebase_service_new (NULL, NULL);
 	priv->cancellable = g_cancellable_new ();
+	priv->external_cancellable = g_cancellable_new ();
+	priv->max_active_items = DEFAULT_MAX_ACTIVE_ITEMS;
+	priv->request_rate = DEFAULT_REQUEST_RATE;
+	priv->refresh_budget = DEFAULT_REFRESH_BUDGET;
+	priv->request_timeout = DEFAULT_REQUEST_TIMEOUT;
+	priv->throttle = tmm_throttle_new (priv->request_rate);
+	priv->latencies = tmm_histogram_new ();
+
+	for (i = 0; i < N_STAGES; i++)
+		priv->stage_latencies[i] = tmm_histogram_new ();
+
+	priv->live_items = g_hash_table_new (NULL, NULL);
+	priv->uncommitted = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+	                                           (GDestroyNotify) pending_commit_free);
+	priv->unconfirmed = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+	                                           (GDestroyNotify) pending_commit_free);
+	priv->confirm_ids = g_array_new (FALSE, FALSE, sizeof (gint));
+	priv->pending_searches = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                                (GDestroyNotify) g_free,
+	                                                (GDestroyNotify) g_ptr_array_unref);
+	priv->pending_seasons = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                               (GDestroyNotify) g_free,
+	                                               (GDestroyNotify) g_ptr_array_unref);
+	priv->pending_topics = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                              (GDestroyNotify) g_free,
+	                                              (GDestroyNotify) g_ptr_array_unref);
+	priv->known_artists = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                             (GDestroyNotify) g_free, NULL);
+	g_mutex_init (&priv->known_artists_lock);
+
+	priv->extract_pool = g_thread_pool_new (extract_job_run, decorator,
+	                                        g_get_num_processors (),
+	                                        FALSE, NULL);
+	g_queue_init (&priv->extract_done);
+	g_mutex_init (&priv->extract_done_lock);
+	g_queue_init (&priv->parked);
+}
+
+/* Looks up @file outside of the decorator queue, the update
+ * for it is written to @sparql. Callers that parsed the file
+ * name already pass the result as @guess, or %NULL.
+ */
+void
+tmm_decorator_process_file_async (TmmDecorator         *decorator,
+                                  GFile                *file,
+                                  const gchar          *urn,
+                                  const TmmGuess       *guess,
+                                  TrackerSparqlBuilder *sparql,
+                                  GCancellable         *cancellable,
+                                  GAsyncReadyCallback   callback,
+                                  gpointer              user_data)
+{
+	TmmDecoratorPrivate *priv;
+	FileInfo *info;
+	GTask *task;
+
+	g_return_if_fail (TMM_IS_DECORATOR (decorator));
+	g_return_if_fail (G_IS_FILE (file));
+	g_return_if_fail (urn != NULL);
+
+	priv = tmm_decorator_get_instance_private (decorator);
+
+	task = g_task_new (decorator, cancellable, callback, user_data);
+	g_task_set_task_data (task, g_object_ref (sparql), g_object_unref);
+
+	priv->n_active_items++;
+	info = file_info_new (file, decorator, task, urn);
+	info->external = TRUE;
+	g_object_unref (task);
+
+	if (guess) {
+		info->title = g_strdup (guess->title);
+		info->year = guess->year;
+		info->season = guess->season;
+		info->episode = guess->episode;
+		info->guessed = TRUE;
+	}
+
+	file_info_identify (info);
+}
+
+gboolean
+tmm_decorator_process_file_finish (TmmDecorator  *decorator,
+                                   GAsyncResult  *result,
+                                   GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, decorator), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/* Tells whether the update for @urn, as built by
+ * tmm_decorator_process_file_async(), made it to the store.
+ * What was written, the content hash and refresh schedule are
+ * only recorded once it did, a failed write leaves the file to
+ * be looked up again.
+ */
+void
+tmm_decorator_file_committed (TmmDecorator *decorator,
+                              const gchar  *urn,
+                              gboolean      committed)
+{
+	TmmDecoratorPrivate *priv;
+	PendingCommit *commit;
+
+	g_return_if_fail (TMM_IS_DECORATOR (decorator));
+	g_return_if_fail (urn != NULL);
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	commit = g_hash_table_lookup (priv->uncommitted, urn);
+
+	if (!commit)
+		return;
+
+	if (committed)
+		tmm_decorator_apply_commit (decorator, commit);
+
+	g_hash_table_remove (priv->uncommitted, urn);
+}
+
+/* Current resident set size in KiB, 0 if unknown */
+static guint64
+get_rss (void)
+{
+	guint64 size, resident = 0;
+	gchar *contents;
+
+	if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+		return 0;
+
+	if (sscanf (contents, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+	            &size, &resident) != 2)
+		resident = 0;
+
+	g_free (contents);
+
+	return resident * sysconf (_SC_PAGESIZE) / 1024;
+}
+
+void
+tmm_decorator_get_stats (TmmDecorator      *decorator,
+                         TmmDecoratorStats *stats)
+{
+	TmmDecoratorPrivate *priv;
+	struct rusage usage;
+	GHashTableIter iter;
+	gdouble elapsed;
+	FileInfo *info;
+
+	g_return_if_fail (TMM_IS_DECORATOR (decorator));
+	g_return_if_fail (stats != NULL);
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	memset (stats, 0, sizeof (TmmDecoratorStats));
+
+	stats->n_items = tmm_histogram_get_count (priv->latencies);
+	stats->n_requests = priv->n_requests;
+
+	if (stats->n_items > 0) {
+		elapsed = (gdouble) (g_get_monotonic_time () - priv->stats_start_time) / G_USEC_PER_SEC;
+		stats->items_per_second = stats->n_items / MAX (elapsed, 0.001);
+		stats->requests_per_item = (gdouble) stats->n_requests / stats->n_items;
+	}
+
+	stats->latency_p50 = tmm_histogram_get_percentile (priv->latencies, 0.50);
+	stats->latency_p95 = tmm_histogram_get_percentile (priv->latencies, 0.95);
+	stats->latency_p99 = tmm_histogram_get_percentile (priv->latencies, 0.99);
+
+	stats->n_live_items = g_hash_table_size (priv->live_items);
+	g_hash_table_iter_init (&iter, priv->live_items);
+
+	while (g_hash_table_iter_next (&iter, (gpointer *) &info, NULL))
+		stats->live_bytes += file_info_get_size (info);
+
+	stats->rss = get_rss ();
+
+	/* ru_maxrss is already in KiB on Linux */
+	if (getrusage (RUSAGE_SELF, &usage) == 0)
+		stats->peak_rss = usage.ru_maxrss;
+}
+
+/* Returns a floating a{sv} variant, latencies are in microseconds */
+GVariant *
+tmm_decorator_get_statistics (TmmDecorator *decorator)
+{
+	GVariantBuilder builder, dict;
+	TmmDecoratorPrivate *priv;
+	TmmDecoratorStats stats;
+	guint i, hits, misses;
+
+	g_return_val_if_fail (TMM_IS_DECORATOR (decorator), NULL);
+
+	priv = tmm_decorator_get_instance_private (decorator);
+	tmm_decorator_get_stats (decorator, &stats);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add (&builder, "{sv}", "items",
+	                       g_variant_new_uint64 (stats.n_items));
+	g_variant_builder_add (&builder, "{sv}", "items-unchanged",
+	                       g_variant_new_uint64 (priv->n_unchanged));
+	g_variant_builder_add (&builder, "{sv}", "requests",
+	                       g_variant_new_uint64 (stats.n_requests));
+	g_variant_builder_add (&builder, "{sv}", "hedged-requests",
+	                       g_variant_new_uint64 (priv->n_hedged_requests));
+	g_variant_builder_add (&builder, "{sv}", "items-per-second",
+	                       g_variant_new_double (stats.items_per_second));
+	g_variant_builder_add (&builder, "{sv}", "requests-per-item",
+	                       g_variant_new_double (stats.requests_per_item));
+	g_variant_builder_add (&builder, "{sv}", "items-alive",
+	                       g_variant_new_uint32 (stats.n_live_items));
+	g_variant_builder_add (&builder, "{sv}", "bytes-held",
+	                       g_variant_new_uint64 (stats.live_bytes));
+	g_variant_builder_add (&builder, "{sv}", "rss",
+	                       g_variant_new_uint64 (stats.rss));
+	g_variant_builder_add (&builder, "{sv}", "peak-rss",
+	                       g_variant_new_uint64 (stats.peak_rss));
+
+	/* Per stage (count, p50, p95, p99) */
+	g_variant_builder_init (&dict, G_VARIANT_TYPE ("a{s(tttt)}"));
+	g_variant_builder_add (&dict, "{s(tttt)}", "total",
+	                       stats.n_items, stats.latency_p50,
+	                       stats.latency_p95, stats.latency_p99);
+
+	for (i = 0; i < N_STAGES; i++) {
+		TmmHistogram *histogram = priv->stage_latencies[i];
+
+		g_variant_builder_add (&dict, "{s(tttt)}", stage_names[i],
+		                       tmm_histogram_get_count (histogram),
+		                       tmm_histogram_get_percentile (histogram, 0.50),
+		                       tmm_histogram_get_percentile (histogram, 0.95),
+		                       tmm_histogram_get_percentile (histogram, 0.99));
+	}
+
+	g_variant_builder_add (&builder, "{sv}", "latencies",
+	                       g_variant_builder_end (&dict));
+
+	g_variant_builder_init (&dict, G_VARIANT_TYPE ("a{st}"));
+
+	for (i = 0; i < N_FAILURES; i++)
+		g_variant_builder_add (&dict, "{st}", failure_names[i], priv->n_failures[i]);
+
+	g_variant_builder_add (&builder, "{sv}", "failures",
+	                       g_variant_builder_end (&dict));
+
+	/* Per tier (hits, misses) */
+	g_variant_builder_init (&dict, G_VARIANT_TYPE ("a{s(uu)}"));
+
+	for (i = 0; i < TMM_CACHE_N_TIERS; i++) {
+		tmm_cache_get_stats (priv->cache, i, &hits, &misses);
+		g_variant_builder_add (&dict, "{s(uu)}", cache_tier_names[i], hits, misses);
+	}
+
+	g_variant_builder_add (&builder, "{sv}", "cache",
+	                       g_variant_builder_end (&dict));
+
+	g_variant_builder_init (&dict, G_VARIANT_TYPE ("a{su}"));
+	g_variant_builder_add (&dict, "{su}", "remaining",
+	                       tracker_decorator_get_n_items (TRACKER_DECORATOR (decorator)));
+	g_variant_builder_add (&dict, "{su}", "active", priv->n_active_items);
+	g_variant_builder_add (&dict, "{su}", "throttled",
+	                       tmm_throttle_get_n_queued (priv->throttle));
+	g_variant_builder_add (&dict, "{su}", "extracting",
+	                       g_thread_pool_unprocessed (priv->extract_pool));
+	g_variant_builder_add (&builder, "{sv}", "queues",
+	                       g_variant_builder_end (&dict));
+
+	return g_variant_builder_end (&builder);
 }
 
 TrackerMiner *
-tmm_decorator_new (void)
+tmm_decorator_new (TmmBackend *backend)
 {
 	gchar *classes[] = {
 		"nfo:Video",
@@ -743,5 +3962,6 @@ tmm_decorator_new (void)
 	                     "name", "Media",
 	                     "data-source", TMM_DATA_SOURCE,
 	                     "class-names", classes,
+	                     "backend", backend,
 	                     NULL);
 }
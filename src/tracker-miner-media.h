@@ -22,8 +22,13 @@
 
 #include <libtracker-miner/tracker-miner.h>
 
+#include "tmm-backend.h"
+#include "tmm-guess.h"
+
 G_BEGIN_DECLS
 
+#define TMM_DATA_SOURCE "tmm:urn:83443497-b4cf-4341-8ac8-74058828f6db"
+
 #define TMM_TYPE_DECORATOR         (tmm_decorator_get_type())
 #define TMM_DECORATOR(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), TMM_TYPE_DECORATOR, TmmDecorator))
 #define TMM_DECORATOR_CLASS(c)     (G_TYPE_CHECK_CLASS_CAST ((c), TMM_TYPE_DECORATOR, TmmDecoratorClass))
@@ -31,8 +36,16 @@ G_BEGIN_DECLS
 #define TMM_IS_DECORATOR_CLASS(c)  (G_TYPE_CHECK_CLASS_TYPE ((c),  TMM_TYPE_DECORATOR))
 #define TMM_DECORATOR_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), TMM_TYPE_DECORATOR, TmmDecoratorClass))
 
+#define TMM_DECORATOR_ERROR (tmm_decorator_error_quark ())
+
+typedef enum {
+	TMM_DECORATOR_ERROR_NOT_FOUND,
+	TMM_DECORATOR_ERROR_BACKED_OFF
+} TmmDecoratorError;
+
 typedef struct _TmmDecorator TmmDecorator;
 typedef struct _TmmDecoratorClass TmmDecoratorClass;
+typedef struct _TmmDecoratorStats TmmDecoratorStats;
 
 struct _TmmDecorator {
 	TrackerDecoratorFS parent_instance;
@@ -42,9 +55,51 @@ struct _TmmDecoratorClass {
 	TrackerDecoratorFSClass parent_class;
 };
 
+/* Latencies are end to end per item, in microseconds */
+struct _TmmDecoratorStats {
+	guint64 n_items;
+	guint64 n_requests;
+	gdouble items_per_second;
+	gdouble requests_per_item;
+
+	guint64 latency_p50;
+	guint64 latency_p95;
+	guint64 latency_p99;
+
+	/* Items being looked up, and the memory they hold */
+	guint n_live_items;
+	guint64 live_bytes;
+
+	/* In KiB */
+	guint64 rss;
+	guint64 peak_rss;
+};
+
 GType          tmm_decorator_get_type (void) G_GNUC_CONST;
+GQuark         tmm_decorator_error_quark (void);
+
+TrackerMiner * tmm_decorator_new      (TmmBackend *backend);
+
+void     tmm_decorator_process_file_async  (TmmDecorator          *decorator,
+                                            GFile                 *file,
+                                            const gchar           *urn,
+                                            const TmmGuess        *guess,
+                                            TrackerSparqlBuilder  *sparql,
+                                            GCancellable          *cancellable,
+                                            GAsyncReadyCallback    callback,
+                                            gpointer               user_data);
+gboolean tmm_decorator_process_file_finish (TmmDecorator          *decorator,
+                                            GAsyncResult          *result,
+                                            GError               **error);
+void     tmm_decorator_file_committed      (TmmDecorator          *decorator,
+                                            const gchar           *urn,
+                                            gboolean               committed);
+
+void     tmm_decorator_save_cache          (TmmDecorator          *decorator);
 
-TrackerMiner * tmm_decorator_new      (void);
+void     tmm_decorator_get_stats           (TmmDecorator          *decorator,
+                                            TmmDecoratorStats     *stats);
+GVariant * tmm_decorator_get_statistics    (TmmDecorator          *decorator);
 
 G_END_DECLS
 